@@ -0,0 +1,106 @@
+#include "pch.hpp"
+#include "ActionQueue.hpp"
+
+//Compares ActionQueue with the binary heap it replaced on a load resembling emulation:
+//headTick is polled every bus cycle, timers reschedule themselves when fired, a few short lived actions come and go.
+
+namespace
+{
+
+//the former ActionQueue implementation
+class HeapActionQueue
+{
+public:
+  void push( SequencedAction action )
+  {
+    mHeap.push_back( action );
+    std::push_heap( mHeap.begin(), mHeap.end(), later );
+  }
+
+  SequencedAction pop()
+  {
+    std::pop_heap( mHeap.begin(), mHeap.end(), later );
+    auto result = mHeap.back();
+    mHeap.pop_back();
+    return result;
+  }
+
+  uint64_t headTick() const
+  {
+    return mHeap.empty() ? ~0ull : mHeap.front().getTick();
+  }
+
+private:
+  static bool later( SequencedAction left, SequencedAction right )
+  {
+    return right.before( left );
+  }
+
+  std::vector<SequencedAction> mHeap;
+};
+
+static constexpr uint64_t CYCLES = 200'000'000;
+static constexpr uint64_t TIMER_PERIODS[] = { 1024, 159 * 16, 4000, 2048 * 3, 16 * 100, 16 * 7, 64 * 33, 128 * 5, 16 * 250, 32 * 13, 16 * 41, 16 * 52 };
+
+template<typename Queue>
+uint64_t simulate( Queue & queue )
+{
+  for ( size_t i = 0; i < std::size( TIMER_PERIODS ); ++i )
+  {
+    queue.push( { (Action)( (int)Action::FIRE_TIMER0 + i ), TIMER_PERIODS[i] } );
+  }
+
+  uint64_t executed = 0;
+  uint64_t tick = 0;
+  while ( tick < CYCLES )
+  {
+    if ( queue.headTick() <= tick )
+    {
+      auto action = queue.pop();
+      executed += (uint64_t)action.getAction();
+      switch ( action.getAction() )
+      {
+      case Action::DISPLAY_DMA:
+        queue.push( { Action::ASSERT_IRQ, tick + 5 } );
+        break;
+      case Action::ASSERT_IRQ:
+        break;
+      default:
+        {
+          size_t timer = (size_t)action.getAction() - (size_t)Action::FIRE_TIMER0;
+          queue.push( { action.getAction(), action.getTick() + TIMER_PERIODS[timer] } );
+          if ( timer == 0 )
+            queue.push( { Action::DISPLAY_DMA, tick + 40 } );
+        }
+        break;
+      }
+    }
+    else
+    {
+      //a bus cycle
+      tick += 5;
+    }
+  }
+
+  return executed;
+}
+
+template<typename Queue>
+void run( char const* name )
+{
+  Queue queue;
+  auto begin = std::chrono::steady_clock::now();
+  uint64_t checksum = simulate( queue );
+  auto end = std::chrono::steady_clock::now();
+  double ms = std::chrono::duration<double, std::milli>( end - begin ).count();
+  fmt::print( "{:<12} {:8.1f} ms  {:6.2f} ns/cycle  checksum {}\n", name, ms, ms * 1e6 / ( CYCLES / 5 ), checksum );
+}
+
+}
+
+int main()
+{
+  run<HeapActionQueue>( "heap" );
+  run<ActionQueue>( "ActionQueue" );
+  return 0;
+}
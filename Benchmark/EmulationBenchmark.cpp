@@ -0,0 +1,348 @@
+#include "pch.hpp"
+#include "Core.hpp"
+#include "ComLynxWire.hpp"
+#include "IInputSource.hpp"
+#include "ImageProperties.hpp"
+#include "InputFile.hpp"
+#include "ScriptDebuggerEscapes.hpp"
+
+//Throughput of the whole emulator on built-in synthetic BS93 programs, each stressing a different hot path.
+//Results are printed as JSON to be compared between releases.
+
+namespace
+{
+
+static constexpr int SAMPLES_PER_SECOND = 48000;
+static constexpr size_t SAMPLES_PER_BATCH = 256;
+static constexpr uint64_t WARMUP_FRAMES = 30;
+static constexpr double TICKS_PER_SECOND = 16'000'000.0;
+
+//just enough of a 65C02 assembler to write the workloads
+class Assembler
+{
+public:
+  static constexpr uint16_t LOAD_ADDRESS = 0x0400;
+
+  uint16_t here() const
+  {
+    return (uint16_t)( LOAD_ADDRESS + mCode.size() );
+  }
+
+  Assembler & op( std::initializer_list<uint8_t> bytes )
+  {
+    mCode.insert( mCode.end(), bytes );
+    return *this;
+  }
+
+  Assembler & abs( uint8_t opcode, uint16_t address )
+  {
+    return op( { opcode, (uint8_t)address, (uint8_t)( address >> 8 ) } );
+  }
+
+  //LDA #value; STA address
+  Assembler & poke( uint16_t address, uint8_t value )
+  {
+    op( { 0xa9, value } );
+    return abs( 0x8d, address );
+  }
+
+  Assembler & branch( uint8_t opcode, uint16_t target )
+  {
+    int offset = (int)target - ( here() + 2 );
+    assert( offset >= -128 && offset <= 127 );
+    return op( { opcode, (uint8_t)offset } );
+  }
+
+  Assembler & jmp( uint16_t target )
+  {
+    return abs( 0x4c, target );
+  }
+
+  //pads with zeros up to given address
+  Assembler & org( uint16_t address )
+  {
+    assert( address >= here() );
+    mCode.resize( address - LOAD_ADDRESS );
+    return *this;
+  }
+
+  std::vector<uint8_t> bs93() const
+  {
+    size_t size = mCode.size() + 10;
+    std::array<uint8_t, 10> const header{ 0x80, 0x08, LOAD_ADDRESS >> 8, LOAD_ADDRESS & 0xff, (uint8_t)( size >> 8 ), (uint8_t)size, 'B', 'S', '9', '3' };
+    std::vector<uint8_t> result( size );
+    std::ranges::copy( header, result.begin() );
+    std::ranges::copy( mCode, result.begin() + header.size() );
+    return result;
+  }
+
+private:
+  std::vector<uint8_t> mCode;
+};
+
+//color display of $C000 and one running audio channel
+void setupDisplay( Assembler & a )
+{
+  a.poke( 0xfd92, 0x0d ).poke( 0xfd94, 0x00 ).poke( 0xfd95, 0xc0 );
+  a.poke( 0xfd20, 0x7f ).poke( 0xfd21, 0x01 ).poke( 0xfd23, 0xff ).poke( 0xfd24, 0x20 ).poke( 0xfd25, 0x19 );
+}
+
+//CPU only: increments two pages of video and collision buffers and changes palette every pass
+std::vector<uint8_t> cpuProgram()
+{
+  Assembler a;
+  setupDisplay( a );
+  uint16_t loop = a.here();
+  a.op( { 0xa2, 0x00 } );                     //LDX #0
+  uint16_t inner = a.here();
+  a.abs( 0xfe, 0xc000 ).abs( 0xfe, 0xd000 );  //INC $C000,X; INC $D000,X
+  a.op( { 0xe8 } ).branch( 0xd0, inner );     //INX; BNE
+  a.abs( 0xee, 0xfdb1 ).abs( 0xee, 0xfda2 );  //INC palette registers
+  a.jmp( loop );
+  return a.bs93();
+}
+
+//Suzy: draws a 128x96 sprite over and over with the CPU asleep while the sprite engine works
+std::vector<uint8_t> spriteProgram()
+{
+  static constexpr uint16_t SCB = 0x0600;
+  static constexpr uint16_t SPRITE_DATA = 0x0700;
+
+  Assembler a;
+  setupDisplay( a );
+  a.poke( 0xfc83, 0xf3 ).poke( 0xfc90, 0x01 );
+  a.poke( 0xfc08, 0x00 ).poke( 0xfc09, 0xc0 ).poke( 0xfc0a, 0x00 ).poke( 0xfc0b, 0xd0 );
+  a.poke( 0xfc28, 0x00 ).poke( 0xfc29, 0x04 ).poke( 0xfc2a, 0x00 ).poke( 0xfc2b, 0x04 );
+  a.poke( 0xfc04, 0x00 ).poke( 0xfc05, 0x00 ).poke( 0xfc06, 0x00 ).poke( 0xfc07, 0x00 );
+  for ( uint8_t i = 0; i < 16; ++i )
+  {
+    a.poke( 0xfda0 + i, (uint8_t)( i * 0x11 ) ).poke( 0xfdb0 + i, (uint8_t)( i * 0x37 ) );
+  }
+  uint16_t loop = a.here();
+  a.poke( 0xfc10, SCB & 0xff ).poke( 0xfc11, SCB >> 8 ).poke( 0xfc92, 0x00 ).poke( 0xfc91, 0x01 );
+  a.abs( 0x9c, 0xfd91 );                      //STZ CPUSLEEP
+  uint16_t wait = a.here();
+  a.abs( 0xad, 0xfc92 ).op( { 0x29, 0x01 } ).branch( 0xd0, wait );
+  a.abs( 0xee, SCB + 8 ).abs( 0xee, SCB + 10 ); //move the sprite
+  a.jmp( loop );
+
+  a.org( SCB );
+  //SPRCTL0, SPRCTL1, SPRCOLL, SCBNEXT, SPRDLINE, HPOSSTRT, VPOSSTRT, SPRHSIZ, SPRVSIZ, palette
+  a.op( { 0xc4, 0x90, 0x20, 0x00, 0x00, SPRITE_DATA & 0xff, SPRITE_DATA >> 8, 0x10, 0x00, 0x02, 0x00, 0x00, 0x10, 0x00, 0x0c } );
+  a.op( { 0x01, 0x23, 0x45, 0x67, 0x89, 0xab, 0xcd, 0xef } );
+
+  a.org( SPRITE_DATA );
+  for ( uint8_t line = 0; line < 8; ++line )
+  {
+    a.op( { 0x05, (uint8_t)( 0x12 + line ), 0x34, (uint8_t)( 0x56 + line ), 0x78 } );
+  }
+  a.op( { 0x00 } );
+
+  return a.bs93();
+}
+
+//Timers and audio: four audio channels on the fastest clock and four timers interrupting tens of thousands times a second
+std::vector<uint8_t> timerProgram()
+{
+  static constexpr uint16_t IRQ_HANDLER = 0x0600;
+
+  Assembler a;
+  setupDisplay( a );
+  a.op( { 0x78 } );                           //SEI
+  a.poke( 0xfff9, 0x08 );                     //RAM in vector space
+  a.poke( 0xfffe, IRQ_HANDLER & 0xff ).poke( 0xffff, IRQ_HANDLER >> 8 );
+  for ( uint8_t channel = 0; channel < 4; ++channel )
+  {
+    uint16_t base = 0xfd20 + channel * 8;
+    a.poke( base + 0, 0x20 ).poke( base + 1, (uint8_t)( 0x11 << channel ) ).poke( base + 3, 0xa5 ).poke( base + 4, (uint8_t)( 0x08 + channel * 5 ) ).poke( base + 5, 0x18 );
+  }
+  a.poke( 0xfd50, 0x00 );                     //MSTEREO
+  static constexpr std::array<std::pair<uint8_t, uint8_t>, 4> timers{ { { 1, 19 }, { 3, 36 }, { 5, 63 }, { 7, 98 } } };
+  for ( auto [timer, backup] : timers )
+  {
+    uint16_t base = 0xfd00 + timer * 4;
+    a.poke( base + 0, backup ).poke( base + 1, 0x98 ); //interrupt, reload, count, 1us clock
+  }
+  a.op( { 0x58 } );                           //CLI
+  uint16_t loop = a.here();
+  a.abs( 0xee, 0xc000 ).jmp( loop );
+
+  a.org( IRQ_HANDLER );
+  a.op( { 0x48 } ).abs( 0xad, 0xfd81 ).abs( 0x8d, 0xfd80 ).op( { 0x68, 0x40 } ); //PHA; LDA INTSET; STA INTRST; PLA; RTI
+
+  return a.bs93();
+}
+
+//Menu screen: the CPU spins most of the frame waiting for a flag set by vertical blank interrupt
+std::vector<uint8_t> idleProgram()
+{
+  static constexpr uint16_t IRQ_HANDLER = 0x0600;
+  static constexpr uint8_t FLAG = 0x80;
+
+  Assembler a;
+  setupDisplay( a );
+  a.op( { 0x78 } );                           //SEI
+  a.poke( 0xfff9, 0x08 );                     //RAM in vector space
+  a.poke( 0xfffe, IRQ_HANDLER & 0xff ).poke( 0xffff, IRQ_HANDLER >> 8 );
+  a.abs( 0xad, 0xfd09 ).op( { 0x09, 0x80 } ).abs( 0x8d, 0xfd09 ); //enable timer 2 interrupt
+  a.op( { 0x64, FLAG, 0x58 } );               //STZ FLAG; CLI
+  uint16_t loop = a.here();
+  uint16_t wait = a.here();
+  a.op( { 0xa5, FLAG } ).branch( 0xf0, wait ); //LDA FLAG; BEQ
+  a.op( { 0x64, FLAG } );                     //STZ FLAG
+  a.abs( 0xee, 0xc000 ).abs( 0xee, 0xfdb1 );  //some per frame work
+  a.jmp( loop );
+
+  a.org( IRQ_HANDLER );
+  a.op( { 0x48 } ).abs( 0xad, 0xfd81 ).abs( 0x8d, 0xfd80 ); //PHA; LDA INTSET; STA INTRST
+  a.op( { 0xe6, FLAG, 0x68, 0x40 } );         //INC FLAG; PLA; RTI
+
+  return a.bs93();
+}
+
+//Suzy math: a multiplication and a division per pass with results read back
+std::vector<uint8_t> mathProgram()
+{
+  Assembler a;
+  setupDisplay( a );
+  a.poke( 0xfc92, 0x00 );                     //unsigned math without accumulation
+  uint16_t loop = a.here();
+  a.op( { 0xa2, 0x00 } );                     //LDX #0
+  uint16_t inner = a.here();
+  a.op( { 0x8a } );                           //TXA
+  a.abs( 0x8d, 0xfc52 ).abs( 0x8d, 0xfc54 );  //MATHD, MATHB
+  a.poke( 0xfc53, 0x12 ).poke( 0xfc55, 0x34 ); //MATHC, MATHA starts multiplication
+  a.abs( 0xad, 0xfc63 ).abs( 0x9d, 0xc000 );  //LDA MATHE; STA $C000,X
+  a.poke( 0xfc56, 0x00 ).op( { 0x8a } ).op( { 0x09, 0x01 } ).abs( 0x8d, 0xfc57 ); //MATHP, MATHN = X | 1
+  a.poke( 0xfc60, 0x78 ).poke( 0xfc61, 0x56 ).poke( 0xfc62, 0x34 ).poke( 0xfc63, 0x12 ); //MATHE starts division
+  a.abs( 0xad, 0xfc55 ).abs( 0x9d, 0xd000 );  //LDA MATHA; STA $D000,X
+  a.op( { 0xe8 } ).branch( 0xd0, inner );     //INX; BNE
+  a.jmp( loop );
+  return a.bs93();
+}
+
+struct Workload
+{
+  char const* name;
+  std::vector<uint8_t> ( *program )();
+};
+
+static constexpr Workload WORKLOADS[] = {
+  { "cpu", cpuProgram },
+  { "sprite", spriteProgram },
+  { "timer", timerProgram },
+  { "math", mathProgram },
+  { "idle", idleProgram },
+};
+
+class CountingVideoSink : public IVideoSink
+{
+public:
+  void newFrame( uint64_t tick, uint8_t hbackup ) override
+  {
+    mFrames += 1;
+  }
+  void newRow( uint64_t tick, int row ) override {}
+  void emitScreenData( std::span<uint8_t const> data ) override {}
+  void updateColorReg( uint8_t reg, uint8_t value ) override {}
+
+  uint64_t frames() const
+  {
+    return mFrames;
+  }
+
+private:
+  uint64_t mFrames = 0;
+};
+
+class NullInputSource : public IInputSource
+{
+public:
+  KeyInput getInput( bool leftHand ) const override
+  {
+    return KeyInput{};
+  }
+};
+
+struct Result
+{
+  uint64_t frames;
+  uint64_t ticks;
+  uint64_t actions;
+  double seconds;
+};
+
+Result run( Workload const& workload, uint64_t frames, CpuEngine engine )
+{
+  std::shared_ptr<ImageProperties> imageProperties;
+  InputFile inputFile{ workload.program(), workload.name, imageProperties };
+  assert( inputFile.valid() );
+
+  auto videoSink = std::make_shared<CountingVideoSink>();
+  auto core = std::make_shared<Core>( *imageProperties, std::make_shared<ComLynxWire>(), videoSink, std::make_shared<NullInputSource>(),
+    inputFile, nullptr, std::make_shared<ScriptDebuggerEscapes>() );
+  core->setCpuEngine( engine );
+
+  std::vector<AudioSample> samples( SAMPLES_PER_BATCH );
+
+  while ( videoSink->frames() < WARMUP_FRAMES )
+    core->advanceAudio( SAMPLES_PER_SECOND, samples, RunMode::RUN );
+
+  uint64_t beginFrames = videoSink->frames();
+  uint64_t beginTick = core->tick();
+  uint64_t beginActions = core->executedActions();
+  auto begin = std::chrono::steady_clock::now();
+
+  while ( videoSink->frames() < beginFrames + frames )
+    core->advanceAudio( SAMPLES_PER_SECOND, samples, RunMode::RUN );
+
+  auto end = std::chrono::steady_clock::now();
+
+  return Result{ videoSink->frames() - beginFrames, core->tick() - beginTick, core->executedActions() - beginActions, std::chrono::duration<double>( end - begin ).count() };
+}
+
+}
+
+int main( int argc, char* argv[] )
+{
+  uint64_t frames = 1200;
+  CpuEngine engine = CpuEngine::INLINE;
+  std::vector<std::string_view> selected;
+
+  for ( int i = 1; i < argc; ++i )
+  {
+    std::string_view arg{ argv[i] };
+    if ( ( arg == "-f" || arg == "--frames" ) && i + 1 < argc )
+      frames = std::strtoull( argv[++i], nullptr, 10 );
+    else if ( ( arg == "-e" || arg == "--engine" ) && i + 1 < argc )
+      engine = std::string_view{ argv[++i] } == "coroutine" ? CpuEngine::COROUTINE : CpuEngine::INLINE;
+    else if ( arg.starts_with( "-" ) )
+    {
+      fmt::print( stderr, "Usage: EmulationBenchmark [--frames N] [--engine inline|coroutine] [cpu|sprite|timer|math|idle]...\n" );
+      return 2;
+    }
+    else
+      selected.push_back( arg );
+  }
+
+  fmt::print( "{{\n  \"engine\": \"{}\",\n  \"frames\": {},\n  \"workloads\": [", engine == CpuEngine::INLINE ? "inline" : "coroutine", frames );
+
+  char const* separator = "";
+  for ( auto const& workload : WORKLOADS )
+  {
+    if ( !selected.empty() && std::ranges::find( selected, std::string_view{ workload.name } ) == selected.end() )
+      continue;
+
+    auto result = run( workload, frames, engine );
+    double emulatedSeconds = result.ticks / TICKS_PER_SECOND;
+
+    fmt::print( "{}\n    {{ \"name\": \"{}\", \"frames\": {}, \"ticks\": {}, \"seconds\": {:.6f}, \"emulatedMHz\": {:.2f}, \"realtime\": {:.2f}, \"nsPerFrame\": {:.0f}, \"eventsPerSecond\": {:.0f} }}",
+      separator, workload.name, result.frames, result.ticks, result.seconds, result.ticks / result.seconds / 1e6, emulatedSeconds / result.seconds,
+      result.seconds * 1e9 / result.frames, result.actions / result.seconds );
+    separator = ",";
+  }
+
+  fmt::print( "\n  ]\n}}\n" );
+
+  return 0;
+}
@@ -0,0 +1,108 @@
+#include "pch.hpp"
+#include "FrameRenderer.hpp"
+#include "ScreenRenderingBuffer.hpp"
+#include "Utility.hpp"
+
+//Measures FrameRenderer on synthetic frames with palette changes in the middle of lines
+//and checks the YUV420 conversion against a plain scalar one.
+
+namespace
+{
+
+static constexpr int FRAMES = 20000;
+
+std::shared_ptr<ScreenRenderingBuffer> makeFrame( std::mt19937 & gen )
+{
+  auto frame = std::make_shared<ScreenRenderingBuffer>();
+  std::uniform_int_distribution<int> byte{ 0, 255 };
+  std::array<uint8_t, SCREEN_WIDTH / 2> data;
+
+  for ( int row = 104; row >= 0; --row )
+  {
+    frame->newRow( row );
+    for ( auto & b : data )
+      b = (uint8_t)byte( gen );
+    //palette is changed a few times during each line
+    frame->pushScreenBytes( std::span{ data }.subspan( 0, 20 ) );
+    frame->pushColorChage( (uint8_t)( row & 0x0f ), (uint8_t)byte( gen ) );
+    frame->pushScreenBytes( std::span{ data }.subspan( 20, 40 ) );
+    frame->pushColorChage( (uint8_t)( 0x10 | ( row & 0x0f ) ), (uint8_t)byte( gen ) );
+    frame->pushScreenBytes( std::span{ data }.subspan( 60 ) );
+  }
+
+  return frame;
+}
+
+void referenceYUV420( std::span<FrameRenderer::Pixel const> src, std::vector<uint8_t> & y, std::vector<uint8_t> & u, std::vector<uint8_t> & v )
+{
+  for ( int i = 0; i < SCREEN_WIDTH * SCREEN_HEIGHT; ++i )
+  {
+    auto p = src[i];
+    y[i] = (uint8_t)( ( ( 66 * p.r + 129 * p.g + 25 * p.b + 128 ) >> 8 ) + 16 );
+  }
+
+  for ( int cy = 0; cy < SCREEN_HEIGHT / 2; ++cy )
+  {
+    for ( int cx = 0; cx < SCREEN_WIDTH / 2; ++cx )
+    {
+      int r = 0, g = 0, b = 0;
+      for ( int i = 0; i < 4; ++i )
+      {
+        auto p = src[( cy * 2 + i / 2 ) * SCREEN_WIDTH + cx * 2 + i % 2];
+        r += p.r;
+        g += p.g;
+        b += p.b;
+      }
+      r = ( r + 2 ) >> 2;
+      g = ( g + 2 ) >> 2;
+      b = ( b + 2 ) >> 2;
+      u[cy * SCREEN_WIDTH / 2 + cx] = (uint8_t)( ( ( -38 * r - 74 * g + 112 * b + 128 ) >> 8 ) + 128 );
+      v[cy * SCREEN_WIDTH / 2 + cx] = (uint8_t)( ( ( 112 * r - 94 * g - 18 * b + 128 ) >> 8 ) + 128 );
+    }
+  }
+}
+
+template<typename F>
+void run( char const* name, F && f )
+{
+  auto begin = std::chrono::steady_clock::now();
+  for ( int i = 0; i < FRAMES; ++i )
+    f( i );
+  auto end = std::chrono::steady_clock::now();
+  double ms = std::chrono::duration<double, std::milli>( end - begin ).count();
+  fmt::print( "{:<16} {:8.1f} ms  {:6.2f} us/frame  {:8.0f} fps\n", name, ms, ms * 1e3 / FRAMES, FRAMES * 1e3 / ms );
+}
+
+}
+
+int main()
+{
+  std::mt19937 gen{ 42 };
+  std::vector<std::shared_ptr<ScreenRenderingBuffer>> frames;
+  for ( int i = 0; i < 16; ++i )
+    frames.push_back( makeFrame( gen ) );
+
+  FrameRenderer renderer;
+  std::vector<FrameRenderer::Pixel> rgba( SCREEN_WIDTH * SCREEN_HEIGHT );
+  std::vector<uint8_t> y( SCREEN_WIDTH * SCREEN_HEIGHT ), u( SCREEN_WIDTH * SCREEN_HEIGHT / 4 ), v( SCREEN_WIDTH * SCREEN_HEIGHT / 4 );
+  std::vector<uint8_t> refY( y.size() ), refU( u.size() ), refV( v.size() );
+
+  for ( auto const& frame : frames )
+  {
+    renderer.renderRGBA( *frame, rgba );
+    FrameRenderer::convertYUV420( rgba, { y, u, v } );
+    referenceYUV420( rgba, refY, refU, refV );
+    if ( y != refY || u != refU || v != refV )
+    {
+      fmt::print( stderr, "YUV420 conversion differs from reference\n" );
+      return 1;
+    }
+  }
+
+  run( "renderRGBA", [&]( int i ) { renderer.renderRGBA( *frames[i % frames.size()], rgba ); } );
+  run( "convertYUV420", [&]( int i ) { FrameRenderer::convertYUV420( rgba, { y, u, v } ); } );
+  run( "reference YUV", [&]( int i ) { referenceYUV420( rgba, refY, refU, refV ); } );
+  run( "renderYUV420", [&]( int i ) { renderer.renderYUV420( *frames[i % frames.size()], { y, u, v } ); } );
+
+  return 0;
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+//FNV-1a 64 bit, stable across runs and platforms so results can be compared between machines
+class Hash
+{
+public:
+  void update( std::span<uint8_t const> data )
+  {
+    for ( uint8_t byte : data )
+    {
+      mValue = ( mValue ^ byte ) * PRIME;
+    }
+  }
+
+  template<typename T> requires std::is_trivially_copyable_v<T>
+  void update( T const& value )
+  {
+    update( std::span<uint8_t const>{ reinterpret_cast<uint8_t const*>( &value ), sizeof( T ) } );
+  }
+
+  uint64_t value() const
+  {
+    return mValue;
+  }
+
+private:
+  static constexpr uint64_t OFFSET_BASIS = 0xcbf29ce484222325ull;
+  static constexpr uint64_t PRIME = 0x100000001b3ull;
+
+  uint64_t mValue = OFFSET_BASIS;
+};
@@ -0,0 +1,398 @@
+#include "pch.hpp"
+#include "Core.hpp"
+#include "ComLynxWire.hpp"
+#ifndef _WIN32
+#include "ComLynxSharedWire.hpp"
+#endif
+#include "IInputSource.hpp"
+#include "ImageProperties.hpp"
+#include "ImageROM.hpp"
+#include "InputFile.hpp"
+#include "ScriptDebuggerEscapes.hpp"
+#include "WorkStealingPool.hpp"
+#include "LinkSession.hpp"
+#include "HostProfiler.hpp"
+#include "GuestProfiler.hpp"
+#include "CpuTrace.hpp"
+#include "InputMovie.hpp"
+#include "SymbolSource.hpp"
+#include "HeadlessVideoSink.hpp"
+#include "Hash.hpp"
+
+//Headless front-end for batch runs. Every image is emulated for given number of frames as fast as possible
+//and hashes of the last frame, of all emitted audio and of the RAM are printed one line per image.
+//With --fast audio is not sampled and only the last frame is emitted, the hash of audio is then of no data.
+//With --run-ahead N the last frame is the one N frames ahead of the machine.
+//With --seed N the random power on state of the CPU is derived from N instead of 0, so that hashes of a run are reproducible.
+//With --host-trace DIR host time of every image is profiled and written to DIR as Chrome trace named after the image.
+//With --guest-profile DIR emulated cycles of the guest code are written to DIR as callgrind profile named after the image.
+//With --cpu-trace DIR every executed instruction is written to DIR as binary CPU trace named after the image, see TraceDecoder.
+//With --replay-input DIR input of every image is replayed from the input movie in DIR named after the image.
+//With --link all images are connected by ComLynx in one LinkSession, each running on its own thread.
+//With --comlynx NAME all images are connected by ComLynx shared with other processes using the same name.
+//Images are run in parallel, each Core lives in one task of a work stealing pool.
+
+namespace
+{
+
+static constexpr int SAMPLES_PER_SECOND = 48000;
+//small enough to not overshoot requested frame count by more than a fraction of a frame
+static constexpr size_t SAMPLES_PER_BATCH = 256;
+
+class NullInputSource : public IInputSource
+{
+public:
+  KeyInput getInput( bool leftHand ) const override
+  {
+    return KeyInput{};
+  }
+};
+
+struct RunResult
+{
+  uint64_t frames;
+  uint64_t ticks;
+  uint64_t frameHash;
+  uint64_t audioHash;
+  uint64_t ramHash;
+  //replayed input movie was not read at the recorded ticks
+  bool desynchronized;
+};
+
+struct Options
+{
+  uint64_t frames = 600;
+  size_t jobs = std::thread::hardware_concurrency();
+  CpuEngine engine = CpuEngine::INLINE;
+  //no audio and only the last frame is emitted
+  bool fast = false;
+  int runAhead = 0;
+  //of the power on state of the CPU, input movie has its own
+  uint32_t seed = 0;
+  bool link = false;
+  std::string comLynx;
+  std::filesystem::path hostTrace;
+  std::filesystem::path guestProfile;
+  std::filesystem::path cpuTrace;
+  std::filesystem::path replayInput;
+  std::filesystem::path bootROM;
+  std::vector<std::filesystem::path> images;
+};
+
+//input movie of the image if requested, null if not and empty if the movie is bad
+std::optional<std::shared_ptr<InputReplayer>> openInputMovie( std::filesystem::path const& path, Options const& options )
+{
+  if ( options.replayInput.empty() )
+    return std::shared_ptr<InputReplayer>{};
+
+  auto replayer = std::make_shared<InputReplayer>( options.replayInput / ( path.stem().string() + ".fxm" ) );
+  if ( !replayer->good() )
+  {
+    fmt::print( stderr, "Bad input movie for {}\n", path.string() );
+    return std::nullopt;
+  }
+
+  return replayer;
+}
+
+//null input movie means no input
+std::shared_ptr<Core> makeCore( ImageProperties const& imageProperties, InputFile const& inputFile, std::shared_ptr<ComLynxWire> comLynxWire,
+  std::shared_ptr<HeadlessVideoSink> videoSink, std::shared_ptr<InputReplayer> inputMovie, std::shared_ptr<ImageROM const> const& bootROM, Options const& options )
+{
+  std::shared_ptr<IInputSource> inputSource = inputMovie;
+  if ( !inputSource )
+    inputSource = std::make_shared<NullInputSource>();
+
+  auto core = std::make_shared<Core>( imageProperties, std::move( comLynxWire ), std::move( videoSink ), std::move( inputSource ),
+    inputFile, bootROM, std::make_shared<ScriptDebuggerEscapes>() );
+  core->setResetSeed( inputMovie ? inputMovie->seed() : options.seed );
+  core->setCpuEngine( options.engine );
+  core->setRunAhead( options.runAhead );
+  return core;
+}
+
+RunResult runCore( Core & core, HeadlessVideoSink const& videoSink, std::filesystem::path const& path, Options const& options )
+{
+  std::shared_ptr<HostProfiler> hostProfiler;
+  if ( !options.hostTrace.empty() )
+  {
+    hostProfiler = std::make_shared<HostProfiler>();
+    core.setHostProfiler( hostProfiler );
+  }
+
+  std::shared_ptr<GuestProfiler> guestProfiler;
+  if ( !options.guestProfile.empty() )
+  {
+    guestProfiler = std::make_shared<GuestProfiler>();
+    core.setGuestProfiler( guestProfiler );
+  }
+
+  if ( !options.cpuTrace.empty() )
+    core.setCpuTrace( std::make_shared<CpuTraceWriter>( options.cpuTrace / ( path.stem().string() + ".fxt" ) ) );
+
+  std::vector<AudioSample> samples( SAMPLES_PER_BATCH );
+  Hash audioHash;
+  uint64_t frames{};
+
+  if ( options.fast )
+  {
+    core.runFrames( (int)options.frames, OutputPolicy::LAST_FRAME );
+    frames = options.frames;
+  }
+  else
+  {
+    while ( videoSink.frames() < options.frames )
+    {
+      core.advanceAudio( SAMPLES_PER_SECOND, samples, RunMode::RUN );
+      audioHash.update( std::span<uint8_t const>{ reinterpret_cast<uint8_t const*>( samples.data() ), samples.size() * sizeof( AudioSample ) } );
+    }
+    frames = videoSink.frames();
+  }
+
+  //writer flushes the trace when released
+  core.setCpuTrace( {} );
+
+  if ( hostProfiler )
+  {
+    std::ofstream out{ options.hostTrace / ( path.stem().string() + ".json" ) };
+    hostProfiler->writeChromeTrace( out );
+  }
+
+  if ( guestProfiler )
+  {
+    //labels of the image are taken from .lab file next to it
+    auto labPath = std::filesystem::path{ path }.replace_extension( ".lab" );
+    SymbolSource symbols{ std::filesystem::exists( labPath ) ? labPath : std::filesystem::path{} };
+    std::ofstream out{ options.guestProfile / ( "callgrind.out." + path.stem().string() ) };
+    guestProfiler->writeCallgrind( out, [&]( uint16_t address )
+    {
+      if ( auto name = symbols.name( address ) )
+        return *name;
+      if ( auto nearest = symbols.nearest( address ) )
+        return fmt::format( "{}+${:x}", *nearest->name, nearest->offset );
+      return std::string{};
+    } );
+  }
+
+  Hash ramHash;
+  ramHash.update( std::span<uint8_t const>{ core.debugRAM(), 65536 } );
+
+  return RunResult{ frames, core.tick(), videoSink.lastFrameHash(), audioHash.value(), ramHash.value(), false };
+}
+
+std::optional<RunResult> runImage( std::filesystem::path const& path, std::shared_ptr<ImageROM const> const& bootROM, Options const& options )
+{
+  std::shared_ptr<ImageProperties> imageProperties;
+  InputFile inputFile{ path, imageProperties };
+  if ( !inputFile.valid() )
+    return std::nullopt;
+
+  std::shared_ptr<ComLynxWire> comLynxWire = std::make_shared<ComLynxWire>();
+#ifndef _WIN32
+  if ( !options.comLynx.empty() )
+  {
+    comLynxWire = ComLynxSharedWire::open( options.comLynx );
+    if ( !comLynxWire )
+    {
+      fmt::print( stderr, "Can't join ComLynx {}\n", options.comLynx );
+      return std::nullopt;
+    }
+  }
+#endif
+
+  auto inputMovie = openInputMovie( path, options );
+  if ( !inputMovie )
+    return std::nullopt;
+
+  auto videoSink = std::make_shared<HeadlessVideoSink>();
+  auto core = makeCore( *imageProperties, inputFile, comLynxWire, videoSink, *inputMovie, bootROM, options );
+
+  auto result = runCore( *core, *videoSink, path, options );
+  result.desynchronized = *inputMovie && ( *inputMovie )->desynchronized();
+  return result;
+}
+
+//all images are linked or none is run
+std::vector<std::optional<RunResult>> runLinked( std::shared_ptr<ImageROM const> const& bootROM, Options const& options )
+{
+  std::vector<std::optional<RunResult>> results( options.images.size() );
+  std::vector<std::shared_ptr<ImageProperties>> imageProperties( options.images.size() );
+  std::vector<InputFile> inputFiles;
+  inputFiles.reserve( options.images.size() );
+  std::vector<std::shared_ptr<InputReplayer>> inputMovies;
+
+  for ( size_t i = 0; i < options.images.size(); ++i )
+  {
+    inputFiles.emplace_back( options.images[i], imageProperties[i] );
+    if ( !inputFiles.back().valid() )
+      return results;
+
+    auto inputMovie = openInputMovie( options.images[i], options );
+    if ( !inputMovie )
+      return results;
+    inputMovies.push_back( *inputMovie );
+  }
+
+  std::vector<std::shared_ptr<HeadlessVideoSink>> videoSinks;
+  LinkSession session{ options.images.size(), [&]( std::shared_ptr<ComLynxWire> comLynxWire )
+  {
+    size_t i = videoSinks.size();
+    videoSinks.push_back( std::make_shared<HeadlessVideoSink>() );
+    return makeCore( *imageProperties[i], inputFiles[i], std::move( comLynxWire ), videoSinks[i], inputMovies[i], bootROM, options );
+  } };
+
+  session.run( [&]( size_t index, Core & core )
+  {
+    results[index] = runCore( core, *videoSinks[index], options.images[index], options );
+    results[index]->desynchronized = inputMovies[index] && inputMovies[index]->desynchronized();
+  } );
+
+  return results;
+}
+
+std::optional<Options> parseOptions( int argc, char* argv[] )
+{
+  Options options;
+
+  for ( int i = 1; i < argc; ++i )
+  {
+    std::string_view arg{ argv[i] };
+
+    if ( ( arg == "-f" || arg == "--frames" ) && i + 1 < argc )
+    {
+      options.frames = std::strtoull( argv[++i], nullptr, 10 );
+    }
+    else if ( ( arg == "-j" || arg == "--jobs" ) && i + 1 < argc )
+    {
+      options.jobs = std::strtoull( argv[++i], nullptr, 10 );
+    }
+    else if ( ( arg == "-e" || arg == "--engine" ) && i + 1 < argc )
+    {
+      std::string_view engine{ argv[++i] };
+      if ( engine == "coroutine" )
+        options.engine = CpuEngine::COROUTINE;
+      else if ( engine == "inline" )
+        options.engine = CpuEngine::INLINE;
+      else
+        return std::nullopt;
+    }
+    else if ( arg == "--fast" )
+    {
+      options.fast = true;
+    }
+    else if ( arg == "--run-ahead" && i + 1 < argc )
+    {
+      options.runAhead = std::atoi( argv[++i] );
+    }
+    else if ( arg == "--seed" && i + 1 < argc )
+    {
+      options.seed = (uint32_t)std::strtoul( argv[++i], nullptr, 10 );
+    }
+    else if ( arg == "--host-trace" && i + 1 < argc )
+    {
+      options.hostTrace = argv[++i];
+    }
+    else if ( arg == "--guest-profile" && i + 1 < argc )
+    {
+      options.guestProfile = argv[++i];
+    }
+    else if ( arg == "--cpu-trace" && i + 1 < argc )
+    {
+      options.cpuTrace = argv[++i];
+    }
+    else if ( arg == "--replay-input" && i + 1 < argc )
+    {
+      options.replayInput = argv[++i];
+    }
+    else if ( arg == "--link" )
+    {
+      options.link = true;
+    }
+    else if ( arg == "--comlynx" && i + 1 < argc )
+    {
+      options.comLynx = argv[++i];
+    }
+    else if ( ( arg == "-b" || arg == "--bootrom" ) && i + 1 < argc )
+    {
+      options.bootROM = argv[++i];
+    }
+    else if ( arg.starts_with( "-" ) )
+    {
+      return std::nullopt;
+    }
+    else
+    {
+      options.images.push_back( std::filesystem::absolute( arg ) );
+    }
+  }
+
+  if ( options.images.empty() )
+    return std::nullopt;
+
+  //run-ahead reads input again after loading a state, which a movie can't replay
+  if ( !options.replayInput.empty() && options.runAhead > 0 )
+    return std::nullopt;
+
+  return options;
+}
+
+}
+
+int main( int argc, char* argv[] )
+{
+  auto options = parseOptions( argc, argv );
+  if ( !options )
+  {
+    fmt::print( stderr, "Usage: HeadlessFelix [--frames N] [--jobs N] [--engine inline|coroutine] [--fast] [--run-ahead N] [--seed N] [--link] [--comlynx NAME] [--host-trace DIR] [--guest-profile DIR] [--cpu-trace DIR] [--replay-input DIR] [--bootrom lynxboot.img] image...\n" );
+    return 2;
+  }
+
+  std::shared_ptr<ImageROM const> bootROM;
+  if ( !options->bootROM.empty() )
+  {
+    bootROM = ImageROM::create( options->bootROM );
+    if ( !bootROM )
+    {
+      fmt::print( stderr, "Bad boot ROM {}\n", options->bootROM.string() );
+      return 2;
+    }
+  }
+
+  std::vector<std::optional<RunResult>> results( options->images.size() );
+
+  if ( options->link )
+  {
+    results = runLinked( bootROM, *options );
+  }
+  else
+  {
+    WorkStealingPool pool{ std::min( options->jobs, options->images.size() ) };
+    for ( size_t i = 0; i < options->images.size(); ++i )
+    {
+      pool.submit( [&, i]
+      {
+        results[i] = runImage( options->images[i], bootROM, *options );
+      } );
+    }
+    pool.wait();
+  }
+
+  int result = 0;
+
+  for ( size_t i = 0; i < options->images.size(); ++i )
+  {
+    auto const& image = options->images[i];
+    if ( auto const& run = results[i] )
+    {
+      fmt::print( "{} frames={} ticks={} frame={:016x} audio={:016x} ram={:016x}{}\n", image.string(), run->frames, run->ticks, run->frameHash, run->audioHash, run->ramHash,
+        run->desynchronized ? " input=desynchronized" : "" );
+    }
+    else
+    {
+      fmt::print( "{} error=bad_image\n", image.string() );
+      result = 1;
+    }
+  }
+
+  return result;
+}
@@ -0,0 +1,53 @@
+#include "pch.hpp"
+#include "HeadlessVideoSink.hpp"
+#include "ScreenRenderingBuffer.hpp"
+#include "Utility.hpp"
+
+HeadlessVideoSink::HeadlessVideoSink() : mRenderer{}, mActiveFrame{}, mPixels( SCREEN_WIDTH * SCREEN_HEIGHT ), mLastFrameHash{}, mFrames{}
+{
+}
+
+HeadlessVideoSink::~HeadlessVideoSink() = default;
+
+void HeadlessVideoSink::newFrame( uint64_t tick, uint8_t hbackup )
+{
+  if ( mActiveFrame )
+  {
+    mRenderer.renderRGBA( *mActiveFrame, mPixels );
+    Hash hash;
+    hash.update( std::span<uint8_t const>{ reinterpret_cast<uint8_t const*>( mPixels.data() ), mPixels.size() * sizeof( FrameRenderer::Pixel ) } );
+    mLastFrameHash = hash.value();
+  }
+  mFrames += 1;
+  mActiveFrame = std::make_unique<ScreenRenderingBuffer>();
+}
+
+void HeadlessVideoSink::newRow( uint64_t tick, int row )
+{
+  if ( mActiveFrame )
+    mActiveFrame->newRow( row );
+}
+
+void HeadlessVideoSink::emitScreenData( std::span<uint8_t const> data )
+{
+  if ( mActiveFrame )
+    mActiveFrame->pushScreenBytes( data );
+}
+
+void HeadlessVideoSink::updateColorReg( uint8_t reg, uint8_t value )
+{
+  if ( mActiveFrame )
+    mActiveFrame->pushColorChage( reg, value );
+  else
+    mRenderer.updatePalette( reg, value );
+}
+
+uint64_t HeadlessVideoSink::frames() const
+{
+  return mFrames;
+}
+
+uint64_t HeadlessVideoSink::lastFrameHash() const
+{
+  return mLastFrameHash;
+}
@@ -0,0 +1,30 @@
+#pragma once
+#include "IVideoSink.hpp"
+#include "FrameRenderer.hpp"
+#include "Hash.hpp"
+
+class ScreenRenderingBuffer;
+
+//Video sink that does not display anything. Every finished frame is rendered to RGBA
+//and the hash of its pixels is kept, so hashes do not depend on how the frame was emitted.
+class HeadlessVideoSink : public IVideoSink
+{
+public:
+  HeadlessVideoSink();
+  ~HeadlessVideoSink() override;
+
+  void newFrame( uint64_t tick, uint8_t hbackup ) override;
+  void newRow( uint64_t tick, int row ) override;
+  void emitScreenData( std::span<uint8_t const> data ) override;
+  void updateColorReg( uint8_t reg, uint8_t value ) override;
+
+  uint64_t frames() const;
+  uint64_t lastFrameHash() const;
+
+private:
+  FrameRenderer mRenderer;
+  std::unique_ptr<ScreenRenderingBuffer> mActiveFrame;
+  std::vector<FrameRenderer::Pixel> mPixels;
+  uint64_t mLastFrameHash;
+  uint64_t mFrames;
+};
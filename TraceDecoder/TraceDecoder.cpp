@@ -0,0 +1,115 @@
+#include "pch.hpp"
+#include "CPU.hpp"
+#include "CpuTrace.hpp"
+#include "SymbolSource.hpp"
+#include "TraceHelper.hpp"
+
+//Renders binary CPU trace written by CpuTraceWriter, e.g. by HeadlessFelix --cpu-trace, as text.
+//Every instruction is printed on one line prefixed by its tick, in the format of the text trace of Core::setLog.
+//Addresses are named like in the text trace, with labels from given .lab file on top.
+//Comments of the text trace made by the emulated hardware are not part of the binary trace.
+
+namespace
+{
+
+struct Options
+{
+  std::filesystem::path trace;
+  std::filesystem::path labels;
+  uint64_t from = 0;
+  uint64_t to = std::numeric_limits<uint64_t>::max();
+};
+
+std::optional<Options> parseOptions( int argc, char* argv[] )
+{
+  Options options{};
+
+  for ( int i = 1; i < argc; ++i )
+  {
+    std::string_view arg = argv[i];
+    if ( arg == "--from" && i + 1 < argc )
+    {
+      options.from = std::strtoull( argv[++i], nullptr, 10 );
+    }
+    else if ( arg == "--to" && i + 1 < argc )
+    {
+      options.to = std::strtoull( argv[++i], nullptr, 10 );
+    }
+    else if ( arg == "--labels" && i + 1 < argc )
+    {
+      options.labels = argv[++i];
+    }
+    else if ( arg.starts_with( "-" ) || !options.trace.empty() )
+    {
+      return std::nullopt;
+    }
+    else
+    {
+      options.trace = arg;
+    }
+  }
+
+  if ( options.trace.empty() )
+    return std::nullopt;
+
+  return options;
+}
+
+}
+
+int main( int argc, char* argv[] )
+{
+  auto options = parseOptions( argc, argv );
+  if ( !options )
+  {
+    fmt::print( stderr, "Usage: TraceDecoder [--labels image.lab] [--from TICK] [--to TICK] trace.fxt\n" );
+    return 2;
+  }
+
+  CpuTraceReader reader{ options->trace };
+  if ( !reader.good() )
+  {
+    fmt::print( stderr, "Bad CPU trace {}\n", options->trace.string() );
+    return 1;
+  }
+
+  TraceHelper traceHelper{};
+  if ( !options->labels.empty() )
+  {
+    SymbolSource symbols{ options->labels };
+    for ( uint32_t address = 0; address < 0x10000; ++address )
+    {
+      if ( auto name = symbols.name( (uint16_t)address ) )
+        traceHelper.updateLabel( (uint16_t)address, name->c_str() );
+    }
+  }
+
+  std::array<char, 1024> buf;
+  std::string out;
+  CpuTraceRecord record;
+  CPUState before;
+  CPUState after;
+
+  while ( reader.next( record ) )
+  {
+    if ( record.tick < options->from )
+      continue;
+    if ( record.tick > options->to )
+      break;
+
+    record.unpack( before, after );
+    int size = CPU::formatTrace( buf.data(), before, after, traceHelper, {} );
+    out += fmt::format( "{:>12} ", record.tick );
+    out.append( buf.data(), size );
+    out += '\n';
+
+    if ( out.size() >= 1 << 16 )
+    {
+      fwrite( out.data(), 1, out.size(), stdout );
+      out.clear();
+    }
+  }
+
+  fwrite( out.data(), 1, out.size(), stdout );
+  return 0;
+}
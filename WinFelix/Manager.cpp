@@ -19,12 +19,12 @@
 #include "ImageProperties.hpp"
 #include "LuaProxies.hpp"
 #include "CPU.hpp"
-#include "DebugRAM.hpp"
 #include "BaseRenderer.hpp"
 #include "IInputSource.hpp"
 #include "ISystemDriver.hpp"
 #include "VGMWriter.hpp"
 #include "TraceHelper.hpp"
+#include "InputMovie.hpp"
 
 
 Manager::Manager() : mUI{ *this },
@@ -403,6 +403,11 @@ void Manager::processLua( std::filesystem::path const& path )
   {
     mLogPath = *opt;
   }
+
+  if ( sol::optional<std::string> opt = mLua["recordInput"] )
+  {
+    mInputMoviePath = *opt;
+  }
 }
 
 std::optional<InputFile> Manager::computeInputFile()
@@ -440,8 +445,16 @@ void Manager::reset()
 
   if ( auto input = computeInputFile() )
   {
-    mInstance = std::make_shared<Core>( *mImageProperties, mComLynxWire, mRenderer->getVideoSink(), mSystemDriver->userInput(),
+    std::shared_ptr<IInputSource> inputSource = mSystemDriver->userInput();
+    //recorded session starts from a random reset state the movie can reproduce
+    uint32_t const resetSeed = std::random_device{}();
+    if ( !mInputMoviePath.empty() )
+      inputSource = std::make_shared<InputRecorder>( std::move( inputSource ), mInputMoviePath, resetSeed );
+
+    mInstance = std::make_shared<Core>( *mImageProperties, mComLynxWire, mRenderer->getVideoSink(), std::move( inputSource ),
       *input, getOptionalBootROM(), mScriptDebuggerEscapes );
+    if ( !mInputMoviePath.empty() )
+      mInstance->setResetSeed( resetSeed );
 
     updateRotation();
 
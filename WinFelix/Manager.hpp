@@ -104,6 +104,8 @@ private:
   std::shared_ptr<ImageProperties> mImageProperties;
   std::filesystem::path mArg;
   std::filesystem::path mLogPath;
+  //input of the session is recorded to a movie if set
+  std::filesystem::path mInputMoviePath;
   std::mutex mMutex;
   int64_t mRenderingTime;
 };
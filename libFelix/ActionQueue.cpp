@@ -1,5 +1,6 @@
 #include "pch.hpp"
 #include "ActionQueue.hpp"
+#include "StateArchive.hpp"
 
 SequencedAction::SequencedAction() : mData{}
 {
@@ -29,50 +30,118 @@ SequencedAction::operator bool() const
   return mData != 0;
 }
 
-ActionQueue::ActionQueue() : mHeap{}
+SequencedAction SequencedAction::never()
 {
+  SequencedAction result;
+  result.mData = ~0ull;
+  return result;
 }
 
-void ActionQueue::push( SequencedAction action )
+ActionQueue::ActionQueue() : mSlots( CAPACITY + 1 ), mBegin{}, mEnd{}
 {
-  mHeap.push_back( action );
-  std::push_heap( mHeap.begin(), mHeap.end() );
+  mSlots[mEnd] = SequencedAction::never();
 }
 
-SequencedAction ActionQueue::pop()
+void ActionQueue::push( SequencedAction action )
 {
-  if ( !mHeap.empty() )
+  auto type = action.getAction();
+  if ( type >= Action::FIRE_TIMER0 && type <= Action::FIRE_TIMERC )
   {
-    std::pop_heap( mHeap.begin(), mHeap.end() );
+    for ( size_t i = mBegin; i < mEnd; ++i )
+    {
+      if ( mSlots[i].getAction() == type )
+      {
+        remove( i );
+        break;
+      }
+    }
+  }
 
-    auto result = mHeap.back();
-    mHeap.pop_back();
-    return result;
+  if ( mEnd + 1 == mSlots.size() )
+  {
+    if ( mBegin > 0 )
+    {
+      std::copy( mSlots.begin() + mBegin, mSlots.begin() + mEnd, mSlots.begin() );
+      mEnd -= mBegin;
+      mBegin = 0;
+    }
+    else
+    {
+      mSlots.resize( 2 * mSlots.size() );
+    }
   }
-  else
+
+  size_t i = mEnd;
+  for ( ; i > mBegin && action.before( mSlots[i - 1] ); --i )
   {
-    return {};
+    mSlots[i] = mSlots[i - 1];
   }
+  mSlots[i] = action;
+  mSlots[++mEnd] = SequencedAction::never();
 }
 
-uint64_t ActionQueue::headTick() const
+SequencedAction ActionQueue::pop()
 {
-  assert( !empty() );
-  return mHeap.front().getTick();
+  if ( mBegin == mEnd )
+    return {};
+
+  auto result = mSlots[mBegin++];
+
+  if ( mBegin == mEnd )
+  {
+    mBegin = mEnd = 0;
+    mSlots[mEnd] = SequencedAction::never();
+  }
+
+  return result;
 }
 
 void ActionQueue::erase( Action action )
 {
-  for ( auto& e : mHeap )
+  for ( size_t i = mBegin; i < mEnd; )
   {
-    if ( e.getAction() == action )
+    if ( mSlots[i].getAction() == action )
     {
-      e.clear();
+      remove( i );
+    }
+    else
+    {
+      ++i;
     }
   }
 }
 
-bool ActionQueue::empty() const
+bool ActionQueue::contains( Action action ) const
 {
-  return mHeap.empty();
+  return std::any_of( mSlots.begin() + mBegin, mSlots.begin() + mEnd, [=]( SequencedAction const& slot )
+  {
+    return slot.getAction() == action;
+  } );
 }
+
+void ActionQueue::remove( size_t index )
+{
+  std::copy( mSlots.begin() + index + 1, mSlots.begin() + mEnd + 1, mSlots.begin() + index );
+  mEnd -= 1;
+}
+
+template<typename Archive>
+void ActionQueue::serialize( Archive & ar )
+{
+  std::vector<SequencedAction> actions{ mSlots.begin() + mBegin, mSlots.begin() + mEnd };
+  ar( actions );
+
+  if constexpr ( Archive::LOADING )
+  {
+    mBegin = mEnd = 0;
+    mSlots[mEnd] = SequencedAction::never();
+    for ( auto action : actions )
+    {
+      push( action );
+    }
+  }
+}
+
+template void ActionQueue::serialize<StateWriter>( StateWriter & );
+template void ActionQueue::serialize<StateReader>( StateReader & );
+template void ActionQueue::serialize<StateValidator>( StateValidator & );
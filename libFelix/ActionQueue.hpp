@@ -24,7 +24,6 @@ enum class Action
   ASSERT_RESET = 0x20,
   DESERT_IRQ = 0x11,
   DESERT_RESET = 0x21,
-  SAMPLE_AUDIO = 0x30,
   BATCH_END = 0x40,
   ACTIONS_END_
 };
@@ -44,29 +43,60 @@ public:
 
   explicit operator bool() const;
 
-  friend bool operator<( SequencedAction left, SequencedAction right )
+  //placeholder later than any real action
+  static SequencedAction never();
+
+  //earlier tick first, lower action first on the same tick
+  bool before( SequencedAction other ) const
   {
-    return left.mData > right.mData;
+    return mData < other.mData;
   }
 
 private:
   uint64_t mData;
 };
 
+//Array kept sorted by tick instead of a heap. There are rarely more than a handful of pending actions:
+//one per timer, display DMA, audio sampling and few interrupt changes. Nothing bounds the interrupt changes though,
+//so the array grows when it is full from its beginning.
+//The earliest action is always at mBegin and the slot after the last one holds a sentinel,
+//so headTick() that is polled before every bus access is a single load and pop() just advances mBegin.
+//New actions are mostly later than pending ones, so inserting from the back moves few elements.
+//Timer actions replace the pending action of the same timer. The replaced one would be a no-op anyway
+//as TimerCore ignores firing at other tick than expected.
 class ActionQueue
 {
 public:
   ActionQueue();
 
-
   void push( SequencedAction action );
   SequencedAction pop();
-  uint64_t headTick() const;
   void erase( Action action );
-  bool empty() const;
+  bool contains( Action action ) const;
+
+  //tick of the earliest action or a tick never reached if empty
+  uint64_t headTick() const
+  {
+    return mSlots[mBegin].getTick();
+  }
+
+  bool empty() const
+  {
+    return mBegin == mEnd;
+  }
+
+  template<typename Archive>
+  void serialize( Archive & ar );
+
+private:
+  void remove( size_t index );
 
 private:
+  static constexpr size_t CAPACITY = 64;
 
-  std::vector<SequencedAction> mHeap;
+  //at least one more than actions for the sentinel
+  std::vector<SequencedAction> mSlots;
+  size_t mBegin;
+  size_t mEnd;
 };
 
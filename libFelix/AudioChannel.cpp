@@ -1,9 +1,10 @@
 #include "pch.hpp"
 #include "AudioChannel.hpp"
 #include "TimerCore.hpp"
+#include "StateArchive.hpp"
 #include "Utility.hpp"
 
-AudioChannel::AudioChannel( TimerCore& timer ) : mTimer{ timer }, mChangeCycle{}, mShiftRegisterBackup{}, mShiftRegister{}, mTapSelector{}, mParity{ ~0u }, mEnableIntegrate{}, mVolume{}, mOutput{}, mOldOutput{}
+AudioChannel::AudioChannel( TimerCore& timer ) : mTimer{ timer }, mChangeCycle{}, mShiftRegisterBackup{}, mShiftRegister{}, mTapSelector{}, mParity{ ~0u }, mEnableIntegrate{}, mVolume{}, mOutput{}, mOldOutput{}, mTransitions{}, mLogging{}
 {
 }
 
@@ -19,9 +20,11 @@ SequencedAction AudioChannel::setFeedback( uint8_t value )
   return {};
 }
 
-SequencedAction AudioChannel::setOutput( uint8_t value )
+SequencedAction AudioChannel::setOutput( uint64_t tick, uint8_t value )
 {
   mOutput = (int8_t)value;
+  if ( mLogging )
+    mTransitions.push_back( { tick, (int16_t)mOutput } );
   return {};
 }
 
@@ -112,6 +115,7 @@ float AudioChannel::sample( uint64_t tick ) const
 
 void AudioChannel::trigger( uint64_t tick )
 {
+  float const output = mOutput;
   uint32_t xorGate = mTapSelector & mShiftRegister;
   uint32_t parity = std::popcount( xorGate ) & 1 ^ 1;
   mShiftRegister = ( mShiftRegister << 1 ) | parity;
@@ -137,4 +141,28 @@ void AudioChannel::trigger( uint64_t tick )
     mParity = parity;
   }
 
+  if ( mLogging && mOutput != output )
+    mTransitions.push_back( { tick, (int16_t)mOutput } );
 }
+
+void AudioChannel::logOutput( bool enabled, uint64_t tick )
+{
+  if ( enabled && !mLogging )
+    mTransitions.push_back( { tick, (int16_t)mOutput } );
+  mLogging = enabled;
+}
+
+std::vector<AudioChannel::Transition> & AudioChannel::transitions()
+{
+  return mTransitions;
+}
+
+template<typename Archive>
+void AudioChannel::serialize( Archive & ar )
+{
+  ar( mChangeCycle, mShiftRegisterBackup, mShiftRegister, mTapSelector, mParity, mEnableIntegrate, mEven, mVolume, mOutput, mOldOutput );
+}
+
+template void AudioChannel::serialize<StateWriter>( StateWriter & );
+template void AudioChannel::serialize<StateReader>( StateReader & );
+template void AudioChannel::serialize<StateValidator>( StateValidator & );
@@ -7,11 +7,18 @@ class TimerCore;
 class AudioChannel
 {
 public:
+  //change of the output logged for synthesis
+  struct Transition
+  {
+    uint64_t tick;
+    int16_t output;
+  };
+
   AudioChannel( TimerCore & timer );
 
   SequencedAction setVolume( int8_t );
   SequencedAction setFeedback( uint8_t );
-  SequencedAction setOutput( uint8_t );
+  SequencedAction setOutput( uint64_t tick, uint8_t );
   SequencedAction setShift( uint8_t );
   SequencedAction setBackup( uint64_t tick, uint8_t );
   SequencedAction setControl( uint64_t tick, uint8_t );
@@ -31,6 +38,13 @@ public:
 
   void trigger( uint64_t tick );
 
+  //Output changes are logged while enabled. Enabling logs the current output
+  void logOutput( bool enabled, uint64_t tick );
+  std::vector<Transition> & transitions();
+
+  template<typename Archive>
+  void serialize( Archive & ar );
+
 private:
   static float sampleHelper( uint32_t diff );
 
@@ -65,5 +79,7 @@ private:
   int8_t mVolume;
   float mOutput;
   float mOldOutput;
+  std::vector<Transition> mTransitions;
+  bool mLogging;
 };
 
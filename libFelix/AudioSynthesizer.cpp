@@ -0,0 +1,175 @@
+#include "pch.hpp"
+#include "AudioSynthesizer.hpp"
+#include <cmath>
+#include <numbers>
+
+#if defined( _M_X64 ) || defined( __SSE2__ )
+#define FELIX_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+
+//samples a step is spread over
+static constexpr size_t WIDTH = 16;
+//resolution of the position of a step between two samples
+static constexpr int PHASES = 32;
+//cutoff below the Nyquist frequency in cycles per sample
+static constexpr double CUTOFF = 0.45;
+
+using Kernel = std::array<std::array<float, WIDTH>, PHASES + 1>;
+
+//Blackman windowed sinc impulse for each phase, centered WIDTH / 2 samples after the step.
+//Every row sums up to one, so integrated impulses make steps of exact height
+Kernel const& kernel()
+{
+  static Kernel const result = []
+  {
+    Kernel kernel{};
+    double const pi = std::numbers::pi;
+    for ( int phase = 0; phase <= PHASES; ++phase )
+    {
+      double sum{};
+      for ( size_t j = 0; j < WIDTH; ++j )
+      {
+        double x = (double)j + (double)phase / PHASES - WIDTH / 2.0;
+        double sinc = x == 0.0 ? 2.0 * CUTOFF : std::sin( 2.0 * pi * CUTOFF * x ) / ( pi * x );
+        double window = 0.42 + 0.5 * std::cos( 2.0 * pi * x / WIDTH ) + 0.08 * std::cos( 4.0 * pi * x / WIDTH );
+        kernel[phase][j] = (float)( sinc * window );
+        sum += sinc * window;
+      }
+      for ( auto & tap : kernel[phase] )
+      {
+        tap = (float)( tap / sum );
+      }
+    }
+    return kernel;
+  }();
+
+  return result;
+}
+
+int16_t saturate( float value )
+{
+  return (int16_t)std::clamp( (int)std::lrint( value ), (int)std::numeric_limits<int16_t>::min(), (int)std::numeric_limits<int16_t>::max() );
+}
+
+}
+
+AudioSynthesizer::AudioSynthesizer() : mTicks{}, mLastTick{}, mCursor{}, mOutputs{}, mMix{}, mLevel{}, mSum{}, mDeltas( 2 * WIDTH )
+{
+}
+
+void AudioSynthesizer::begin( std::span<uint64_t const> ticks )
+{
+  mTicks = ticks;
+  mCursor = 0;
+  mDeltas.resize( 2 * ( ticks.size() + WIDTH ) );
+}
+
+void AudioSynthesizer::setOutput( int channel, uint64_t tick, int output )
+{
+  int diff = output - mOutputs[channel];
+  if ( diff == 0 )
+    return;
+
+  mOutputs[channel] = output;
+  step( tick, diff * mMix.left[channel], diff * mMix.right[channel] );
+}
+
+void AudioSynthesizer::setMix( uint64_t tick, Mix const& mix )
+{
+  int left{};
+  int right{};
+  for ( int i = 0; i < CHANNELS; ++i )
+  {
+    left += mOutputs[i] * ( mix.left[i] - mMix.left[i] );
+    right += mOutputs[i] * ( mix.right[i] - mMix.right[i] );
+  }
+
+  mMix = mix;
+  if ( left != 0 || right != 0 )
+    step( tick, left, right );
+}
+
+void AudioSynthesizer::step( uint64_t tick, int left, int right )
+{
+  while ( mCursor + 1 < mTicks.size() && mTicks[mCursor] < tick )
+  {
+    mCursor += 1;
+  }
+
+  //position of the step between the previous sample and the one at the cursor. Late logged changes are moved to the previous sample
+  uint64_t const previous = mCursor > 0 ? mTicks[mCursor - 1] : mLastTick;
+  uint64_t const next = mTicks[mCursor];
+  uint64_t const period = std::max<uint64_t>( next - std::min( previous, next ), 1 );
+  uint64_t const before = next - std::clamp( tick, std::min( previous, next ), next );
+  size_t const phase = (size_t)( ( before * PHASES + period / 2 ) / period );
+
+  auto const& taps = kernel()[phase];
+  float* deltas = mDeltas.data() + 2 * mCursor;
+  for ( size_t j = 0; j < WIDTH; ++j )
+  {
+    deltas[2 * j] += left * taps[j];
+    deltas[2 * j + 1] += right * taps[j];
+  }
+
+  mLevel[0] += left;
+  mLevel[1] += right;
+}
+
+void AudioSynthesizer::render( std::span<AudioSample> out )
+{
+  assert( out.size() == mTicks.size() );
+
+  float const* deltas = mDeltas.data();
+  size_t i = 0;
+
+#ifdef FELIX_SSE2
+  //two samples per register, prefix sum of the pair added to the running sum of the previous one
+  __m128 sum = _mm_setr_ps( mSum[0], mSum[1], mSum[0], mSum[1] );
+  for ( ; i + 4 <= out.size(); i += 4 )
+  {
+    __m128 lo = _mm_loadu_ps( deltas + 2 * i );
+    __m128 hi = _mm_loadu_ps( deltas + 2 * i + 4 );
+    lo = _mm_add_ps( _mm_add_ps( lo, _mm_castsi128_ps( _mm_slli_si128( _mm_castps_si128( lo ), 8 ) ) ), sum );
+    sum = _mm_movehl_ps( lo, lo );
+    hi = _mm_add_ps( _mm_add_ps( hi, _mm_castsi128_ps( _mm_slli_si128( _mm_castps_si128( hi ), 8 ) ) ), sum );
+    sum = _mm_movehl_ps( hi, hi );
+    _mm_storeu_si128( (__m128i*)( out.data() + i ), _mm_packs_epi32( _mm_cvtps_epi32( lo ), _mm_cvtps_epi32( hi ) ) );
+  }
+  mSum[0] = _mm_cvtss_f32( sum );
+  mSum[1] = _mm_cvtss_f32( _mm_shuffle_ps( sum, sum, _MM_SHUFFLE( 1, 1, 1, 1 ) ) );
+#endif
+
+  for ( ; i < out.size(); ++i )
+  {
+    mSum[0] += deltas[2 * i];
+    mSum[1] += deltas[2 * i + 1];
+    out[i] = { saturate( mSum[0] ), saturate( mSum[1] ) };
+  }
+
+  //tail of the kernels goes to the start of the next batch. Rounding errors of the integrator are dropped against the exact level
+  auto tail = mDeltas.begin() + 2 * out.size();
+  std::array<float, 2> pending{};
+  for ( size_t j = 0; j < WIDTH; ++j )
+  {
+    pending[0] += tail[2 * j];
+    pending[1] += tail[2 * j + 1];
+  }
+  mSum[0] = mLevel[0] - pending[0];
+  mSum[1] = mLevel[1] - pending[1];
+
+  std::copy( tail, tail + 2 * WIDTH, mDeltas.begin() );
+  mDeltas.resize( 2 * WIDTH );
+
+  if ( !mTicks.empty() )
+    mLastTick = mTicks.back();
+  mTicks = {};
+}
+
+void AudioSynthesizer::restart( uint64_t tick )
+{
+  mLastTick = tick;
+}
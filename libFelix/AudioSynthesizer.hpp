@@ -0,0 +1,47 @@
+#pragma once
+
+#include "Utility.hpp"
+
+//Renders the stereo output from outputs of audio channels and the mixer changing at given ticks.
+//Every change of a level is a band-limited step (BLEP) spread over a few samples instead of being point sampled,
+//so the output does not alias at any sample rate. The output is delayed by half of the step kernel.
+class AudioSynthesizer : private NonCopyable
+{
+public:
+  static constexpr int CHANNELS = 4;
+
+  //attenuation of each channel in the left and the right output, 0 if the channel is disabled there
+  struct Mix
+  {
+    std::array<int16_t, CHANNELS> left;
+    std::array<int16_t, CHANNELS> right;
+  };
+
+  AudioSynthesizer();
+
+  //Starts a batch of samples at given ascending ticks. Changes up to the last of them follow in the order of their ticks
+  void begin( std::span<uint64_t const> ticks );
+  void setOutput( int channel, uint64_t tick, int output );
+  void setMix( uint64_t tick, Mix const& mix );
+  //Integrates steps of the batch to the samples
+  void render( std::span<AudioSample> out );
+  //The next batch does not follow the last rendered sample but given tick
+  void restart( uint64_t tick );
+
+private:
+  void step( uint64_t tick, int left, int right );
+
+private:
+  std::span<uint64_t const> mTicks;
+  //tick of the last rendered sample
+  uint64_t mLastTick;
+  //sample of the batch the last step was added before
+  size_t mCursor;
+  std::array<int, CHANNELS> mOutputs;
+  Mix mMix;
+  //exact sum of all steps, the integrator is pulled to it after every batch
+  std::array<int, 2> mLevel;
+  std::array<float, 2> mSum;
+  //interleaved left and right differences of samples of the batch followed by the kernel tail reaching into the next batch
+  std::vector<float> mDeltas;
+};
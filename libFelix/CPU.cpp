@@ -1,8 +1,11 @@
 #include "pch.hpp"
 #include "CPU.hpp"
+#include "Core.hpp"
 #include "Opcodes.hpp"
 #include "TraceHelper.hpp"
-#include "DebugRAM.hpp"
+#include "CpuTrace.hpp"
+#include "GuestProfiler.hpp"
+#include "StateArchive.hpp"
 #include <stdarg.h>
 
 namespace
@@ -180,6 +183,7 @@ consteval uint32_t l4( char const ( &t )[N] )
 
 }
 
+template<typename Instrumentation>
 bool CPU::isHiccup()
 {
   switch ( mState.op )
@@ -216,7 +220,11 @@ bool CPU::isHiccup()
   case Opcode::UND_1_db:
   case Opcode::UND_1_eb:
   case Opcode::UND_1_fb:
-    trace2();
+    if constexpr ( Instrumentation::enabled )
+    {
+      trace();
+      report();
+    }
     return true;
   default:
     return false;
@@ -233,11 +241,9 @@ CPUState & CPU::state()
   return mState;
 }
 
-CPU::CPU( std::shared_ptr<TraceHelper> traceHelper ) : mState{ CPUState::reset() }, mEx{ execute() }, mReq{}, mRes{ mState }, mTrace{}, mTraceNextCount{}, mGlobalTrace{}, mFtrace{}, mTraceHelper{ std::move( traceHelper ) }, mHistory{}, mHistoryPresent{}, off{},
-  mPostponedStepOut{}, mStackBreakCondition{ 0xffff }, mBreakOnBrk{ false }
+CPU::CPU( std::shared_ptr<TraceHelper> traceHelper, uint64_t const& tick ) : mState{ CPUState::reset() }, mEx{ execute<Bare>() }, mReq{}, mRes{ mState }, mInlineBus{}, mTrace{}, mTraceNextCount{}, mGlobalTrace{}, mFtrace{}, mTraceHelper{ std::move( traceHelper ) }, mGuestProfiler{}, mCpuTrace{}, mTick{ &tick }, mHistory{}, mHistoryColumns{}, mHistoryPresent{},
+  mPostponedStepOut{}, mStackBreakCondition{ 0xffff }, mBreakOnBrk{ false }, mStarted{}, mMemoryTraps{}, mInstrumented{}
 {
-  static constexpr char prototype[] = "PC:ffff A:ff X:ff Y:ff S:1ff P=NVDIZC ";
-  memcpy( &buf[0], prototype, sizeof prototype );
 }
 
 CPU::~CPU()
@@ -247,6 +253,17 @@ CPU::~CPU()
 CPU::Request const& CPU::advance()
 {
   mEx.coro();
+  if ( mEx.coro.done() )
+  {
+    //requested instrumentation changed, the other variant continues the instruction just fetched
+    mEx = startExecute( true );
+    mEx.coro();
+  }
+  return mReq;
+}
+
+CPU::Request const& CPU::request() const
+{
   return mReq;
 }
 
@@ -289,6 +306,58 @@ void CPU::breakOnBrk( bool value )
   mBreakOnBrk = value;
 }
 
+void CPU::setInlineBus( Core * bus )
+{
+  mInlineBus = bus;
+}
+
+void CPU::setMemoryTraps( bool present )
+{
+  mMemoryTraps = present;
+}
+
+bool CPU::isInstrumented() const
+{
+  return mInstrumented;
+}
+
+bool CPU::instrumentationRequested() const
+{
+  return mGlobalTrace || mMemoryTraps || mGuestProfiler || mCpuTrace || mHistoryPresent.load( std::memory_order_relaxed );
+}
+
+void CPU::setGuestProfiler( std::shared_ptr<GuestProfiler> profiler )
+{
+  mGuestProfiler = std::move( profiler );
+}
+
+void CPU::setCpuTrace( std::shared_ptr<CpuTraceWriter> writer )
+{
+  mCpuTrace = std::move( writer );
+}
+
+void CPU::report()
+{
+  if ( mGuestProfiler )
+    mGuestProfiler->instruction( mPreviousState, mState, *mTick );
+  if ( mCpuTrace )
+    mCpuTrace->push( CpuTraceRecord::make( mPreviousState, mState, *mTick ) );
+  if ( mHistoryPresent.load( std::memory_order_acquire ) )
+    mHistory->push( CpuTraceRecord::make( mPreviousState, mState, *mTick ) );
+}
+
+bool CPU::accessInline()
+{
+  if ( !mInlineBus )
+    return false;
+
+  //breaks are reported only by Core::run
+  if ( mReq.type == Request::Type::FETCH_OPCODE && mReq.cpuBreakType != CpuBreakType::NONE )
+    return false;
+
+  return mInstrumented ? mInlineBus->inlineCPUAction<Instrumented>( mReq, mRes.value ) : mInlineBus->inlineCPUAction<Bare>( mReq, mRes.value );
+}
+
 void CPU::respond( uint8_t value )
 {
   mRes.value = value;
@@ -323,6 +392,12 @@ CPU::Execute::Execute( handle c ) : coro{ c }
 {
 }
 
+CPU::Execute & CPU::Execute::operator=( Execute && other )
+{
+  std::swap( coro, other.coro );
+  return *this;
+}
+
 CPU::Execute::~Execute()
 {
   if ( coro )
@@ -331,14 +406,47 @@ CPU::Execute::~Execute()
   }
 }
 
-CPU::Execute CPU::execute()
+CPU::Execute CPU::startExecute( bool resumeFetched )
 {
-  auto& state = mState;
-  mPreviousState = state;
+  mInstrumented = instrumentationRequested();
+  return mInstrumented ? execute<Instrumented>( resumeFetched ) : execute<Bare>( resumeFetched );
+}
 
-  trace1();
+//Variant without instrumentation does not even check for trace. On every opcode fetch the requested variant is checked
+//and on change the coroutine ends, CPU::advance then starts the other one with the fetched opcode.
+template<typename Instrumentation>
+CPU::Execute CPU::execute( bool resumeFetched )
+{
+  auto& state = mState;
+  mStarted = true;
 
+  if ( resumeFetched )
+  {
+    //same as the instruction fetch at the end of the loop resumed after co_await fetchOpcode
+    state.interrupt = mRes.interrupt;
+    state.op = (Opcode)mRes.value;
+    if constexpr ( Instrumentation::enabled )
+    {
+      mPreviousState = state;
+    }
+    state.pc += 1;
 
+    while ( isHiccup<Instrumentation>() )
+    {
+      co_await fetchOpcode( state.pc );
+      if ( instrumentationRequested() != Instrumentation::enabled )
+        co_return;
+      if constexpr ( Instrumentation::enabled )
+      {
+        mPreviousState = state;
+      }
+      state.pc += 1;
+    }
+  }
+  else if constexpr ( Instrumentation::enabled )
+  {
+    mPreviousState = state;
+  }
 
   for ( ;; )
   {
@@ -2119,44 +2227,27 @@ CPU::Execute CPU::execute()
       break;
     }
 
-    trace2();
+    if constexpr ( Instrumentation::enabled )
+    {
+      trace();
+      report();
+    }
 
     do
     {
       co_await fetchOpcode( state.pc );
-      mPreviousState = state;
-      trace1();
+      if ( instrumentationRequested() != Instrumentation::enabled )
+        co_return;
+      if constexpr ( Instrumentation::enabled )
+      {
+        mPreviousState = state;
+      }
       state.pc += 1;
-    } while ( isHiccup() );
+    } while ( isHiccup<Instrumentation>() );
   }
 
 }
 
-void CPU::trace1()
-{
-  if ( mGlobalTrace )
-  {
-    buf[3] = hexTab[mPreviousState.pch >> 4];
-    buf[4] = hexTab[mPreviousState.pch & 0x0f];
-    buf[5] = hexTab[mPreviousState.pcl >> 4];
-    buf[6] = hexTab[mPreviousState.pcl & 0x0f];
-
-    buf[10] = hexTab[mPreviousState.a >> 4];
-    buf[11] = hexTab[mPreviousState.a & 0x0f];
-    buf[15] = hexTab[mPreviousState.x >> 4];
-    buf[16] = hexTab[mPreviousState.x & 0x0f];
-    buf[20] = hexTab[mPreviousState.y >> 4];
-    buf[21] = hexTab[mPreviousState.y & 0x0f];
-
-    buf[26] = hexTab[mPreviousState.sl >> 4];
-    buf[27] = hexTab[mPreviousState.sl & 0x0f];
-
-    mPreviousState.printP( (char*)&buf[31] );
-
-    off = 38;
-  }
-}
-
 void CPU::printStatus( std::span<uint8_t,3*14> text )
 {
   static constexpr char prototype[3 * 14 + 1] =
@@ -2201,28 +2292,52 @@ void CPU::disassemblyFromPC( uint8_t const* ram, char* out, int columns, int row
 
 void CPU::enableHistory( int columns, int rows )
 {
-  std::scoped_lock<std::mutex> l{ mHistoryMutex };
-  mHistory.reset( new History( columns, rows, 0, std::vector<char>{} ) );
-  mHistory->data.resize( columns * rows );
-  mHistoryPresent.store( true );
-  setGlobalTrace();
+  if ( !mHistory )
+    mHistory = std::make_unique<History>();
+  mHistoryColumns.store( columns );
+  mHistoryPresent.store( true, std::memory_order_release );
 }
 
 void CPU::disableHistory()
 {
-  mHistoryPresent.store( false );
-  std::scoped_lock<std::mutex> l{ mHistoryMutex };
-  mHistory.reset();
-  setGlobalTrace();
+  mHistoryPresent.store( false, std::memory_order_release );
+}
+
+void CPU::copyHistory( std::span<char> out ) const
+{
+  int const columns = mHistoryColumns.load();
+  if ( !mHistoryPresent.load( std::memory_order_acquire ) || columns <= 0 )
+    return;
+
+  size_t const rows = out.size() / columns;
+  auto records = mHistory->latest( rows );
+
+  //rows not filled yet are left blank at the top
+  std::fill( out.begin(), out.begin() + ( rows - records.size() ) * columns, ' ' );
+  auto row = out.begin() + ( rows - records.size() ) * columns;
+
+  std::array<char, 1024> line;
+  CPUState before;
+  CPUState after;
+  for ( auto const& record : records )
+  {
+    record.unpack( before, after );
+    int size = formatTrace( line.data(), before, after, *mTraceHelper, {} );
+    auto it = std::copy_n( line.cbegin(), std::min( (size_t)columns, (size_t)size ), row );
+    std::fill( it, row + columns, ' ' );
+    row += columns;
+  }
 }
 
-void CPU::copyHistory( std::span<char> out )
+std::vector<CpuTraceRecord> CPU::historyRecords( size_t count ) const
 {
-  if ( mHistoryPresent.load() )
-    mHistory->copy( out );
+  if ( !mHistoryPresent.load( std::memory_order_acquire ) )
+    return {};
+
+  return mHistory->latest( count );
 }
 
-bool CPU::disasmOp( char * out, Opcode op, CPUState* state )
+bool CPU::disasmOp( char * out, Opcode op, CPUState const* state )
 {
   bool defined = true;
   out[4] = ' '; /* Hack for history */
@@ -3173,17 +3288,33 @@ uint8_t CPU::disasmOpr( uint8_t const* ram, char* out, int & pc )
   return pc - intialPC;
 }
 
-void CPU::trace2()
+int CPU::formatTrace( char * out, CPUState const& before, CPUState const& after, TraceHelper const& traceHelper, std::string_view comment )
 {
-  if ( !mGlobalTrace )
-    return;
+  static constexpr char prototype[] = "PC:ffff A:ff X:ff Y:ff S:1ff P=NVDIZC ";
+  memcpy( out, prototype, sizeof prototype );
 
-  disasmOp( buf.data() + off, mState.op, &mState );
-  off += 5;
+  out[3] = hexTab[before.pch >> 4];
+  out[4] = hexTab[before.pch & 0x0f];
+  out[5] = hexTab[before.pcl >> 4];
+  out[6] = hexTab[before.pcl & 0x0f];
 
-  auto comment = mTraceHelper->getTraceComment();
+  out[10] = hexTab[before.a >> 4];
+  out[11] = hexTab[before.a & 0x0f];
+  out[15] = hexTab[before.x >> 4];
+  out[16] = hexTab[before.x & 0x0f];
+  out[20] = hexTab[before.y >> 4];
+  out[21] = hexTab[before.y & 0x0f];
 
-  switch ( mState.op )
+  out[26] = hexTab[before.sl >> 4];
+  out[27] = hexTab[before.sl & 0x0f];
+
+  before.printP( &out[31] );
+
+  int off = 38;
+  disasmOp( out + off, after.op, &after );
+  off += 5;
+
+  switch ( after.op )
   {
   case Opcode::UND_1_03:
   case Opcode::UND_1_13:
@@ -3230,7 +3361,7 @@ void CPU::trace2()
   case Opcode::RZP_ORA:
   case Opcode::RZP_ADC:
   case Opcode::RZP_SBC:
-    off += sprintf( buf.data() + off, "$%02x\t;$%02x", mState.eal, mState.m1 );
+    off += sprintf( out + off, "$%02x\t;$%02x", after.eal, after.m1 );
     break;
   case Opcode::MZP_ASL:
   case Opcode::MZP_DEC:
@@ -3256,14 +3387,14 @@ void CPU::trace2()
   case Opcode::MZP_SMB5:
   case Opcode::MZP_SMB6:
   case Opcode::MZP_SMB7:
-    off += sprintf( buf.data() + off, "$%02x\t;$%02x->$%02x", mState.eal, mState.m1, mState.m2 );
+    off += sprintf( out + off, "$%02x\t;$%02x->$%02x", after.eal, after.m1, after.m2 );
     break;
   case Opcode::WZP_STA:
   case Opcode::WZP_STX:
   case Opcode::WZP_STY:
   case Opcode::WZP_STZ:
   case Opcode::UND_3_44:
-    off += sprintf( buf.data() + off, "$%02x", mState.eal );
+    off += sprintf( out + off, "$%02x", after.eal );
     break;
   case Opcode::RZX_LDA:
   case Opcode::RZX_LDY:
@@ -3274,7 +3405,7 @@ void CPU::trace2()
   case Opcode::RZX_ORA:
   case Opcode::RZX_ADC:
   case Opcode::RZX_SBC:
-    off += sprintf( buf.data() + off, "$%02x,x\t;[$%04x]=$%02x", mState.eal, mState.t, mState.m1 );
+    off += sprintf( out + off, "$%02x,x\t;[$%04x]=$%02x", after.eal, after.t, after.m1 );
     break;
   case Opcode::MZX_ASL:
   case Opcode::MZX_DEC:
@@ -3282,7 +3413,7 @@ void CPU::trace2()
   case Opcode::MZX_LSR:
   case Opcode::MZX_ROL:
   case Opcode::MZX_ROR:
-    off += sprintf( buf.data() + off, "$%02x,x\t;[$%04x]=$%02x->$%02x", mState.eal, mState.t, mState.m1, mState.m2 );
+    off += sprintf( out + off, "$%02x,x\t;[$%04x]=$%02x->$%02x", after.eal, after.t, after.m1, after.m2 );
     break;
   case Opcode::WZX_STA:
   case Opcode::WZX_STY:
@@ -3290,13 +3421,13 @@ void CPU::trace2()
   case Opcode::UND_4_54:
   case Opcode::UND_4_d4:
   case Opcode::UND_4_f4:
-    off += sprintf( buf.data() + off, "$%02x,x\t;[$%04x]", mState.eal, mState.t );
+    off += sprintf( out + off, "$%02x,x\t;[$%04x]", after.eal, after.t );
     break;
   case Opcode::RZY_LDX:
-    off += sprintf( buf.data() + off, "$%02x,y\t;[$%04x]=$%02x", mState.eal, mState.t, mState.m1 );
+    off += sprintf( out + off, "$%02x,y\t;[$%04x]=$%02x", after.eal, after.t, after.m1 );
     break;
   case Opcode::WZY_STX:
-    off += sprintf( buf.data() + off, "$%02x,y\t;[$%04x]", mState.eal, mState.t );
+    off += sprintf( out + off, "$%02x,y\t;[$%04x]", after.eal, after.t );
     break;
   case Opcode::RIN_LDA:
   case Opcode::RIN_AND:
@@ -3305,23 +3436,23 @@ void CPU::trace2()
   case Opcode::RIN_ORA:
   case Opcode::RIN_ADC:
   case Opcode::RIN_SBC:
-    if ( comment )
+    if ( !comment.empty() )
     {
-      off = fmt::format_to( buf.data() + off, "({:02x})\t;[{}]={:02x}\t{}", mState.fa, mTraceHelper->addressLabel( mState.t ), mState.m1, *comment ) - buf.data();
+      off = fmt::format_to( out + off, "({:02x})\t;[{}]={:02x}\t{}", after.fa, traceHelper.addressLabel( after.t ), after.m1, comment ) - out;
     }
     else
     {
-      off += sprintf( buf.data() + off, "($%02x)\t;[%s]=$%02x", mState.fa, mTraceHelper->addressLabel( mState.t ), mState.m1 );
+      off += sprintf( out + off, "($%02x)\t;[%s]=$%02x", after.fa, traceHelper.addressLabel( after.t ), after.m1 );
     }
     break;
   case Opcode::WIN_STA:
-    if ( comment )
+    if ( !comment.empty() )
     {
-      off = fmt::format_to( buf.data() + off, "({:02x})\t;[{}]\t{}", mState.fa, mTraceHelper->addressLabel( mState.t ), *comment ) - buf.data();
+      off = fmt::format_to( out + off, "({:02x})\t;[{}]\t{}", after.fa, traceHelper.addressLabel( after.t ), comment ) - out;
     }
     else
     {
-      off += sprintf( buf.data() + off, "($%02x)\t;[%s]", mState.fa, mTraceHelper->addressLabel( mState.t ) );
+      off += sprintf( out + off, "($%02x)\t;[%s]", after.fa, traceHelper.addressLabel( after.t ) );
     }
     break;
   case Opcode::RIX_AND:
@@ -3331,23 +3462,23 @@ void CPU::trace2()
   case Opcode::RIX_ORA:
   case Opcode::RIX_ADC:
   case Opcode::RIX_SBC:
-    if ( comment )
+    if ( !comment.empty() )
     {
-      off = fmt::format_to( buf.data() + off, "({:02x},x)\t;[{}]={:02x}\t{}", mState.fa, mTraceHelper->addressLabel( mState.t ), mState.m1, *comment ) - buf.data();
+      off = fmt::format_to( out + off, "({:02x},x)\t;[{}]={:02x}\t{}", after.fa, traceHelper.addressLabel( after.t ), after.m1, comment ) - out;
     }
     else
     {
-      off += sprintf( buf.data() + off, "($%02x,x)\t;[%s]=$%02x", mState.fa, mTraceHelper->addressLabel( mState.t ), mState.m1 );
+      off += sprintf( out + off, "($%02x,x)\t;[%s]=$%02x", after.fa, traceHelper.addressLabel( after.t ), after.m1 );
     }
     break;
   case Opcode::WIX_STA:
-    if ( comment )
+    if ( !comment.empty() )
     {
-      off = fmt::format_to( buf.data() + off, "({:02x},x)\t;[{}]\t{}", mState.fa, mTraceHelper->addressLabel( mState.t ), *comment ) - buf.data();
+      off = fmt::format_to( out + off, "({:02x},x)\t;[{}]\t{}", after.fa, traceHelper.addressLabel( after.t ), comment ) - out;
     }
     else
     {
-      off += sprintf( buf.data() + off, "($%02x,x)\t;[%s]", mState.fa, mTraceHelper->addressLabel( mState.t ) );
+      off += sprintf( out + off, "($%02x,x)\t;[%s]", after.fa, traceHelper.addressLabel( after.t ) );
     }
     break;
   case Opcode::RIY_AND:
@@ -3357,23 +3488,23 @@ void CPU::trace2()
   case Opcode::RIY_ORA:
   case Opcode::RIY_ADC:
   case Opcode::RIY_SBC:
-    if ( comment )
+    if ( !comment.empty() )
     {
-      off = fmt::format_to( buf.data() + off, "({:02x}),y\t;[{}]={:02x}\t{}", mState.fa, mTraceHelper->addressLabel( mState.ea ), mState.m1, *comment ) - buf.data();
+      off = fmt::format_to( out + off, "({:02x}),y\t;[{}]={:02x}\t{}", after.fa, traceHelper.addressLabel( after.ea ), after.m1, comment ) - out;
     }
     else
     {
-      off += sprintf( buf.data() + off, "($%02x),y\t;[%s]=$%02x", mState.fa, mTraceHelper->addressLabel( mState.ea ), mState.m1 );
+      off += sprintf( out + off, "($%02x),y\t;[%s]=$%02x", after.fa, traceHelper.addressLabel( after.ea ), after.m1 );
     }
     break;
   case Opcode::WIY_STA:
-    if ( comment )
+    if ( !comment.empty() )
     {
-      off = fmt::format_to( buf.data() + off, "({:02x}),y\t;[{}]\t{}", mState.fa, mTraceHelper->addressLabel( mState.ea ), *comment ) - buf.data();
+      off = fmt::format_to( out + off, "({:02x}),y\t;[{}]\t{}", after.fa, traceHelper.addressLabel( after.ea ), comment ) - out;
     }
     else
     {
-      off += sprintf( buf.data() + off, "($%02x),y\t;[%s]", mState.fa, mTraceHelper->addressLabel( mState.ea ) );
+      off += sprintf( out + off, "($%02x),y\t;[%s]", after.fa, traceHelper.addressLabel( after.ea ) );
     }
     break;
   case Opcode::RAB_AND:
@@ -3388,13 +3519,13 @@ void CPU::trace2()
   case Opcode::RAB_ORA:
   case Opcode::RAB_ADC:
   case Opcode::RAB_SBC:
-    if ( comment )
+    if ( !comment.empty() )
     {
-      off = fmt::format_to( buf.data() + off, "{}\t;={:02x}\t{}", mTraceHelper->addressLabel( mState.ea ), mState.m1, *comment ) - buf.data();
+      off = fmt::format_to( out + off, "{}\t;={:02x}\t{}", traceHelper.addressLabel( after.ea ), after.m1, comment ) - out;
     }
     else
     {
-      off += sprintf( buf.data() + off, "%s\t;=$%02x", mTraceHelper->addressLabel( mState.ea ), mState.m1 );
+      off += sprintf( out + off, "%s\t;=$%02x", traceHelper.addressLabel( after.ea ), after.m1 );
     }
     break;
   case Opcode::MAB_ASL:
@@ -3405,26 +3536,26 @@ void CPU::trace2()
   case Opcode::MAB_ROR:
   case Opcode::MAB_TRB:
   case Opcode::MAB_TSB:
-    if ( comment )
+    if ( !comment.empty() )
     {
-      off = fmt::format_to( buf.data() + off, "{}\t;={:02x}->{:02x}\t{}", mTraceHelper->addressLabel( mState.ea ), mState.m1, mState.m2, *comment ) - buf.data();
+      off = fmt::format_to( out + off, "{}\t;={:02x}->{:02x}\t{}", traceHelper.addressLabel( after.ea ), after.m1, after.m2, comment ) - out;
     }
     else
     {
-      off += sprintf( buf.data() + off, "%s\t;=$%02x->$%02x", mTraceHelper->addressLabel( mState.ea ), mState.m1, mState.m2 );
+      off += sprintf( out + off, "%s\t;=$%02x->$%02x", traceHelper.addressLabel( after.ea ), after.m1, after.m2 );
     }
     break;
   case Opcode::WAB_STA:
   case Opcode::WAB_STX:
   case Opcode::WAB_STY:
   case Opcode::WAB_STZ:
-    if ( comment )
+    if ( !comment.empty() )
     {
-      off = fmt::format_to( buf.data() + off, "{}\t;{}", mTraceHelper->addressLabel( mState.ea ), *comment ) - buf.data();
+      off = fmt::format_to( out + off, "{}\t;{}", traceHelper.addressLabel( after.ea ), comment ) - out;
     }
     else
     {
-      off += sprintf( buf.data() + off, "%s", mTraceHelper->addressLabel( mState.ea ) );
+      off += sprintf( out + off, "%s", traceHelper.addressLabel( after.ea ) );
     }
     break;
   case Opcode::JMA_JMP:
@@ -3432,7 +3563,7 @@ void CPU::trace2()
   case Opcode::UND_4_dc:
   case Opcode::UND_4_fc:
   case Opcode::UND_8_5c:
-    off += sprintf( buf.data() + off, "%s", mTraceHelper->addressLabel( mState.ea ) );
+    off += sprintf( out + off, "%s", traceHelper.addressLabel( after.ea ) );
     break;
   case Opcode::RAX_AND:
   case Opcode::RAX_BIT:
@@ -3443,13 +3574,13 @@ void CPU::trace2()
   case Opcode::RAX_ORA:
   case Opcode::RAX_ADC:
   case Opcode::RAX_SBC:
-    if ( comment )
+    if ( !comment.empty() )
     {
-      off = fmt::format_to( buf.data() + off, "{:04x},x\t;[{}]={:02x}\t{}", mState.ea, mTraceHelper->addressLabel( mState.fa ), mState.m1, *comment ) - buf.data();
+      off = fmt::format_to( out + off, "{:04x},x\t;[{}]={:02x}\t{}", after.ea, traceHelper.addressLabel( after.fa ), after.m1, comment ) - out;
     }
     else
     {
-      off += sprintf( buf.data() + off, "$%04x,x\t;[%s]=$%02x", mState.ea, mTraceHelper->addressLabel( mState.fa ), mState.m1 );
+      off += sprintf( out + off, "$%04x,x\t;[%s]=$%02x", after.ea, traceHelper.addressLabel( after.fa ), after.m1 );
     }
     break;
   case Opcode::MAX_ASL:
@@ -3458,24 +3589,24 @@ void CPU::trace2()
   case Opcode::MAX_LSR:
   case Opcode::MAX_ROL:
   case Opcode::MAX_ROR:
-    if ( comment )
+    if ( !comment.empty() )
     {
-      off = fmt::format_to( buf.data() + off, "{:04x},x\t;[{}]={:02x}->{:02x}\t{}", mState.ea, mTraceHelper->addressLabel( mState.fa ), mState.m1, mState.m2, *comment ) - buf.data();
+      off = fmt::format_to( out + off, "{:04x},x\t;[{}]={:02x}->{:02x}\t{}", after.ea, traceHelper.addressLabel( after.fa ), after.m1, after.m2, comment ) - out;
     }
     else
     {
-      off += sprintf( buf.data() + off, "$%04x,x\t;[%s]=$%02x->$%02x", mState.ea, mTraceHelper->addressLabel( mState.fa ), mState.m1, mState.m2 );
+      off += sprintf( out + off, "$%04x,x\t;[%s]=$%02x->$%02x", after.ea, traceHelper.addressLabel( after.fa ), after.m1, after.m2 );
     }
     break;
   case Opcode::WAX_STA:
   case Opcode::WAX_STZ:
-    if ( comment )
+    if ( !comment.empty() )
     {
-      off = fmt::format_to( buf.data() + off, "{:04x},x\t;[{}]\t{}", mState.ea, mTraceHelper->addressLabel( mState.fa ), *comment ) - buf.data();
+      off = fmt::format_to( out + off, "{:04x},x\t;[{}]\t{}", after.ea, traceHelper.addressLabel( after.fa ), comment ) - out;
     }
     else
     {
-      off += sprintf( buf.data() + off, "$%04x,x\t;[%s]", mState.ea, mTraceHelper->addressLabel( mState.fa ) );
+      off += sprintf( out + off, "$%04x,x\t;[%s]", after.ea, traceHelper.addressLabel( after.fa ) );
     }
     break;
   case Opcode::RAY_AND:
@@ -3486,30 +3617,30 @@ void CPU::trace2()
   case Opcode::RAY_ORA:
   case Opcode::RAY_ADC:
   case Opcode::RAY_SBC:
-    if ( comment )
+    if ( !comment.empty() )
     {
-      off = fmt::format_to( buf.data() + off, "{:04x},y\t;[{}]={:02x}\t{}", mState.ea, mTraceHelper->addressLabel( mState.fa ), mState.m1, *comment ) - buf.data();
+      off = fmt::format_to( out + off, "{:04x},y\t;[{}]={:02x}\t{}", after.ea, traceHelper.addressLabel( after.fa ), after.m1, comment ) - out;
     }
     else
     {
-      off += sprintf( buf.data() + off, "$%04x,y\t;[%s]=$%02x", mState.ea, mTraceHelper->addressLabel( mState.fa ), mState.m1 );
+      off += sprintf( out + off, "$%04x,y\t;[%s]=$%02x", after.ea, traceHelper.addressLabel( after.fa ), after.m1 );
     }
     break;
   case Opcode::WAY_STA:
-    if ( comment )
+    if ( !comment.empty() )
     {
-      off = fmt::format_to( buf.data() + off, "{:04x},y\t;[{}]\t{}", mState.ea, mTraceHelper->addressLabel( mState.fa ), *comment ) - buf.data();
+      off = fmt::format_to( out + off, "{:04x},y\t;[{}]\t{}", after.ea, traceHelper.addressLabel( after.fa ), comment ) - out;
     }
     else
     {
-      off += sprintf( buf.data() + off, "$%04x,y\t;[%s]", mState.ea, mTraceHelper->addressLabel( mState.fa ) );
+      off += sprintf( out + off, "$%04x,y\t;[%s]", after.ea, traceHelper.addressLabel( after.fa ) );
     }
     break;
   case Opcode::JMX_JMP:
-    off += sprintf( buf.data() + off, "($%04x,x)\t;[%s]", mState.fa, mTraceHelper->addressLabel( mState.ea ) );
+    off += sprintf( out + off, "($%04x,x)\t;[%s]", after.fa, traceHelper.addressLabel( after.ea ) );
     break;
   case Opcode::JMI_JMP:
-    off += sprintf( buf.data() + off, "($%04x)\t;[%s]", mState.fa, mTraceHelper->addressLabel( mState.t ) );
+    off += sprintf( out + off, "($%04x)\t;[%s]", after.fa, traceHelper.addressLabel( after.t ) );
     break;
   case Opcode::IMP_ASL:
   case Opcode::IMP_CLC:
@@ -3566,7 +3697,7 @@ void CPU::trace2()
   case Opcode::UND_2_C2:
   case Opcode::UND_2_E2:
   case Opcode::BRK_BRK:
-    off += sprintf( buf.data() + off, "#$%02x", mState.eal );
+    off += sprintf( out + off, "#$%02x", after.eal );
     break;
   case Opcode::BRL_BCC:
   case Opcode::BRL_BCS:
@@ -3577,7 +3708,7 @@ void CPU::trace2()
   case Opcode::BRL_BVC:
   case Opcode::BRL_BVS:
   case Opcode::BRL_BRA:
-    off += sprintf( buf.data() + off, "$%04x", mState.t );
+    off += sprintf( out + off, "$%04x", after.t );
     break;
   case Opcode::BZR_BBR0:
   case Opcode::BZR_BBR1:
@@ -3595,10 +3726,20 @@ void CPU::trace2()
   case Opcode::BZR_BBS5:
   case Opcode::BZR_BBS6:
   case Opcode::BZR_BBS7:
-    off += sprintf( buf.data() + off, "$%02x,$%04x\t;$%02x", mState.eal, mState.t, mState.m1 );
+    off += sprintf( out + off, "$%02x,$%04x\t;$%02x", after.eal, after.t, after.m1 );
     break;
   }
 
+  return off;
+}
+
+void CPU::trace()
+{
+  if ( !mGlobalTrace )
+    return;
+
+  int const off = formatTrace( buf.data(), mPreviousState, mState, *mTraceHelper, mTraceHelper->getTraceComment() );
+
   if ( mFtrace.good() && ( mTrace || mTraceNextCount ) )
   {
     mFtrace.write( buf.data(), off );
@@ -3612,14 +3753,6 @@ void CPU::trace2()
       toggleTrace( false );
     }
   }
-
-  std::scoped_lock<std::mutex> l{ mHistoryMutex };
-  if ( mHistoryPresent.load() )
-  {
-    auto row = mHistory->nextRow();
-    auto it = std::copy_n( buf.cbegin(), (std::min)( row.size(), (size_t)off ), row.begin() );
-    std::fill( it, row.end(), ' ' );
-  }
 }
 
 void CPU::enableTrace()
@@ -3650,40 +3783,72 @@ void CPU::traceNextCount( int count )
   setGlobalTrace();
 }
 
+bool CPU::isTraced() const
+{
+  return mGlobalTrace || mCpuTrace || mGuestProfiler || mHistoryPresent.load( std::memory_order_relaxed );
+}
 
 void CPU::setGlobalTrace()
 {
-  if ( mTrace || mTraceNextCount || mHistoryPresent.load() )
-  {
-    if ( !mGlobalTrace )
-    {
-      mGlobalTrace = true;
-      trace1();
-    }
-  }
-  else
-  {
-    mGlobalTrace = false;
-  }
+  mGlobalTrace = mTrace || mTraceNextCount;
 }
 
+void CPU::History::push( CpuTraceRecord const& record )
+{
+  static_assert( sizeof( CpuTraceRecord ) == RECORD_WORDS * sizeof( uint64_t ) );
+
+  std::array<uint64_t, RECORD_WORDS> words;
+  memcpy( words.data(), &record, sizeof record );
 
-std::span<char> CPU::History::nextRow()
+  uint64_t const index = head.load( std::memory_order_relaxed );
+  //a reader that sees any word of this record also sees head that tells the slot is being overwritten
+  std::atomic_thread_fence( std::memory_order_release );
+  auto & slot = records[index % HISTORY_DEPTH];
+  for ( size_t i = 0; i < RECORD_WORDS; ++i )
+  {
+    slot[i].store( words[i], std::memory_order_relaxed );
+  }
+  head.store( index + 1, std::memory_order_release );
+}
+
+std::vector<CpuTraceRecord> CPU::History::latest( size_t count ) const
 {
-  std::span<char> result = std::span<char>{ data.data() + cursor * columns, (size_t)columns };
-  cursor = ( cursor + 1 ) % rows;
+  uint64_t const end = head.load( std::memory_order_acquire );
+  uint64_t const begin = end - std::min<uint64_t>( { count, end, HISTORY_DEPTH } );
+
+  std::vector<CpuTraceRecord> result( end - begin );
+  for ( uint64_t index = begin; index < end; ++index )
+  {
+    std::array<uint64_t, RECORD_WORDS> words;
+    auto const& slot = records[index % HISTORY_DEPTH];
+    for ( size_t i = 0; i < RECORD_WORDS; ++i )
+    {
+      words[i] = slot[i].load( std::memory_order_relaxed );
+    }
+    memcpy( &result[index - begin], words.data(), sizeof words );
+  }
+
+  //records the writer has overwritten in the meantime are dropped
+  std::atomic_thread_fence( std::memory_order_acquire );
+  uint64_t const overwritten = head.load( std::memory_order_relaxed );
+  if ( overwritten >= begin + HISTORY_DEPTH )
+    result.erase( result.begin(), result.begin() + std::min<uint64_t>( overwritten - begin - HISTORY_DEPTH + 1, result.size() ) );
 
   return result;
 }
 
-void CPU::History::copy( std::span<char> out )
+template<typename Archive>
+void CPU::serialize( Archive & ar )
 {
-  int cur = cursor;
-  size_t i = 0;
+  ar( mState, mPreviousState, mReq.cpuBreakType, mReq.address, mReq.value, mReq.type, mRes.interrupt, mRes.value,
+    mPostponedStepOut, mStackBreakCondition, mStarted );
 
-  do
+  if constexpr ( Archive::LOADING )
   {
-    std::copy_n( data.data() + cur * columns, columns, out.data() + i * columns );
-    cur = ( cur + 1 ) % rows;
-  } while ( ++i < rows );
+    mEx = startExecute( mStarted );
+  }
 }
+
+template void CPU::serialize<StateWriter>( StateWriter & );
+template void CPU::serialize<StateReader>( StateReader & );
+template void CPU::serialize<StateValidator>( StateValidator & );
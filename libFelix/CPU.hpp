@@ -7,6 +7,10 @@ enum class Opcode : uint8_t;
 struct CpuTrace;
 struct TraceRequest;
 class TraceHelper;
+class GuestProfiler;
+class CpuTraceWriter;
+struct CpuTraceRecord;
+class Core;
 
 class CPU
 {
@@ -15,9 +19,11 @@ public:
   static constexpr uint16_t NMI_VECTOR = 0xfffa;
   static constexpr uint16_t RESET_VECTOR = 0xfffc;
   static constexpr uint16_t IRQ_VECTOR = 0xfffe;
+  //instructions kept by the history
+  static constexpr size_t HISTORY_DEPTH = 1 << 17;
 
 
-  struct Request : private NonCopyable //won't compile on gcc https://gcc.gnu.org/bugzilla/show_bug.cgi?id=99575
+  struct Request : private NonCopyable
   {
     enum class Type : uint8_t
     {
@@ -33,23 +39,32 @@ public:
     Type type;
   };
 
-  struct Response : private NonCopyable //won't compile on gcc https://gcc.gnu.org/bugzilla/show_bug.cgi?id=99575
+  struct Response : private NonCopyable
   {
     Response( CPUState & state ) : state{ state }, interrupt{}, value{} {}
     CPUState & state;
     int interrupt;
     uint8_t value;
+  };
 
-    bool await_ready() { return false; }
-    void await_suspend( std::coroutine_handle<> c ) {}
+  //Awaiters only refer to the CPU. gcc copies lvalue awaiters at co_await https://gcc.gnu.org/bugzilla/show_bug.cgi?id=99575
+  //so they are returned by value and the copy reads the response filled by Core.
+  //The coroutine is not suspended at all if the request could be served inline.
+  struct Awaiter
+  {
+    CPU & cpu;
 
+    bool await_ready() { return cpu.accessInline(); }
+    void await_suspend( std::coroutine_handle<> c ) {}
   };
 
 
-  CPU( std::shared_ptr<TraceHelper> traceHelper );
+  //tick is the current tick of the Core, reported with executed instructions
+  CPU( std::shared_ptr<TraceHelper> traceHelper, uint64_t const& tick );
   ~CPU();
 
   Request const& advance();
+  Request const& request() const;
 
   //triggers a break on next instruction boundary on batch end
   void breakNext();
@@ -66,6 +81,13 @@ public:
 
   void breakOnBrk( bool value );
 
+  //Non null bus lets the CPU serve plain RAM accesses without suspending, see Core::inlineCPUAction
+  void setInlineBus( Core * bus );
+  //Core reports traps on RAM, Mikey or Suzy. Together with trace and history they select instrumented variant
+  void setMemoryTraps( bool present );
+  //variant of the running instruction
+  bool isInstrumented() const;
+
   void respond( uint8_t value );
   CpuBreakType respondFetchOpcode( uint8_t value );
   void assertInterrupt( int mask );
@@ -79,13 +101,31 @@ public:
   void disableTrace();
   void toggleTrace( bool on );
   void traceNextCount( int count );
+  //any of trace, trace of next instructions, binary trace, guest profiler or history is enabled
+  bool isTraced() const;
   void printStatus( std::span<uint8_t, 3 * 14> text );
-  static bool disasmOp( char* out, Opcode op, CPUState* state = nullptr );
+  static bool disasmOp( char* out, Opcode op, CPUState const* state = nullptr );
+  //line of the text trace of an instruction given states on its opcode fetch and at its end. Returns its length
+  static int formatTrace( char * out, CPUState const& before, CPUState const& after, TraceHelper const& traceHelper, std::string_view comment );
   uint8_t disasmOpr( uint8_t const* ram, char* out, int& pc );
   void disassemblyFromPC( uint8_t const* ram, char * out, int columns, int rows );
+  //selects instrumented variant that reports every instruction to the profiler. Null disables it
+  void setGuestProfiler( std::shared_ptr<GuestProfiler> profiler );
+  //selects instrumented variant that records every instruction to the binary trace. Null disables it
+  void setCpuTrace( std::shared_ptr<CpuTraceWriter> writer );
+  //Selects instrumented variant that records raw states of the last HISTORY_DEPTH instructions.
+  //Rows of given number of columns are formatted only by copyHistory, which may be called from another thread
   void enableHistory( int columns, int rows );
   void disableHistory();
-  void copyHistory( std::span<char> out );
+  //latest instructions formatted to rows of the text trace, oldest first
+  void copyHistory( std::span<char> out ) const;
+  //latest instructions up to given count, oldest first
+  std::vector<CpuTraceRecord> historyRecords( size_t count ) const;
+
+  //Valid only on instruction boundary, i.e. between Core::run calls.
+  //Loading recreates the coroutine suspended on opcode fetch.
+  template<typename Archive>
+  void serialize( Archive & ar );
 
 private:
 
@@ -108,73 +148,85 @@ private:
 
     Execute();
     Execute( handle c );
+    Execute & operator=( Execute && other );
     ~Execute();
 
     handle coro;
-  } const mEx;
+  } mEx;
 
   Request mReq;
   Response mRes;
+  Core * mInlineBus;
   bool mTrace;
   int mTraceNextCount;
   bool mGlobalTrace;
   std::ofstream mFtrace;
   std::shared_ptr<TraceHelper> mTraceHelper;
-
-  Execute execute();
+  std::shared_ptr<GuestProfiler> mGuestProfiler;
+  std::shared_ptr<CpuTraceWriter> mCpuTrace;
+  uint64_t const* mTick;
+
+  //resumeFetched resumes after opcode fetch awaiter that has been already responded to
+  template<typename Instrumentation>
+  Execute execute( bool resumeFetched = false );
+  //creates variant of execute selected by instrumentationRequested
+  Execute startExecute( bool resumeFetched );
+  bool instrumentationRequested() const;
+  template<typename Instrumentation>
   bool isHiccup();
+  bool accessInline();
 
 
-  auto & fetchOpcode( uint16_t address )
+  auto fetchOpcode( uint16_t address )
   {
-    struct CPUFetchOpcodeAwaiter : public Response
+    struct CPUFetchOpcodeAwaiter : public Awaiter
     {
       void await_resume()
       {
-        state.interrupt = interrupt;
-        state.op = (Opcode)value;
+        cpu.mState.interrupt = cpu.mRes.interrupt;
+        cpu.mState.op = (Opcode)cpu.mRes.value;
       }
     };
 
     mReq.type = Request::Type::FETCH_OPCODE;
     mReq.address = address;
-    return static_cast<CPUFetchOpcodeAwaiter &>( mRes );
+    return CPUFetchOpcodeAwaiter{ { *this } };
   }
 
-  auto & fetchOperand( uint16_t address )
+  auto fetchOperand( uint16_t address )
   {
-    struct CPUFetchOperandAwaiter : public Response
+    struct CPUFetchOperandAwaiter : public Awaiter
     {
       uint8_t await_resume()
       {
-        return value;
+        return cpu.mRes.value;
       }
     };
 
     mReq.type = Request::Type::FETCH_OPERAND;
     mReq.address = address;
-    return static_cast<CPUFetchOperandAwaiter &>( mRes );
+    return CPUFetchOperandAwaiter{ { *this } };
   }
 
 
-  auto & read( uint16_t address )
+  auto read( uint16_t address )
   {
-    struct CPUReadAwaiter : public Response
+    struct CPUReadAwaiter : public Awaiter
     {
       uint8_t await_resume()
       {
-        return value;
+        return cpu.mRes.value;
       }
     };
 
     mReq.type = Request::Type::READ;
     mReq.address = address;
-    return static_cast<CPUReadAwaiter &>( mRes );
+    return CPUReadAwaiter{ { *this } };
   }
 
-  auto & write( uint16_t address, uint8_t value )
+  auto write( uint16_t address, uint8_t value )
   {
-    struct CPUWriteAwaiter : public Response
+    struct CPUWriteAwaiter : public Awaiter
     {
       void await_resume()
       {
@@ -184,34 +236,43 @@ private:
     mReq.type = Request::Type::WRITE;
     mReq.address = address;
     mReq.value = value;
-    return static_cast<CPUWriteAwaiter &>( mRes );
+    return CPUWriteAwaiter{ { *this } };
   }
 
-  void trace1();
-  void trace2();
+  void trace();
+  //reports finished instruction to the guest profiler and binary trace
+  void report();
   void setGlobalTrace();
 
 private:
 
+  //Ring of the latest records written by the emulation thread without locking.
+  //Records are stored as words of atomics, so that they can be read from another thread at any time
   struct History
   {
-    int columns;
-    int rows;
-    int cursor;
-    std::vector<char> data;
+    static constexpr size_t RECORD_WORDS = 4;
+
+    std::array<std::array<std::atomic<uint64_t>, RECORD_WORDS>, HISTORY_DEPTH> records;
+    //number of records pushed so far
+    std::atomic<uint64_t> head;
 
-    std::span<char> nextRow();
-    void copy( std::span<char> out );
+    void push( CpuTraceRecord const& record );
+    std::vector<CpuTraceRecord> latest( size_t count ) const;
   };
 
   std::array<char, 1024> buf;
-  int64_t off;
+  //allocated on first enableHistory and kept, so that it can be read while disabled from another thread
   std::unique_ptr<History> mHistory;
-  std::mutex mHistoryMutex;
+  std::atomic_int mHistoryColumns;
   std::atomic_bool mHistoryPresent;
   //true if mStackBreakCondition is valid for CpuBreakType::STEP_OUT
   bool mPostponedStepOut;
   uint16_t mStackBreakCondition;
   bool mBreakOnBrk;
+  //coroutine has been resumed at least once
+  bool mStarted;
+  bool mMemoryTraps;
+  //running variant of execute
+  bool mInstrumented;
 };
 
@@ -75,8 +75,13 @@ struct CPUState
 
   static CPUState reset()
   {
-    std::random_device r{};
-    std::default_random_engine e{r()};
+    return reset( std::random_device{}() );
+  }
+
+  //registers and flags undefined at power on follow from the seed
+  static CPUState reset( uint32_t seed )
+  {
+    std::default_random_engine e{ seed };
     std::uniform_int_distribution randomByte{ 0, 255 };
 
     CPUState result;
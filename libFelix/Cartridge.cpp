@@ -3,6 +3,7 @@
 #include "GameDrive.hpp"
 #include "EEPROM.hpp"
 #include "TraceHelper.hpp"
+#include "StateArchive.hpp"
 
 Cartridge::Cartridge( ImageProperties const& imageProperties, std::shared_ptr<ImageCart const> cart, std::shared_ptr<TraceHelper> traceHelper ) :
   mTraceHelper{ std::move( traceHelper ) }, mCart{ std::move( cart ) }, mGameDrive{ GameDrive::create( imageProperties ) },
@@ -45,10 +46,17 @@ void Cartridge::setAudIn( bool value )
     return;
 
   mAudIn = value;
+  updateBanks();
+}
 
+void Cartridge::updateBanks()
+{
   if ( !mCart )
     return;
 
+  mBank0 = mCart->getBank0();
+  mBank1 = mCart->getBank1();
+
   if ( mAudIn )
   {
     auto bank0a = mCart->getBank0A();
@@ -60,11 +68,6 @@ void Cartridge::setAudIn( bool value )
     if ( !bank1a.empty() )
       mBank1 = bank1a;
   }
-  else
-  {
-    mBank0 = mCart->getBank0();
-    mBank1 = mCart->getBank1();
-  }
 }
 
 void Cartridge::setCartAddressData( bool value )
@@ -169,3 +172,31 @@ void Cartridge::incrementCounter( uint64_t tick )
     mCounter++;
   }
 }
+
+bool Cartridge::canLoadState() const
+{
+  return !mGameDrive;
+}
+
+bool Cartridge::canSaveState() const
+{
+  return canLoadState() && ( !mEEPROM || mEEPROM->canSaveState() );
+}
+
+template<typename Archive>
+void Cartridge::serialize( Archive & ar )
+{
+  ar( mShiftRegister, mCounter, mAudIn, mCurrentStrobe, mAddressData );
+
+  if ( mEEPROM )
+    mEEPROM->serialize( ar );
+
+  if constexpr ( Archive::LOADING )
+  {
+    updateBanks();
+  }
+}
+
+template void Cartridge::serialize<StateWriter>( StateWriter & );
+template void Cartridge::serialize<StateReader>( StateReader & );
+template void Cartridge::serialize<StateValidator>( StateValidator & );
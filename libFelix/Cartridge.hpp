@@ -30,8 +30,16 @@ public:
   bool isCart0Inactive() const;
   bool isCart1Inactive() const;
 
+  //GameDrive protocol lives in a coroutine frame that can't be captured
+  bool canLoadState() const;
+  //additionally EEPROM command in progress can't be captured
+  bool canSaveState() const;
+  template<typename Archive>
+  void serialize( Archive & ar );
+
 private:
   uint8_t peek( CartBank const& bank );
+  void updateBanks();
 
   void incrementCounter( uint64_t tick );
 
@@ -3,8 +3,9 @@
 #include "Utility.hpp"
 #include "ComLynxWire.hpp"
 #include "Log.hpp"
+#include "StateArchive.hpp"
 
-ComLynx::ComLynx( std::shared_ptr<ComLynxWire> comLynxWire ) : mId{ comLynxWire->connect() }, mTx{ mId, comLynxWire }, mRx{ mId, comLynxWire }
+ComLynx::ComLynx( std::shared_ptr<ComLynxWire> comLynxWire ) : mId{ comLynxWire->connect() }, mTx{ mId, comLynxWire }, mRx{ mId, comLynxWire }, mWire{ std::move( comLynxWire ) }
 {
 }
 
@@ -12,8 +13,9 @@ ComLynx::~ComLynx()
 {
 }
 
-bool ComLynx::pulse()
+bool ComLynx::pulse( uint64_t tick )
 {
+  mWire->sync( tick );
   mTx.process();
   mRx.process();
 
@@ -253,3 +255,26 @@ void ComLynx::Receiver::process()
     }
   }
 }
+
+template<typename Archive>
+void ComLynx::serialize( Archive & ar )
+{
+  mTx.serialize( ar );
+  mRx.serialize( ar );
+}
+
+template<typename Archive>
+void ComLynx::Transmitter::serialize( Archive & ar )
+{
+  ar( mData, mState, mCounter, mParity, mShifter, mParEn, mIntEn, mTxBrk, mParBit );
+}
+
+template<typename Archive>
+void ComLynx::Receiver::serialize( Archive & ar )
+{
+  ar( mData, mCounter, mParity, mParErr, mFrameErr, mRxBrk, mOverrun, mIntEn );
+}
+
+template void ComLynx::serialize<StateWriter>( StateWriter & );
+template void ComLynx::serialize<StateReader>( StateReader & );
+template void ComLynx::serialize<StateValidator>( StateValidator & );
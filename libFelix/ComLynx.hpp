@@ -2,7 +2,8 @@
 
 
 //It's a relic of two instance of emulation in one process that was communicating using coarse algorithm through ComLynxWire.
-//It needs to be rewritten to multiple processes
+//ComLynxWire is not synchronized, so Cores sharing one must be run by the same thread.
+//Emulators in separate processes are connected by ComLynxSharedWire.
 
 class ComLynxWire;
 
@@ -14,7 +15,7 @@ public:
   ~ComLynx();
 
   bool present() const;
-  bool pulse();
+  bool pulse( uint64_t tick );
   void setCtrl( uint8_t ctrl );
   void setData( uint8_t data );
   uint8_t getCtrl() const;
@@ -22,6 +23,9 @@ public:
 
   bool interrupt() const;
 
+  template<typename Archive>
+  void serialize( Archive & ar );
+
 private:
 
   struct SERCTL
@@ -59,6 +63,9 @@ private:
     bool interrupt() const;
     void process();
 
+    template<typename Archive>
+    void serialize( Archive & ar );
+
   private:
 
     void pull( int bit );
@@ -87,6 +94,9 @@ private:
     bool interrupt() const;
     void process();
 
+    template<typename Archive>
+    void serialize( Archive & ar );
+
   private:
     std::shared_ptr<ComLynxWire> mWire;
     std::optional<int> mData;
@@ -100,4 +110,6 @@ private:
     int mId;
   } mRx;
 
+  std::shared_ptr<ComLynxWire> mWire;
+
 };
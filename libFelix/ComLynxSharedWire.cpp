@@ -0,0 +1,398 @@
+#include "pch.hpp"
+#include "ComLynxSharedWire.hpp"
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+struct ComLynxSharedWire::Event
+{
+  enum Type : uint8_t
+  {
+    LEVEL,
+    COARSE
+  };
+
+  uint64_t tick;
+  uint32_t generation;
+  Type type;
+  uint8_t level;
+  uint8_t parbit;
+  int32_t value;
+};
+
+//Constructed by the process that created the segment, which publishes the magic last
+struct ComLynxSharedWire::Segment
+{
+  static constexpr uint32_t MAGIC = 0x314c4346; //"FCL1"
+  //users of a segment that is being unlinked by the last one
+  static constexpr uint32_t CLOSED = ~0u;
+
+  struct Client
+  {
+    //process holding the slot, 0 if it is free. A slot of a process that died is taken over by the next client
+    std::atomic<int32_t> pid;
+    //odd while the slot is taken, so that a new client in a slot is told apart from the previous one
+    std::atomic<uint32_t> generation;
+    //all events before this tick are sent
+    std::atomic<uint64_t> tick;
+  };
+
+  struct Ring
+  {
+    static constexpr uint64_t SIZE = 1024;
+
+    alignas( 64 ) std::atomic<uint64_t> head;
+    alignas( 64 ) std::atomic<uint64_t> tail;
+    std::array<Event, SIZE> events;
+  };
+
+  std::atomic<uint32_t> magic;
+  std::atomic<uint32_t> users;
+  std::array<Client, MAX_CLIENTS> clients;
+  //rings[from][to]
+  std::array<std::array<Ring, MAX_CLIENTS>, MAX_CLIENTS> rings;
+};
+
+static_assert( std::atomic<uint64_t>::is_always_lock_free && std::atomic<uint32_t>::is_always_lock_free && std::atomic<int32_t>::is_always_lock_free,
+  "atomics in shared memory must not need a lock" );
+
+namespace
+{
+
+bool alive( int32_t pid )
+{
+  return kill( pid, 0 ) == 0 || errno == EPERM;
+}
+
+}
+
+std::shared_ptr<ComLynxSharedWire> ComLynxSharedWire::open( std::string const& name )
+{
+  std::string path = name.starts_with( '/' ) ? name : "/" + name;
+
+  //another process may be in the middle of creating the segment or of unlinking it as the last one leaving
+  auto const deadline = std::chrono::steady_clock::now() + STALL_TIMEOUT;
+  for ( ; std::chrono::steady_clock::now() < deadline; std::this_thread::yield() )
+  {
+    Segment * segment{};
+    int fd = shm_open( path.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600 );
+    if ( fd >= 0 )
+    {
+      segment = create( fd );
+      if ( !segment )
+      {
+        shm_unlink( path.c_str() );
+        return {};
+      }
+    }
+    else if ( errno == EEXIST )
+    {
+      fd = shm_open( path.c_str(), O_RDWR, 0 );
+      if ( fd < 0 && errno != ENOENT )
+        return {};
+      segment = fd >= 0 ? attach( fd ) : nullptr;
+      if ( !segment )
+        continue;
+    }
+    else
+    {
+      return {};
+    }
+
+    uint32_t users = segment->users.load();
+    while ( users != Segment::CLOSED && !segment->users.compare_exchange_weak( users, users + 1 ) )
+    {
+    }
+    if ( users == Segment::CLOSED )
+    {
+      munmap( segment, sizeof( Segment ) );
+      continue;
+    }
+
+    if ( auto slot = join( *segment ) )
+      return std::shared_ptr<ComLynxSharedWire>( new ComLynxSharedWire{ std::move( path ), segment, *slot, segment->clients[*slot].generation.load(), segment->clients[*slot].tick.load() } );
+
+    leave( segment, path );
+    return {};
+  }
+
+  return {};
+}
+
+ComLynxSharedWire::Segment * ComLynxSharedWire::create( int fd )
+{
+  bool sized = ftruncate( fd, sizeof( Segment ) ) == 0;
+  void * memory = sized ? mmap( nullptr, sizeof( Segment ), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 ) : MAP_FAILED;
+  close( fd );
+  if ( memory == MAP_FAILED )
+    return nullptr;
+
+  auto segment = new ( memory ) Segment{};
+  segment->magic.store( Segment::MAGIC, std::memory_order_release );
+  return segment;
+}
+
+//null if the segment is not completely created yet or it is not a ComLynx segment of this version
+ComLynxSharedWire::Segment * ComLynxSharedWire::attach( int fd )
+{
+  struct stat st{};
+  bool sized = fstat( fd, &st ) == 0 && st.st_size == sizeof( Segment );
+  void * memory = sized ? mmap( nullptr, sizeof( Segment ), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 ) : MAP_FAILED;
+  close( fd );
+  if ( memory == MAP_FAILED )
+    return nullptr;
+
+  auto segment = static_cast<Segment *>( memory );
+  if ( segment->magic.load( std::memory_order_acquire ) != Segment::MAGIC )
+  {
+    munmap( memory, sizeof( Segment ) );
+    return nullptr;
+  }
+
+  return segment;
+}
+
+std::optional<int> ComLynxSharedWire::join( Segment & segment )
+{
+  int32_t const pid = (int32_t)getpid();
+
+  for ( int slot = 0; slot < MAX_CLIENTS; ++slot )
+  {
+    auto & client = segment.clients[slot];
+    int32_t owner = client.pid.load();
+    if ( ( owner != 0 && alive( owner ) ) || !client.pid.compare_exchange_strong( owner, pid ) )
+      continue;
+
+    //user of a process that died without leaving is taken over too
+    if ( owner != 0 )
+      segment.users.fetch_sub( 1 );
+
+    //a client joins at the time of the ones that are already there
+    uint64_t joinTick{};
+    for ( int peer = 0; peer < MAX_CLIENTS; ++peer )
+    {
+      if ( peer != slot && ( segment.clients[peer].generation.load() & 1 ) != 0 )
+        joinTick = std::max( joinTick, segment.clients[peer].tick.load() );
+    }
+    client.tick.store( joinTick );
+
+    //events not received by the previous client in the slot
+    for ( int peer = 0; peer < MAX_CLIENTS; ++peer )
+    {
+      auto & ring = segment.rings[peer][slot];
+      ring.tail.store( ring.head.load() );
+    }
+
+    //next odd generation, also if the previous client died taken or leaving the slot
+    uint32_t generation = client.generation.load();
+    client.generation.store( generation + ( ( generation & 1 ) != 0 ? 2 : 1 ), std::memory_order_release );
+    return slot;
+  }
+
+  return std::nullopt;
+}
+
+//the last user unlinks the segment, so that the next client creates a new one
+void ComLynxSharedWire::leave( Segment * segment, std::string const& path )
+{
+  uint32_t users = segment->users.load();
+  while ( !segment->users.compare_exchange_weak( users, users == 1 ? Segment::CLOSED : users - 1 ) )
+  {
+  }
+
+  if ( users == 1 )
+    shm_unlink( path.c_str() );
+
+  munmap( segment, sizeof( Segment ) );
+}
+
+ComLynxSharedWire::ComLynxSharedWire( std::string name, Segment * segment, int slot, uint32_t generation, uint64_t joinTick ) : mName{ std::move( name ) }, mSegment{ segment }, mSlot{ slot },
+  mGeneration{ generation }, mTick{ joinTick }, mOffset{}, mStarted{}, mPeerGeneration{}, mPeerLevel{}, mPeerStall{}, mLevel{ 1 }, mCoarseValue{}, mParBit{}
+{
+  mPeerLevel.fill( 1 );
+}
+
+ComLynxSharedWire::~ComLynxSharedWire()
+{
+  //others release the line held by this client on the generation change
+  mSegment->clients[mSlot].generation.store( mGeneration + 1 );
+  mSegment->clients[mSlot].pid.store( 0 );
+
+  leave( mSegment, mName );
+}
+
+void ComLynxSharedWire::pullUp()
+{
+  mLevel = 1;
+  send( Event{ mTick, mGeneration, Event::LEVEL, 1, 0, 0 } );
+}
+
+void ComLynxSharedWire::pullDown()
+{
+  mLevel = 0;
+  send( Event{ mTick, mGeneration, Event::LEVEL, 0, 0, 0 } );
+}
+
+int ComLynxSharedWire::wire() const
+{
+  int result = mLevel == 0 ? -1 : 0;
+  for ( int peer = 0; peer < MAX_CLIENTS; ++peer )
+  {
+    if ( peer != mSlot && mPeerLevel[peer] == 0 )
+      result -= 1;
+  }
+  return result;
+}
+
+int ComLynxSharedWire::connect()
+{
+  return mSlot;
+}
+
+void ComLynxSharedWire::setCoarse( int value, int parbit )
+{
+  mCoarseValue = value;
+  mParBit = parbit;
+  send( Event{ mTick, mGeneration, Event::COARSE, 0, (uint8_t)parbit, value } );
+}
+
+int ComLynxSharedWire::getCoarse( int & parbit ) const
+{
+  parbit = mParBit;
+  return mCoarseValue;
+}
+
+void ComLynxSharedWire::sync( uint64_t tick )
+{
+  if ( !mStarted )
+  {
+    mOffset = (int64_t)mTick - (int64_t)tick;
+    mStarted = true;
+  }
+
+  mTick = std::max( mTick, (uint64_t)( (int64_t)tick + mOffset ) );
+  mSegment->clients[mSlot].tick.store( mTick, std::memory_order_release );
+
+  for ( int peer = 0; peer < MAX_CLIENTS; ++peer )
+  {
+    if ( peer == mSlot )
+      continue;
+
+    waitFor( peer );
+    receive( peer );
+  }
+}
+
+void ComLynxSharedWire::send( Event const& event )
+{
+  for ( int peer = 0; peer < MAX_CLIENTS; ++peer )
+  {
+    if ( peer == mSlot || ( mSegment->clients[peer].generation.load( std::memory_order_acquire ) & 1 ) == 0 )
+      continue;
+
+    auto & ring = mSegment->rings[mSlot][peer];
+    uint64_t head = ring.head.load( std::memory_order_relaxed );
+
+    //receiver drains the ring as it runs, the event is dropped if it is stalled
+    auto deadline = std::chrono::steady_clock::now() + STALL_TIMEOUT;
+    while ( head - ring.tail.load( std::memory_order_acquire ) >= Segment::Ring::SIZE )
+    {
+      if ( std::chrono::steady_clock::now() > deadline )
+        break;
+      std::this_thread::yield();
+    }
+
+    if ( head - ring.tail.load( std::memory_order_acquire ) < Segment::Ring::SIZE )
+    {
+      ring.events[head % Segment::Ring::SIZE] = event;
+      ring.head.store( head + 1, std::memory_order_release );
+    }
+  }
+}
+
+void ComLynxSharedWire::receive( int peer )
+{
+  auto & ring = mSegment->rings[peer][mSlot];
+  uint64_t tail = ring.tail.load( std::memory_order_relaxed );
+  uint64_t head = ring.head.load( std::memory_order_acquire );
+
+  for ( ; tail != head; ++tail )
+  {
+    Event const& event = ring.events[tail % Segment::Ring::SIZE];
+    if ( event.tick + LATENCY > mTick )
+      break;
+
+    if ( event.generation != mPeerGeneration[peer] )
+    {
+      mPeerGeneration[peer] = event.generation;
+      mPeerLevel[peer] = 1;
+    }
+
+    switch ( event.type )
+    {
+    case Event::LEVEL:
+      mPeerLevel[peer] = event.level;
+      break;
+    case Event::COARSE:
+      mCoarseValue = event.value;
+      mParBit = event.parbit;
+      break;
+    }
+  }
+
+  ring.tail.store( tail, std::memory_order_release );
+
+  //line is released by a peer that left or died and was replaced, even if the new client has sent nothing yet
+  uint32_t generation = mSegment->clients[peer].generation.load( std::memory_order_acquire );
+  if ( ( generation & 1 ) == 0 )
+  {
+    mPeerLevel[peer] = 1;
+  }
+  else if ( generation != mPeerGeneration[peer] && tail == head )
+  {
+    mPeerGeneration[peer] = generation;
+    mPeerLevel[peer] = 1;
+  }
+}
+
+void ComLynxSharedWire::waitFor( int peer )
+{
+  auto & client = mSegment->clients[peer];
+
+  if ( mPeerStall[peer] )
+  {
+    if ( *mPeerStall[peer] == client.tick.load( std::memory_order_acquire ) )
+    {
+      //a process that died does not leave, so its slot is left for it and the line it held is released on the generation change
+      int32_t owner = client.pid.load();
+      if ( owner != 0 && !alive( owner ) && client.pid.compare_exchange_strong( owner, (int32_t)getpid() ) )
+      {
+        uint32_t generation = client.generation.load();
+        client.generation.store( generation + ( generation & 1 ), std::memory_order_release );
+        client.pid.store( 0 );
+        mSegment->users.fetch_sub( 1 );
+      }
+      return;
+    }
+    mPeerStall[peer].reset();
+  }
+
+  //every event the peer sends from now on is due after this tick
+  auto ready = [&]
+  {
+    return ( client.generation.load( std::memory_order_acquire ) & 1 ) == 0 || client.tick.load( std::memory_order_acquire ) + LATENCY > mTick;
+  };
+
+  auto deadline = std::chrono::steady_clock::now() + STALL_TIMEOUT;
+  for ( uint32_t spin = 0; !ready(); ++spin )
+  {
+    if ( ( spin & 0x3ff ) == 0 && std::chrono::steady_clock::now() > deadline )
+    {
+      mPeerStall[peer] = client.tick.load( std::memory_order_acquire );
+      return;
+    }
+    std::this_thread::yield();
+  }
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include "ComLynxWire.hpp"
+
+//ComLynx line shared by up to MAX_CLIENTS emulator processes on one host through a POSIX shared memory segment.
+//Every client sends its line level changes and bytes as timestamped events through lock-free single producer single consumer rings,
+//one for each other client, and applies events of others LATENCY ticks after they were sent.
+//In sync a client publishes its tick and waits until every other one is less than LATENCY ticks behind,
+//so no event can come too late and the skew between processes stays bounded.
+//A client that does not move for STALL_TIMEOUT is not waited for until it moves again. If its process is gone, the client
+//waiting for it leaves the slot for it, which releases the line it held.
+//The first client creates the segment exclusively and the last one leaving unlinks it. Slot of a process that died
+//without leaving is taken over by the next client joining.
+//Ticks of a client must not go back, so it can't be combined with rewind or run-ahead.
+class ComLynxSharedWire : public ComLynxWire
+{
+public:
+  static constexpr int MAX_CLIENTS = 8;
+  static constexpr uint64_t LATENCY = 2048;
+  static constexpr std::chrono::milliseconds STALL_TIMEOUT{ 500 };
+
+  //joins segment of given name creating it if needed. Null if it can't be mapped in STALL_TIMEOUT or all slots are taken
+  static std::shared_ptr<ComLynxSharedWire> open( std::string const& name );
+  ~ComLynxSharedWire() override;
+
+  void pullUp() override;
+  void pullDown() override;
+  int wire() const override;
+  int connect() override;
+  void setCoarse( int value, int parbit ) override;
+  int getCoarse( int & parbit ) const override;
+  void sync( uint64_t tick ) override;
+
+private:
+  struct Segment;
+  struct Event;
+
+  ComLynxSharedWire( std::string name, Segment * segment, int slot, uint32_t generation, uint64_t joinTick );
+
+  static Segment * create( int fd );
+  static Segment * attach( int fd );
+  //takes a free slot
+  static std::optional<int> join( Segment & segment );
+  static void leave( Segment * segment, std::string const& path );
+
+  void send( Event const& event );
+  void receive( int peer );
+  void waitFor( int peer );
+
+private:
+  std::string mName;
+  Segment * mSegment;
+  int mSlot;
+  uint32_t mGeneration;
+  //tick on the wire, i.e. of the Core shifted to the time of clients that were there first
+  uint64_t mTick;
+  int64_t mOffset;
+  bool mStarted;
+  std::array<uint32_t, MAX_CLIENTS> mPeerGeneration;
+  //0 if the peer pulls the line down
+  std::array<int, MAX_CLIENTS> mPeerLevel;
+  //tick of a stalled peer that is not waited for
+  std::array<std::optional<uint64_t>, MAX_CLIENTS> mPeerStall;
+  int mLevel;
+  int mCoarseValue;
+  int mParBit;
+};
@@ -1,45 +1,52 @@
 #pragma once
 
+//ComLynx line of Cores in one process. ComLynxSharedWire connects Cores in separate processes.
 class ComLynxWire
 {
 public:
   ComLynxWire() : mValue{ 0 }, mClients{ 0 }, mCoarseValue{}, mParBit{} {}
+  virtual ~ComLynxWire() = default;
 
-  void pullUp()
+  virtual void pullUp()
   {
     mValue += 1;
   }
 
-  void pullDown()
+  virtual void pullDown()
   {
     mValue -= 1;
   }
 
-  int wire() const
+  virtual int wire() const
   {
     return mValue;
   }
 
   int value() const
   {
-    return mValue == 0 ? 1 : 0;
+    return wire() == 0 ? 1 : 0;
   }
 
-  int connect()
+  virtual int connect()
   {
     return mClients++;
   }
 
-  void setCoarse( int value, int parbit )
+  virtual void setCoarse( int value, int parbit )
   {
     mCoarseValue = value;
     mParBit = parbit;
   }
 
-  int getCoarse( int & parbit ) const
+  virtual int getCoarse( int & parbit ) const
   {
-    return mCoarseValue;
     parbit = mParBit;
+    return mCoarseValue;
+  }
+
+  //current tick of the Core on every ComLynx pulse, every line and at the end of every run, before the other calls made on that tick
+  virtual void sync( uint64_t tick )
+  {
   }
 
 private:
@@ -12,46 +12,27 @@
 #include "Log.hpp"
 #include "BootROMTraps.hpp"
 #include "TraceHelper.hpp"
-#include "DebugRAM.hpp"
 #include "ScriptDebuggerEscapes.hpp"
 #include "VGMWriter.hpp"
-
-uint8_t* gDebugRAM;
+#include "StateArchive.hpp"
+#include "Rewind.hpp"
+#include "HostProfiler.hpp"
 
 static constexpr uint64_t RESET_DURATION = 5 * 10;  //asserting RESET for 10 cycles to make sure none will miss it
 static constexpr uint32_t BAD_LAST_ACCESS_PAGE = ~0;
 
-static constexpr bool ENABLE_TRAPS = true;
+static constexpr uint32_t STATE_MAGIC = 0x53584c46; //"FLXS"
+static constexpr uint32_t STATE_VERSION = 4;
 
 Core::Core( ImageProperties const& imageProperties, std::shared_ptr<ComLynxWire> comLynxWire, std::shared_ptr<IVideoSink> videoSink,
   std::shared_ptr<IInputSource> inputSource, InputFile inputFile, std::shared_ptr<ImageROM const> bootROM,
   std::shared_ptr<ScriptDebuggerEscapes> scriptDebuggerEscapes ) :
-  mRAM{}, mROM{}, mPageTypes{}, mScriptDebugger{ std::make_shared<ScriptDebugger>() }, mCurrentTick{}, mSamplesRemainder{}, mActionQueue{}, mTraceHelper{ std::make_shared<TraceHelper>() }, mCpu{ std::make_shared<CPU>( mTraceHelper ) },
+  mRAM{}, mROM{}, mPages{}, mScriptDebugger{ std::make_shared<ScriptDebugger>() }, mCurrentTick{}, mSampleOrigin{}, mSampleIndex{}, mSPS{}, mSampleTicks{}, mGlobalSamplesEmitted{}, mGlobalSamplesEmittedSnapshot{}, mGlobalSamplesEmittedPerFrame{}, mFramesToRun{}, mExecutedActions{}, mActionQueue{}, mTraceHelper{ std::make_shared<TraceHelper>() }, mCpu{ std::make_shared<CPU>( mTraceHelper, mCurrentTick ) },
   mCartridge{ std::make_shared<Cartridge>( imageProperties, std::shared_ptr<ImageCart>{}, mTraceHelper ) }, mComLynx{ std::make_shared<ComLynx>( comLynxWire ) }, mComLynxWire{ comLynxWire },
   mMikey{ std::make_shared<Mikey>( *this, *mComLynx, videoSink ) }, mSuzy{ std::make_shared<Suzy>( *this, inputSource ) }, mMapCtl{}, mLastAccessPage{ BAD_LAST_ACCESS_PAGE },
-  mDMAAddress{}, mFastCycleTick{ 4 }, mPatchMagickCodeAccumulator{}, mResetRequestDuringSpriteRendering{}, mSuzyRunning{}, mGlobalSamplesEmitted{}, mGlobalSamplesEmittedSnapshot{}, mGlobalSamplesEmittedPerFrame{}
+  mDMAAddress{}, mFastCycleTick{ 4 }, mPatchMagickCodeAccumulator{}, mRewind{}, mRunAheadState{}, mRunAhead{}, mRunAheadUnmute{}, mHostProfiler{}, mResetRequestDuringSpriteRendering{}, mSuzyRunning{}, mCPURequestPending{}, mInlineSuzy{}, mRewindCapture{}, mRunAheadFrame{}, mIdleLoop{}
 {
-  gDebugRAM = &mRAM[0];
-
-  for ( size_t i = 0; i < mPageTypes.size(); ++i )
-  {
-    switch ( i )
-    {
-      case 0xff:
-      case 0xfe:
-        mPageTypes[i] = PageType::ROM;
-        break;
-      case 0xfd:
-        mPageTypes[i] = PageType::MIKEY;
-        break;
-      case 0xfc:
-        mPageTypes[i] = PageType::SUZY;
-        break;
-      default:
-        mPageTypes[i] = PageType::RAM;
-        break;
-    }
-  }
+  mapPages();
 
   switch ( inputFile.getType() )
   {
@@ -147,7 +128,6 @@ void Core::pulseReset( std::optional<uint16_t> resetAddress )
 
 Core::~Core()
 {
-  gDebugRAM = nullptr;
 }
 
 void Core::requestDisplayDMA( uint64_t tick, uint16_t address )
@@ -203,6 +183,7 @@ void Core::desertInterrupt( int mask, std::optional<uint64_t> tick )
 void Core::executeSequencedAction( SequencedAction seqAction )
 {
   auto action = seqAction.getAction();
+  mExecutedActions += 1;
 
   switch ( action )
   {
@@ -240,18 +221,6 @@ void Core::executeSequencedAction( SequencedAction seqAction )
   case Action::DESERT_RESET:
     mCpu->desertInterrupt( CPUState::I_RESET );
     break;
-  case Action::SAMPLE_AUDIO:
-    if ( mSamplesEmitted >= mOutputSamples.size() )
-    {
-      mCpu->breakNext();
-    }
-    else
-    {
-      mOutputSamples[mSamplesEmitted++] = mMikey->sampleAudio( mCurrentTick );
-      mGlobalSamplesEmitted += 1;
-      enqueueSampling();
-    }
-    break;
   case Action::BATCH_END:
     mCpu->breakNext();
     break;
@@ -277,9 +246,8 @@ bool Core::executeSuzyAction()
 
   mSuzyProcessRequest = mSuzyProcess->advance();
 
-  switch ( mSuzyProcessRequest->type )
+  if ( mSuzyProcessRequest->type == ISuzyProcess::Request::FINISH )
   {
-  case ISuzyProcess::Request::FINISH:
     mSuzyRunning = false;
     mMikey->suzyDone();
     mSuzyProcess.reset();
@@ -289,152 +257,224 @@ bool Core::executeSuzyAction()
       mResetRequestDuringSpriteRendering = false;
       pulseReset();
     }
-    break;
+    return true;
+  }
+
+  //inline engine suspends on a request that can't be served before due action or interrupt
+  if ( ( mActionQueue.headTick() <= mCurrentTick ) || ( mCpu->interruptedMask() != 0 ) )
+  {
+    mSuzyProcess->postpone();
+    return true;
+  }
+
+  uint32_t value;
+  if ( serveSuzyRequest( *mSuzyProcessRequest, value ) )
+    mSuzyProcess->respond( value );
+
+  return true;
+}
+
+//Serves Suzy request from inside of the Suzy coroutine if it would be the next thing Core::run did,
+//i.e. no action is due and CPU is not interrupted. Suzy accesses only RAM and is never trapped.
+bool Core::inlineSuzyAction( ISuzyProcess::Request const& req, uint32_t & value )
+{
+  if ( !mInlineSuzy )
+    return false;
+
+  if ( mActionQueue.headTick() <= mCurrentTick )
+    return false;
+
+  if ( mCpu->interruptedMask() != 0 )
+    return false;
+
+  serveSuzyRequest( req, value );
+  return true;
+}
+
+//Performs RAM access of Suzy request. Returns true if there is a value to respond with.
+bool Core::serveSuzyRequest( ISuzyProcess::Request const& req, uint32_t & value )
+{
+  if ( mHostProfiler )
+    mHostProfiler->suzyRequest( req.type );
+
+  switch ( req.type )
+  {
   case ISuzyProcess::Request::READ:
   case ISuzyProcess::Request::FETCHSCB:
-    mSuzyProcess->respond( mRAM[mSuzyProcessRequest->addr] );
+    value = mRAM[req.addr];
     mCurrentTick += 5ull; //read byte
-    break;
+    return true;
   case ISuzyProcess::Request::READ4:
   case ISuzyProcess::Request::READPAL:
-    if ( mSuzyProcessRequest->addr <= 0xfffc )
-      mSuzyProcess->respond( *( (uint32_t const *)( mRAM.data() + mSuzyProcessRequest->addr ) ) );
     mCurrentTick += 5ull + 3 * mFastCycleTick;  //read 4 bytes
-    break;
+    if ( req.addr > 0xfffc )
+      return false;
+    value = *( (uint32_t const *)( mRAM.data() + req.addr ) );
+    return true;
   case ISuzyProcess::Request::WRITE:
   case ISuzyProcess::Request::WRITEFRED:
-    mRAM[mSuzyProcessRequest->addr] = (uint8_t)mSuzyProcessRequest->value;
+    mRAM[req.addr] = (uint8_t)req.value;
     mCurrentTick += 5ull; //write byte
-    break;
+    return false;
   case ISuzyProcess::Request::COLRMW:
     {
-      if ( mSuzyProcessRequest->addr > 0xfffc )
-        break;
+      if ( req.addr > 0xfffc )
+        return false;
 
-      const uint32_t u16 = mSuzyProcessRequest->value;
+      const uint32_t u16 = req.value;
       const uint32_t u32 = u16 | ( u16 << 16 );
-      const uint32_t maskedU32 = u32 & mSuzyProcessRequest->mask;
-
-      const uint32_t value = *( (uint32_t const*)( mRAM.data() + mSuzyProcessRequest->addr ) );
-      const uint32_t maskedValue = value & ~mSuzyProcessRequest->mask;
-      const uint32_t outValue = value & mSuzyProcessRequest->mask;
+      const uint32_t maskedU32 = u32 & req.mask;
 
-      *( (uint32_t *)( mRAM.data() + mSuzyProcessRequest->addr ) ) = maskedValue | maskedU32;
+      const uint32_t ramValue = *( (uint32_t const*)( mRAM.data() + req.addr ) );
+      const uint32_t maskedValue = ramValue & ~req.mask;
+      value = ramValue & req.mask;
 
-      mSuzyProcess->respond( outValue );
+      *( (uint32_t *)( mRAM.data() + req.addr ) ) = maskedValue | maskedU32;
     }
     mCurrentTick += 5ull + 7 * mFastCycleTick;  //read 4 bytes & write 4 bytes
-    break;
+    return true;
   case ISuzyProcess::Request::VIDRMW:
     {
-      auto value = mRAM[mSuzyProcessRequest->addr] & mSuzyProcessRequest->mask | mSuzyProcessRequest->value;
-      mRAM[mSuzyProcessRequest->addr] = (uint8_t)value;
+      auto ramValue = mRAM[req.addr] & req.mask | req.value;
+      mRAM[req.addr] = (uint8_t)ramValue;
     }
     mCurrentTick += 5ull + mFastCycleTick;  //read & write byte
-    break;
+    return false;
   case ISuzyProcess::Request::XOR:
     {
-      auto ramValue = mRAM[mSuzyProcessRequest->addr];
-      auto xorValue = ramValue ^ mSuzyProcessRequest->value;
-      mRAM[mSuzyProcessRequest->addr] = (uint8_t)xorValue;
+      auto ramValue = mRAM[req.addr];
+      auto xorValue = ramValue ^ req.value;
+      mRAM[req.addr] = (uint8_t)xorValue;
     }
     mCurrentTick += 5ull + mFastCycleTick; //read & write byte
-    break;
+    return false;
+  default:
+    return false;
   }
-
-  return true;
 }
 
 CpuBreakType Core::executeCPUAction()
 {
-  auto const& req = mCpu->advance();
-
-  auto pageType = mPageTypes[req.address >> 8];
-
-  enum class CPUAction
-  {
-    FETCH_OPCODE_RAM = 0,
-    FETCH_OPERAND_RAM,
-    READ_RAM,
-    WRITE_RAM,
-    FETCH_OPCODE_SUZY,
-    FETCH_OPERAND_SUZY,
-    READ_SUZY,
-    WRITE_SUZY,
-    FETCH_OPCODE_MIKEY,
-    FETCH_OPERAND_MIKEY,
-    READ_MIKEY,
-    WRITE_MIKEY,
-    FETCH_OPCODE_KENREL,
-    FETCH_OPERAND_KENREL,
-    READ_KENREL,
-    WRITE_KENREL
-  };
+  if ( !mCPURequestPending )
+  {
+    auto const& req = mCpu->advance();
+    if ( req.type == CPU::Request::Type::FETCH_OPCODE && mPages[req.address >> 8].ram )
+      skipIdleLoop( req.address );
+    //inline CPU engine suspends on a request that can't be served before due action or running Suzy
+    if ( ( mActionQueue.headTick() <= mCurrentTick ) || ( mSuzyProcess && mSuzyRunning ) )
+    {
+      mCPURequestPending = true;
+      return CpuBreakType::NONE;
+    }
+  }
 
-  CPUAction action = (CPUAction)( (int)req.type + (int)pageType );
+  mCPURequestPending = false;
 
-  switch ( action )
+  //the variant follows CPU that switches on instruction boundary
+  if ( mCpu->isInstrumented() )
+    return serveCPURequest<Instrumented>( mCpu->request() );
+  else
+    return serveCPURequest<Bare>( mCpu->request() );
+}
+
+template<typename Instrumentation>
+CpuBreakType Core::serveCPURequest( CPU::Request const& req )
+{
+  auto const& page = mPages[req.address >> 8];
+
+  if ( !isIdleRead<Instrumentation>( req, page.type ) )
+    mIdleLoop.clean = false;
+
+  switch ( page.type )
   {
-  case CPUAction::FETCH_OPCODE_RAM:
-    mCurrentTick += fetchRAMTiming( req.address );
-    return mCpu->respondFetchOpcode( fetchRAM( req.address ) );
-  case CPUAction::FETCH_OPERAND_RAM:
-    mCpu->respond( readRAM( req.address ) );
-    mCurrentTick += fetchRAMTiming( req.address );
-    break;
-  case CPUAction::READ_RAM:
-    mCpu->respond( readRAM( req.address ) );
-    mCurrentTick += readTiming( req.address );
-    break;
-  case CPUAction::WRITE_RAM:
-    writeRAM( req.address, req.value );
-    mCurrentTick += writeTiming( req.address );
-    break;
-  case CPUAction::FETCH_OPCODE_KENREL:
-    mCurrentTick += fetchROMTiming( req.address );
-    return mCpu->respondFetchOpcode( readROM( req.address & 0x1ff, true ) );
-  case CPUAction::FETCH_OPERAND_KENREL:
-    mCpu->respond( readROM( req.address & 0x1ff, false ) );
-    mCurrentTick += fetchROMTiming( req.address );
+  case PageType::RAM:
+    switch ( req.type )
+    {
+    case CPU::Request::Type::FETCH_OPCODE:
+      mCurrentTick += fetchRAMTiming( req.address );
+      return mCpu->respondFetchOpcode( fetchRAM<Instrumentation>( req.address ) );
+    case CPU::Request::Type::FETCH_OPERAND:
+      mCpu->respond( readRAM<Instrumentation>( req.address ) );
+      mCurrentTick += fetchRAMTiming( req.address );
+      break;
+    case CPU::Request::Type::READ:
+      mCpu->respond( readRAM<Instrumentation>( req.address ) );
+      mCurrentTick += readTiming( req.address );
+      break;
+    case CPU::Request::Type::WRITE:
+      writeRAM<Instrumentation>( req.address, req.value );
+      mCurrentTick += writeTiming( req.address );
+      break;
+    }
     break;
-  case CPUAction::READ_KENREL:
-    mCpu->respond( readROM( req.address & 0x1ff, false ) );
-    mCurrentTick += readTiming( req.address );
+  case PageType::ROM:
+    switch ( req.type )
+    {
+    case CPU::Request::Type::FETCH_OPCODE:
+      mCurrentTick += fetchROMTiming( req.address );
+      return mCpu->respondFetchOpcode( fetchROM( req.address & 0x1ff ) );
+    case CPU::Request::Type::FETCH_OPERAND:
+      mCpu->respond( readROM( req.address & 0x1ff ) );
+      mCurrentTick += fetchROMTiming( req.address );
+      break;
+    case CPU::Request::Type::READ:
+      mCpu->respond( readROM( req.address & 0x1ff ) );
+      mCurrentTick += readTiming( req.address );
+      break;
+    case CPU::Request::Type::WRITE:
+      //ignore write to ROM
+      mScriptDebugger->writeROM( *this, req.address & 0x1ff, req.value );
+      mCurrentTick += writeTiming( req.address );
+      break;
+    }
     break;
-  case CPUAction::WRITE_KENREL:
-    writeROM( req.address & 0x1ff, req.value );
-    mCurrentTick += writeTiming( req.address );
+  case PageType::VECTORS:
+    switch ( req.type )
+    {
+    case CPU::Request::Type::FETCH_OPCODE:
+      mCurrentTick += fetchROMTiming( req.address );
+      return mCpu->respondFetchOpcode( readROM( req.address & 0x1ff, true ) );
+    case CPU::Request::Type::FETCH_OPERAND:
+      mCpu->respond( readROM( req.address & 0x1ff, false ) );
+      mCurrentTick += fetchROMTiming( req.address );
+      break;
+    case CPU::Request::Type::READ:
+      mCpu->respond( readROM( req.address & 0x1ff, false ) );
+      mCurrentTick += readTiming( req.address );
+      break;
+    case CPU::Request::Type::WRITE:
+      writeROM( req.address & 0x1ff, req.value );
+      mCurrentTick += writeTiming( req.address );
+      break;
+    }
     break;
-  case CPUAction::FETCH_OPCODE_SUZY:
-    //no code in Suzy napespace. Should trigger emulation break
-    mCurrentTick = mSuzy->requestRead( mCurrentTick, req.address );
-    return mCpu->respondFetchOpcode( readSuzy( req.address ) );
-  case CPUAction::FETCH_OPERAND_SUZY:
-    [[fallthrough]];
-  case CPUAction::READ_SUZY:
+  case PageType::SUZY:
+    if ( req.type == CPU::Request::Type::WRITE )
+    {
+      mCurrentTick = mSuzy->requestWrite( mCurrentTick, req.address );
+      writeSuzy<Instrumentation>( req.address, req.value );
+      mLastAccessPage = BAD_LAST_ACCESS_PAGE;
+      break;
+    }
     mCurrentTick = mSuzy->requestRead( mCurrentTick, req.address );
-    mCpu->respond( readSuzy( req.address ) );
-    mLastAccessPage = BAD_LAST_ACCESS_PAGE;
-    break;
-  case CPUAction::WRITE_SUZY:
-    mCurrentTick = mSuzy->requestWrite( mCurrentTick, req.address );
-    writeSuzy( req.address, req.value );
-    mLastAccessPage = BAD_LAST_ACCESS_PAGE;
-    break;
-  case CPUAction::FETCH_OPCODE_MIKEY:
     //no code in Suzy napespace. Should trigger emulation break
-    mCurrentTick = mMikey->requestAccess( mCurrentTick, req.address );
-    return mCpu->respondFetchOpcode( readMikey( req.address ) );
-  case CPUAction::FETCH_OPERAND_MIKEY:
-    [[fallthrough]];
-  case CPUAction::READ_MIKEY:
-    mCurrentTick = mMikey->requestAccess( mCurrentTick, req.address );
-    mCpu->respond( readMikey( req.address ) );
+    if ( req.type == CPU::Request::Type::FETCH_OPCODE )
+      return mCpu->respondFetchOpcode( readSuzy<Instrumentation>( req.address ) );
+    mCpu->respond( readSuzy<Instrumentation>( req.address ) );
     mLastAccessPage = BAD_LAST_ACCESS_PAGE;
     break;
-  case CPUAction::WRITE_MIKEY:
+  case PageType::MIKEY:
     mCurrentTick = mMikey->requestAccess( mCurrentTick, req.address );
-    writeMikey( req.address, req.value );
+    if ( req.type == CPU::Request::Type::WRITE )
+    {
+      writeMikey<Instrumentation>( req.address, req.value );
+      mLastAccessPage = BAD_LAST_ACCESS_PAGE;
+      break;
+    }
+    //no code in Mikey napespace. Should trigger emulation break
+    if ( req.type == CPU::Request::Type::FETCH_OPCODE )
+      return mCpu->respondFetchOpcode( readMikey<Instrumentation>( req.address ) );
+    mCpu->respond( readMikey<Instrumentation>( req.address ) );
     mLastAccessPage = BAD_LAST_ACCESS_PAGE;
     break;
   }
@@ -442,17 +482,184 @@ CpuBreakType Core::executeCPUAction()
   return CpuBreakType::NONE;
 }
 
-void Core::enqueueSampling()
+//Serves CPU request from inside of the CPU coroutine if it would be the next thing Core::run did
+//and it touches nothing but RAM, i.e. no action is due, Suzy is not running and there is no trap on the address.
+template<typename Instrumentation>
+bool Core::inlineCPUAction( CPU::Request const& req, uint8_t & value )
+{
+  uint8_t* ram = mPages[req.address >> 8].ram;
+  if ( !ram )
+    return false;
+  ram += req.address & 0xff;
+
+  if ( req.type == CPU::Request::Type::FETCH_OPCODE )
+  {
+    //forward progress can't close a loop
+    if ( req.address > mIdleLoop.lastFetch )
+      mIdleLoop.lastFetch = req.address;
+    else
+      skipIdleLoop( req.address );
+  }
+
+  if ( mActionQueue.headTick() <= mCurrentTick )
+    return false;
+
+  if ( mSuzyProcess && mSuzyRunning )
+    return false;
+
+  switch ( req.type )
+  {
+  case CPU::Request::Type::FETCH_OPCODE:
+    if ( Instrumentation::enabled && mScriptDebugger->isTrapped( ScriptDebugger::Type::RAM_EXECUTE, req.address ) )
+      return false;
+    //CPU samples interrupts right after opcode fetch, so an action due by then must be executed by Core::run first
+    if ( mActionQueue.headTick() <= mCurrentTick + ( ( req.address >> 8 ) == mLastAccessPage ? mFastCycleTick : 5 ) )
+      return false;
+    mCurrentTick += fetchRAMTiming( req.address );
+    value = *ram;
+    return true;
+  case CPU::Request::Type::FETCH_OPERAND:
+    if ( Instrumentation::enabled && mScriptDebugger->isTrapped( ScriptDebugger::Type::RAM_READ, req.address ) )
+      return false;
+    value = *ram;
+    mCurrentTick += fetchRAMTiming( req.address );
+    return true;
+  case CPU::Request::Type::READ:
+    if ( Instrumentation::enabled && mScriptDebugger->isTrapped( ScriptDebugger::Type::RAM_READ, req.address ) )
+      return false;
+    value = *ram;
+    mCurrentTick += readTiming( req.address );
+    return true;
+  case CPU::Request::Type::WRITE:
+    if ( Instrumentation::enabled && mScriptDebugger->isTrapped( ScriptDebugger::Type::RAM_WRITE, req.address ) )
+      return false;
+    *ram = req.value;
+    mCurrentTick += writeTiming( req.address );
+    mIdleLoop.clean = false;
+    return true;
+  default:
+    return false;
+  }
+}
+
+template bool Core::inlineCPUAction<Instrumented>( CPU::Request const& req, uint8_t & value );
+template bool Core::inlineCPUAction<Bare>( CPU::Request const& req, uint8_t & value );
+
+static bool sameCPUState( CPUState const& left, CPUState const& right )
+{
+  return left.pc == right.pc && left.s == right.s && left.a == right.a && left.x == right.x && left.y == right.y && left.p_ == right.p_ &&
+    left.op == right.op && left.ea == right.ea && left.fa == right.fa && left.t == right.t && left.m1 == right.m1 && left.m2 == right.m2;
+}
+
+//Polling loops like waiting for a flag set by an interrupt handler can only end due to an action.
+//If the CPU fetches the loop head again in identical state with nothing but idle reads in between and no action executed,
+//all following iterations take the same time until the next action, so whole iterations up to it are skipped at once.
+//Called on every opcode fetch from RAM before checking for due action.
+void Core::skipIdleLoop( uint16_t address )
+{
+  auto & loop = mIdleLoop;
+
+  //the same fetch is seen again by executeCPUAction if inlineCPUAction declined it
+  if ( loop.fetchTick == mCurrentTick )
+    return;
+
+  auto const& state = mCpu->state();
+
+  if ( address == loop.head )
+  {
+    if ( loop.clean && loop.executedActions == mExecutedActions && loop.lastAccessPage == mLastAccessPage && loop.interrupt == mCpu->interruptedMask() &&
+      sameCPUState( loop.state, state ) && mCpu->request().cpuBreakType == CpuBreakType::NONE && !mCpu->isTraced() &&
+      !( mSuzyProcess && mSuzyRunning ) && mActionQueue.headTick() > mCurrentTick )
+    {
+      uint64_t period = mCurrentTick - loop.tick;
+      mCurrentTick += ( mActionQueue.headTick() - mCurrentTick ) / period * period;
+    }
+  }
+  else if ( address > loop.lastFetch )
+  {
+    //forward progress in the loop body
+    loop.lastFetch = address;
+    return;
+  }
+
+  //target of a backward jump is a new loop head
+  loop.state = state;
+  loop.tick = mCurrentTick;
+  loop.fetchTick = mCurrentTick;
+  loop.executedActions = mExecutedActions;
+  loop.lastAccessPage = mLastAccessPage;
+  loop.interrupt = mCpu->interruptedMask();
+  loop.head = address;
+  loop.lastFetch = address;
+  loop.clean = !( mScriptDebugger->isTrapped( ScriptDebugger::Type::RAM_EXECUTE, address ) );
+}
+
+//Reads with no side effects returning the same value until the next action
+template<typename Instrumentation>
+bool Core::isIdleRead( CPU::Request const& req, PageType pageType ) const
+{
+  if ( req.type == CPU::Request::Type::WRITE )
+    return false;
+
+  switch ( pageType )
+  {
+  case PageType::RAM:
+    return !( Instrumentation::enabled && mScriptDebugger->isTrapped( req.type == CPU::Request::Type::FETCH_OPCODE ? ScriptDebugger::Type::RAM_EXECUTE : ScriptDebugger::Type::RAM_READ, req.address ) );
+  case PageType::MIKEY:
+    //interrupt flags change only in actions. Timers and audio depend on the tick and other registers may have side effects
+    switch ( req.address & 0xff )
+    {
+    case Mikey::INTRST:
+    case Mikey::INTSET:
+      return !( Instrumentation::enabled && mScriptDebugger->isTrapped( ScriptDebugger::Type::MIKEY_READ, req.address ) );
+    default:
+      return false;
+    }
+  default:
+    return false;
+  }
+}
+
+//Audio is not sampled in the event loop. Channels log their output changes and the batch is synthesized from them at once
+//at ticks of a grid continuing from batch to batch, the emulation breaking on the last of them.
+//The grid starts over after audio was not logged, e.g. after loading a state, or when the whole batch would be late already.
+void Core::scheduleSamples( int sps, size_t count )
 {
-  int ticks = 16000000 / mSPS;
-  mSamplesRemainder += 16000000 % mSPS;
-  if ( mSamplesRemainder > mSPS )
+  auto sampleTick = [&]( uint64_t index )
+  {
+    return mSampleOrigin + index * 16000000 / sps;
+  };
+
+  if ( sps != mSPS || !mMikey->isLoggingAudio() || sampleTick( mSampleIndex + count ) <= mCurrentTick )
   {
-    mSamplesRemainder %= mSPS;
-    ticks += 1;
+    mSPS = sps;
+    mSampleOrigin = mCurrentTick;
+    mSampleIndex = 0;
+    mMikey->restartAudio( mCurrentTick );
   }
 
-  mActionQueue.push( { Action::SAMPLE_AUDIO, mCurrentTick + ticks } );
+  mSampleTicks.resize( count );
+  for ( size_t i = 0; i < count; ++i )
+  {
+    mSampleTicks[i] = sampleTick( mSampleIndex + i + 1 );
+  }
+
+  mActionQueue.push( { Action::BATCH_END, mSampleTicks.back() } );
+}
+
+//Synthesizes samples reached by the emulation. The rest of the buffer after an early break is silence
+void Core::emitSamples( std::span<AudioSample> out )
+{
+  size_t const reached = std::ranges::upper_bound( mSampleTicks, mCurrentTick ) - mSampleTicks.begin();
+  if ( reached < mSampleTicks.size() )
+    mActionQueue.erase( Action::BATCH_END );
+
+  if ( reached > 0 )
+    mMikey->synthesizeAudio( std::span<uint64_t const>{ mSampleTicks }.first( reached ), out.first( reached ) );
+  std::fill( out.begin() + reached, out.end(), AudioSample{} );
+
+  mSampleIndex += reached;
+  mGlobalSamplesEmitted += reached;
 }
 
 CpuBreakType Core::run( RunMode runMode )
@@ -472,51 +679,299 @@ CpuBreakType Core::run( RunMode runMode )
     mCpu->clearBreak();
     break;
   }
+
+  //traps added between runs take effect on the next instruction
+  mCpu->setMemoryTraps( mScriptDebugger->hasMemoryTraps() );
 
+  CpuBreakType cpuBreakType;
+  if ( !mHostProfiler )
+  {
+    cpuBreakType = runLoop<false>();
+  }
+  else
+  {
+    HostProfiler::Scope scope{ mHostProfiler.get(), HostProfiler::Zone::RUN };
+    cpuBreakType = runLoop<true>();
+    mHostProfiler->leave();
+  }
+
+  //the wire hears of the tick even if the machine stopped the display and ComLynx timers, so linked peers are never held forever
+  mComLynxWire->sync( mCurrentTick );
+  return cpuBreakType;
+}
+
+//Profiled variant sums up time spent in actions, Suzy and CPU, reading the clock only when one changes to another
+template<bool profiled>
+CpuBreakType Core::runLoop()
+{
   for ( ;; )
   {
-    if ( !mActionQueue.empty() && mActionQueue.headTick() <= mCurrentTick )
+    if ( mActionQueue.headTick() <= mCurrentTick )
     {
-      executeSequencedAction( mActionQueue.pop() );
+      auto action = mActionQueue.pop();
+      if constexpr ( profiled )
+      {
+        mHostProfiler->enter( HostProfiler::Zone::ACTIONS );
+        mHostProfiler->action( action.getAction() );
+      }
+      executeSequencedAction( action );
     }
-    else if ( !executeSuzyAction() )
+    else
     {
-      auto cpuBreakType = executeCPUAction();
-      if ( cpuBreakType != CpuBreakType::NONE )
-        return cpuBreakType;
+      if constexpr ( profiled )
+        mHostProfiler->enter( mSuzyProcess && mSuzyRunning ? HostProfiler::Zone::SUZY : HostProfiler::Zone::CPU );
+
+      if ( !executeSuzyAction() )
+      {
+        auto cpuBreakType = executeCPUAction();
+        if ( cpuBreakType != CpuBreakType::NONE )
+          return cpuBreakType;
+      }
     }
   }
+}
+
+void Core::setHostProfiler( std::shared_ptr<HostProfiler> hostProfiler )
+{
+  mHostProfiler = std::move( hostProfiler );
+  mMikey->setHostProfiler( mHostProfiler.get() );
+  mScriptDebugger->setHostProfiler( mHostProfiler.get() );
+}
+
+void Core::setGuestProfiler( std::shared_ptr<GuestProfiler> guestProfiler )
+{
+  mCpu->setGuestProfiler( std::move( guestProfiler ) );
+}
+
+void Core::setCpuTrace( std::shared_ptr<CpuTraceWriter> cpuTrace )
+{
+  mCpu->setCpuTrace( std::move( cpuTrace ) );
+}
+
+void Core::setCpuEngine( CpuEngine engine )
+{
+  mCpu->setInlineBus( engine == CpuEngine::INLINE ? this : nullptr );
+  mInlineSuzy = engine == CpuEngine::INLINE;
 }
 
+void Core::setResetSeed( uint32_t seed )
+{
+  mCpu->state() = CPUState::reset( seed );
+}
+
+CpuBreakType Core::runFrames( int frames, OutputPolicy outputPolicy )
+{
+  if ( frames <= 0 )
+    return CpuBreakType::NONE;
+
+  mFramesToRun = frames;
+  //frames on the way are not run ahead, so the video sink gets just the start of the last one to be filled by the frame ahead of it
+  if ( mRunAhead > 0 )
+  {
+    mMikey->skipVideoFrames( frames );
+    mMikey->muteVideo( false );
+  }
+  else if ( outputPolicy == OutputPolicy::LAST_FRAME )
+  {
+    mMikey->skipVideoFrames( frames - 1 );
+  }
+  mMikey->logAudio( false, mCurrentTick );
+
+  auto cpuBreakType = run( RunMode::RUN );
+  bool const lastFrameStarted = mFramesToRun == 0;
+
+  //in case of a break before the last frame
+  mFramesToRun = 0;
+  mMikey->skipVideoFrames( 0 );
+
+  if ( mRunAhead > 0 )
+  {
+    mMikey->muteVideo( true );
+    if ( lastFrameStarted )
+      runAhead();
+  }
+
+  if ( mRewindCapture )
+    captureRewind();
+
+  return cpuBreakType;
+}
+
 CpuBreakType Core::advanceAudio( int sps, std::span<AudioSample> outputBuffer, RunMode runMode )
 {
-  mSPS = sps;
-  mOutputSamples = outputBuffer;
-  mSamplesEmitted = 0;
   CpuBreakType cpuBreakType = CpuBreakType::NONE;
 
-  if ( runMode != RunMode::PAUSE )
+  if ( runMode != RunMode::PAUSE && !outputBuffer.empty() )
   {
-    enqueueSampling();
-    cpuBreakType = run( runMode );
+    scheduleSamples( sps, outputBuffer.size() );
+    for ( ;; )
+    {
+      cpuBreakType = run( runMode );
+      if ( !std::exchange( mRunAheadFrame, false ) )
+        break;
+
+      bool const outputComplete = !mActionQueue.contains( Action::BATCH_END );
+      runAhead();
+      //frame start alone is no reason to return
+      if ( cpuBreakType != CpuBreakType::NEXT || outputComplete )
+        break;
+    }
+
+    emitSamples( outputBuffer );
   }
   else
   {
     mCpu->clearBreak();
-  }
-
-  if ( mSamplesEmitted < mOutputSamples.size() )
-  {
-    mActionQueue.erase( Action::SAMPLE_AUDIO );
-    for ( size_t i = mSamplesEmitted; i < mOutputSamples.size(); ++i )
-    {
-      mOutputSamples[mSamplesEmitted++] = {};
-    }
+    std::ranges::fill( outputBuffer, AudioSample{} );
   }
 
+  if ( mRewindCapture )
+    captureRewind();
+
   return cpuBreakType;
 }
 
+bool Core::saveState( std::vector<uint8_t> & out )
+{
+  if ( mSuzyProcess || !mCartridge->canSaveState() )
+    return false;
+
+  HostProfiler::Scope scope{ mHostProfiler.get(), HostProfiler::Zone::SAVE_STATE };
+
+  out.clear();
+  out.reserve( mRAM.size() + 4096 );
+
+  StateWriter ar{ out };
+  uint32_t magic = STATE_MAGIC;
+  uint32_t version = STATE_VERSION;
+  ar( magic, version );
+  serialize( ar );
+
+  return true;
+}
+
+bool Core::loadState( std::span<uint8_t const> in )
+{
+  if ( !mCartridge->canLoadState() )
+    return false;
+
+  HostProfiler::Scope scope{ mHostProfiler.get(), HostProfiler::Zone::LOAD_STATE };
+
+  uint32_t magic{};
+  uint32_t version{};
+
+  //whole snapshot is checked before anything of the machine is overwritten
+  StateValidator validator{ in };
+  validator( magic, version );
+  serialize( validator );
+  if ( !validator.good() || !validator.atEnd() )
+    return false;
+
+  StateReader ar{ in };
+  ar( magic, version );
+  if ( !ar.good() || magic != STATE_MAGIC || version != STATE_VERSION )
+    return false;
+
+  //snapshots are never taken during sprite rendering
+  mSuzyProcess.reset();
+  mSuzyProcessRequest = nullptr;
+  mCPURequestPending = false;
+  mIdleLoop = {};
+  mMikey->logAudio( false, mCurrentTick );
+  serialize( ar );
+  mapPages();
+
+  return ar.good() && ar.atEnd();
+}
+
+void Core::setRewind( size_t frames )
+{
+  mRewind = frames > 0 ? std::make_shared<Rewind>( frames ) : nullptr;
+  mRewindCapture = false;
+}
+
+bool Core::rewindFrame()
+{
+  if ( !mRewind || mRewind->size() < 2 )
+    return false;
+
+  //the latest snapshot is the frame being run now
+  std::vector<uint8_t> latest;
+  std::vector<uint8_t> snapshot;
+  mRewind->pop( latest );
+  mRewind->pop( snapshot );
+
+  //history is kept as it was if the snapshot can't be restored
+  if ( !loadState( snapshot ) )
+  {
+    mRewind->push( std::move( snapshot ) );
+    mRewind->push( std::move( latest ) );
+    return false;
+  }
+
+  mRewindCapture = false;
+  return true;
+}
+
+void Core::setRunAhead( int frames )
+{
+  mRunAhead = std::max( frames, 0 );
+  mMikey->muteVideo( mRunAhead > 0 );
+}
+
+//Emulates mRunAhead frames from the start of the current one. Only the last of them reaches the video sink,
+//so the sink gets one frame per frame of the machine, just mRunAhead frames later one.
+void Core::runAhead()
+{
+  //the frame is not shown if the machine can't be saved
+  if ( !saveState( mRunAheadState ) )
+    return;
+
+  HostProfiler::Scope scope{ mHostProfiler.get(), HostProfiler::Zone::RUN_AHEAD };
+
+  bool const rewindCapture = mRewindCapture;
+  //audio output is produced only by the machine, frames ahead are not logged
+  bool const loggingAudio = mMikey->isLoggingAudio();
+  mMikey->logAudio( false, mCurrentTick );
+  mActionQueue.erase( Action::BATCH_END );
+  mRunAheadUnmute = mRunAhead;
+  mFramesToRun = mRunAhead;
+  run( RunMode::RUN );
+  mFramesToRun = 0;
+  mRunAheadUnmute = 0;
+  mMikey->muteVideo( true );
+
+  loadState( mRunAheadState );
+  mMikey->logAudio( loggingAudio, mCurrentTick );
+  mRewindCapture = rewindCapture;
+}
+
+//Snapshot can't be taken in the middle of sprite list or cartridge transfer and then it is tried again after the next run
+void Core::captureRewind()
+{
+  HostProfiler::Scope scope{ mHostProfiler.get(), HostProfiler::Zone::REWIND };
+  std::vector<uint8_t> snapshot;
+  if ( saveState( snapshot ) )
+  {
+    mRewind->push( std::move( snapshot ) );
+    mRewindCapture = false;
+  }
+}
+
+template<typename Archive>
+void Core::serialize( Archive & ar )
+{
+  ar( mRAM, mROM, mCurrentTick, mGlobalSamplesEmitted, mGlobalSamplesEmittedSnapshot, mGlobalSamplesEmittedPerFrame,
+    mMapCtl, mFastCycleTick, mPatchMagickCodeAccumulator, mLastAccessPage, mDMAAddress, mResetRequestDuringSpriteRendering, mSuzyRunning );
+
+  mActionQueue.serialize( ar );
+  mCpu->serialize( ar );
+  mMikey->serialize( ar );
+  mSuzy->serialize( ar );
+  mComLynx->serialize( ar );
+  mCartridge->serialize( ar );
+}
+
 void Core::enterMonitor()
 {
 }
@@ -534,9 +989,34 @@ Cartridge & Core::getCartridge()
 
 void Core::newLine( int rowNr )
 {
+  if ( rowNr == 104 && mRunAhead > 0 && mFramesToRun == 0 )
+  {
+    auto cpuBreakType = mCpu->request().cpuBreakType;
+    if ( cpuBreakType == CpuBreakType::NONE || cpuBreakType == CpuBreakType::NEXT )
+    {
+      mRunAheadFrame = true;
+      mCpu->breakNext();
+    }
+  }
+
+  //run-ahead starts right after a frame start that went by muted, so the sink is unmuted on the next row without screen data
+  if ( rowNr == 103 && mRunAheadUnmute > 0 && --mRunAheadUnmute == 0 )
+  {
+    mMikey->muteVideo( false );
+  }
+
+  if ( rowNr == 104 && mFramesToRun > 0 && --mFramesToRun == 0 )
+  {
+    mCpu->breakNext();
+  }
 
+  mComLynxWire->sync( mCurrentTick );
+
   if ( rowNr == 0 )
   {
+    mRewindCapture = mRewind != nullptr;
+    if ( mHostProfiler )
+      mHostProfiler->frame();
     mGlobalSamplesEmittedPerFrame = mGlobalSamplesEmitted - mGlobalSamplesEmittedSnapshot;
     mGlobalSamplesEmittedSnapshot = mGlobalSamplesEmitted;
   }
@@ -584,10 +1064,11 @@ uint64_t Core::writeTiming( uint16_t address )
   return 5;
 }
 
+template<typename Instrumentation>
 uint8_t Core::fetchRAM( uint16_t address )
 {
   uint8_t sourceByte = mRAM[address];
-  if constexpr ( ENABLE_TRAPS )
+  if constexpr ( Instrumentation::enabled )
   {
     uint8_t filteredByte = mScriptDebugger->executeRAM( *this, address, sourceByte );
     return filteredByte;
@@ -598,24 +1079,19 @@ uint8_t Core::fetchRAM( uint16_t address )
   }
 }
 
+//ROM is always trapped in both variants as boot ROM is emulated with traps
 uint8_t Core::fetchROM( uint16_t address )
 {
   uint8_t sourceByte = mROM[address];
-  if constexpr ( ENABLE_TRAPS )
-  {
-    uint8_t filteredByte = mScriptDebugger->executeROM( *this, address, sourceByte );
-    return filteredByte;
-  }
-  else
-  {
-    return sourceByte;
-  }
+  uint8_t filteredByte = mScriptDebugger->executeROM( *this, address, sourceByte );
+  return filteredByte;
 }
 
+template<typename Instrumentation>
 uint8_t Core::readRAM( uint16_t address )
 {
   uint8_t sourceByte = mRAM[address];
-  if constexpr ( ENABLE_TRAPS )
+  if constexpr ( Instrumentation::enabled )
   {
     uint8_t filteredByte = mScriptDebugger->readRAM( *this, address, sourceByte );
     return filteredByte;
@@ -629,20 +1105,14 @@ uint8_t Core::readRAM( uint16_t address )
 uint8_t Core::readROM( uint16_t address )
 {
   uint8_t sourceByte = mROM[address];
-  if constexpr ( ENABLE_TRAPS )
-  {
-    uint8_t filteredByte = mScriptDebugger->readROM( *this, address, sourceByte );
-    return filteredByte;
-  }
-  else
-  {
-    return sourceByte;
-  }
+  uint8_t filteredByte = mScriptDebugger->readROM( *this, address, sourceByte );
+  return filteredByte;
 }
 
+template<typename Instrumentation>
 void Core::writeRAM( uint16_t address, uint8_t value )
 {
-  if constexpr ( ENABLE_TRAPS )
+  if constexpr ( Instrumentation::enabled )
   {
     uint8_t filteredByte = mScriptDebugger->writeRAM( *this, address, value );
     mRAM[address] = filteredByte;
@@ -653,11 +1123,12 @@ void Core::writeRAM( uint16_t address, uint8_t value )
   }
 }
 
+template<typename Instrumentation>
 uint8_t Core::readMikey( uint16_t address )
 {
   mCurrentTick = mMikey->requestAccess( mCurrentTick, address );
   uint8_t sourceByte = mMikey->read( address );
-  if constexpr ( ENABLE_TRAPS )
+  if constexpr ( Instrumentation::enabled )
   {
     uint8_t filteredByte = mScriptDebugger->readMikey( *this, address, sourceByte );
     return filteredByte;
@@ -668,9 +1139,10 @@ uint8_t Core::readMikey( uint16_t address )
   }
 }
 
+template<typename Instrumentation>
 void Core::writeMikey( uint16_t address, uint8_t value )
 {
-  if constexpr ( ENABLE_TRAPS )
+  if constexpr ( Instrumentation::enabled )
   {
     uint8_t filteredByte = mScriptDebugger->writeMikey( *this, address, value );
     if ( auto mikeyAction = mMikey->write( address, filteredByte ) )
@@ -687,10 +1159,11 @@ void Core::writeMikey( uint16_t address, uint8_t value )
   }
 }
 
+template<typename Instrumentation>
 uint8_t Core::readSuzy( uint16_t address )
 {
   uint8_t sourceByte = mSuzy->read( address );
-  if constexpr ( ENABLE_TRAPS )
+  if constexpr ( Instrumentation::enabled )
   {
     uint8_t filteredByte = mScriptDebugger->readSuzy( *this, address, sourceByte );
     return filteredByte;
@@ -701,9 +1174,10 @@ uint8_t Core::readSuzy( uint16_t address )
   }
 }
 
+template<typename Instrumentation>
 void Core::writeSuzy( uint16_t address, uint8_t value )
 {
-  if constexpr ( ENABLE_TRAPS )
+  if constexpr ( Instrumentation::enabled )
   {
     uint8_t filteredByte = mScriptDebugger->writeSuzy( *this, address, value );
     mSuzy->write( address, filteredByte );
@@ -714,13 +1188,14 @@ void Core::writeSuzy( uint16_t address, uint8_t value )
   }
 }
 
+//RAM below ROM is rarely accessed and always served by the instrumented variant
 uint8_t Core::readROM( uint16_t address, bool isFetch )
 {
   if ( address >= 0x1fa )
   {
     if ( mMapCtl.vectorSpaceDisable )
     {
-      return isFetch ? fetchRAM( address + 0xfe00 ) : readRAM( address + 0xfe00 );
+      return isFetch ? fetchRAM<Instrumented>( address + 0xfe00 ) : readRAM<Instrumented>( address + 0xfe00 );
     }
     else
     {
@@ -731,7 +1206,7 @@ uint8_t Core::readROM( uint16_t address, bool isFetch )
   {
     if ( mMapCtl.romDisable )
     {
-      return isFetch ? fetchRAM( address + 0xfe00 ) : readRAM( address + 0xfe00 );
+      return isFetch ? fetchRAM<Instrumented>( address + 0xfe00 ) : readRAM<Instrumented>( address + 0xfe00 );
     }
     else
     {
@@ -751,7 +1226,7 @@ uint8_t Core::readROM( uint16_t address, bool isFetch )
   else
   {
     //there is always RAM at 0xfff8
-    return isFetch ? fetchRAM( address + 0xfe00 ) : readRAM( address + 0xfe00 );
+    return isFetch ? fetchRAM<Instrumented>( address + 0xfe00 ) : readRAM<Instrumented>( address + 0xfe00 );
   }
 }
 
@@ -759,7 +1234,7 @@ void Core::writeROM( uint16_t address, uint8_t value )
 {
   if ( address >= 0x1fa && mMapCtl.vectorSpaceDisable || address < 0x1f8 && mMapCtl.romDisable || address == 0x1f8 )
   {
-    writeRAM( 0xfe00 + address, value );
+    writeRAM<Instrumented>( 0xfe00 + address, value );
   }
   else if ( address == 0x1f9 )
   {
@@ -784,9 +1259,25 @@ void Core::writeMAPCTL( uint8_t value )
   mMapCtl.suzyDisable = ( value & 0x01 ) != 0;
 
   mFastCycleTick = mMapCtl.sequentialDisable ? 5 : 4;
-  mPageTypes[0xfe] = mMapCtl.romDisable ? PageType::RAM : PageType::ROM;
-  mPageTypes[0xfd] = mMapCtl.mikeyDisable ? PageType::RAM : PageType::MIKEY;
-  mPageTypes[0xfc] = mMapCtl.suzyDisable ? PageType::RAM : PageType::SUZY;
+  mapPages();
+}
+
+void Core::mapPages()
+{
+  auto page = [this]( size_t i, bool ramEnabled, PageType type )
+  {
+    mPages[i] = ramEnabled ? Page{ mRAM.data() + ( i << 8 ), PageType::RAM } : Page{ nullptr, type };
+  };
+
+  for ( size_t i = 0; i < 0xfc; ++i )
+  {
+    page( i, true, PageType::RAM );
+  }
+  page( 0xfc, mMapCtl.suzyDisable, PageType::SUZY );
+  page( 0xfd, mMapCtl.mikeyDisable, PageType::MIKEY );
+  page( 0xfe, mMapCtl.romDisable, PageType::ROM );
+  //there is always RAM at 0xfff8 and MAPCTL at 0xfff9
+  page( 0xff, false, PageType::VECTORS );
 }
 
 uint64_t Core::tick() const
@@ -794,6 +1285,11 @@ uint64_t Core::tick() const
   return mCurrentTick;
 }
 
+uint64_t Core::executedActions() const
+{
+  return mExecutedActions;
+}
+
 uint8_t Core::debugReadRAM( uint16_t address ) const
 {
   return mRAM[address];
@@ -827,7 +1323,7 @@ void Core::debugWriteMikey( uint16_t address, uint8_t value )
 uint8_t Core::debugReadSuzy( uint16_t address ) const
 {
   mSuzy->requestRead( mCurrentTick, address );
-  return mSuzy->read( address );
+  return mSuzy->debugRead( address );
 }
 
 void Core::debugWriteSuzy( uint16_t address, uint8_t value )
@@ -7,9 +7,9 @@
 #include "Utility.hpp"
 #include "ComLynx.hpp"
 #include "ImageCart.hpp"
+#include "CPU.hpp"
 
 class Mikey;
-class CPU;
 class Cartridge;
 class InputFile;
 class ImageBS93;
@@ -21,6 +21,10 @@ class TraceHelper;
 class ScriptDebuggerEscapes;
 class ScriptDebugger;
 class VGMWriter;
+class Rewind;
+class HostProfiler;
+class GuestProfiler;
+class CpuTraceWriter;
 struct CPUState;
 
 class Core
@@ -33,6 +37,41 @@ public:
 
   CpuBreakType advanceAudio( int sps, std::span<AudioSample> outputBuffer, RunMode runMode );
   CpuBreakType run( RunMode runMode );
+  //Runs until given number of frames has started without sampling audio. Timing is identical to advanceAudio.
+  CpuBreakType runFrames( int frames, OutputPolicy outputPolicy );
+
+  //Both engines have identical timing and results. COROUTINE is the default
+  void setCpuEngine( CpuEngine engine );
+
+  //Registers of the CPU are random at power on. Derives them from given seed instead, so that runs are reproducible.
+  //Set it only before the first run
+  void setResetSeed( uint32_t seed );
+
+  //Snapshot of the whole machine into one buffer. Valid only between advanceAudio/run calls.
+  //Fails while Suzy is in the middle of sprite list or a cartridge peripheral is in the middle of a transfer.
+  bool saveState( std::vector<uint8_t> & out );
+  //Restores snapshot taken by saveState on a Core constructed with the same image.
+  //Truncated snapshot or one of another version fails and leaves the Core unchanged
+  bool loadState( std::span<uint8_t const> in );
+
+  //Keeps snapshots of the last given number of frames, taken after advanceAudio/runFrames that started a frame. 0 disables
+  void setRewind( size_t frames );
+  //Drops the latest snapshot and restores the one before it. Rewinding after each emulated frame steps back one frame every time.
+  //False if there is nothing to rewind to or it can't be restored, the history and the Core are then unchanged
+  bool rewindFrame();
+
+  //Video sink shows the machine given number of frames ahead to hide input lag. 0 disables.
+  //On every frame start advanceAudio saves the machine, emulates frames ahead with the current input showing only the last one
+  //and restores the machine. runFrames does it only on its last frame start, so the sink gets just the frame ahead of it.
+  //Frames ahead produce no audio, but they are not isolated from ComLynx and VGM writer.
+  void setRunAhead( int frames );
+
+  //Counts events and times zones of the emulation on the host. Null disables it. Set it only between advanceAudio/run calls
+  void setHostProfiler( std::shared_ptr<HostProfiler> hostProfiler );
+  //Charges emulated cycles to guest code addresses and functions. Runs the instrumented CPU variant. Null disables it
+  void setGuestProfiler( std::shared_ptr<GuestProfiler> guestProfiler );
+  //Records every executed instruction to a binary trace rendered offline by TraceDecoder. Runs the instrumented CPU variant. Null disables it
+  void setCpuTrace( std::shared_ptr<CpuTraceWriter> cpuTrace );
 
   void setLog( std::filesystem::path const & path );
   void setVGMWriter( std::filesystem::path const& path );
@@ -42,6 +81,8 @@ public:
   int64_t globalSamplesEmittedPerFrame() const;
 
   uint64_t tick() const;
+  //number of sequenced actions executed so far
+  uint64_t executedActions() const;
 
   //Not thread safe. Used only for script escapes
   uint8_t debugReadROM( uint16_t address ) const;
@@ -66,10 +107,19 @@ private:
 
   enum class PageType
   {
-    RAM = 0 * 4,
-    SUZY = 1 * 4,
-    MIKEY = 2 * 4,
-    ROM = 3 * 4
+    RAM,
+    SUZY,
+    MIKEY,
+    ROM,
+    //vectors, MAPCTL and RAM at 0xfff8
+    VECTORS
+  };
+
+  //CPU view of one page. Plain RAM is accessed directly through host pointer, other pages are served by a handler of their type
+  struct Page
+  {
+    uint8_t* ram;
+    PageType type;
   };
 
   struct MAPCTL
@@ -81,17 +131,35 @@ private:
     bool suzyDisable;
   };
 
+  template<bool profiled>
+  CpuBreakType runLoop();
   void executeSequencedAction( SequencedAction );
   bool executeSuzyAction();
   CpuBreakType executeCPUAction();
+  template<typename Instrumentation>
+  CpuBreakType serveCPURequest( CPU::Request const& req );
+  template<typename Instrumentation>
+  bool inlineCPUAction( CPU::Request const& req, uint8_t & value );
+  void skipIdleLoop( uint16_t address );
+  template<typename Instrumentation>
+  bool isIdleRead( CPU::Request const& req, PageType pageType ) const;
+  bool inlineSuzyAction( ISuzyProcess::Request const& req, uint32_t & value );
+  bool serveSuzyRequest( ISuzyProcess::Request const& req, uint32_t & value );
   void setROM( std::shared_ptr<ImageROM const> bootROM );
 
+  template<typename Instrumentation>
   uint8_t fetchRAM( uint16_t address );
+  template<typename Instrumentation>
   uint8_t readRAM( uint16_t address );
+  template<typename Instrumentation>
   void writeRAM( uint16_t address, uint8_t value );
+  template<typename Instrumentation>
   uint8_t readMikey( uint16_t address );
+  template<typename Instrumentation>
   void writeMikey( uint16_t address, uint8_t value );
+  template<typename Instrumentation>
   uint8_t readSuzy( uint16_t address );
+  template<typename Instrumentation>
   void writeSuzy( uint16_t address, uint8_t value );
   uint8_t readROM( uint16_t address, bool isFetch );
   uint8_t readROM( uint16_t address );
@@ -100,7 +168,11 @@ private:
 
   void pulseReset( std::optional<uint16_t> resetAddress = std::nullopt );
   void writeMAPCTL( uint8_t value );
-  void enqueueSampling();
+  void mapPages();
+  void scheduleSamples( int sps, size_t count );
+  void emitSamples( std::span<AudioSample> out );
+  void captureRewind();
+  void runAhead();
   void assertInterrupt( int mask, std::optional<uint64_t> tick = std::nullopt );
   void desertInterrupt( int mask, std::optional<uint64_t> tick = std::nullopt );
   void requestDisplayDMA( uint64_t tick, uint16_t address );
@@ -112,23 +184,47 @@ private:
   uint64_t readTiming( uint16_t address );
   uint64_t writeTiming( uint16_t address );
 
+  template<typename Archive>
+  void serialize( Archive & ar );
+
   friend class Mikey;
+  friend class CPU;
+  friend class SuzyProcess;
   friend class Suzy;
   friend class ParallelPort;
 
 private:
+  //Last loop head, i.e. target of a backward jump, and the machine state on its last opcode fetch. See Core::skipIdleLoop
+  struct IdleLoop
+  {
+    CPUState state;
+    uint64_t tick;
+    uint64_t fetchTick;
+    uint64_t executedActions;
+    uint32_t lastAccessPage;
+    int interrupt;
+    uint16_t head;
+    uint16_t lastFetch;
+    //nothing but side effect free reads since the last fetch of the head
+    bool clean;
+  };
+
   std::array<uint8_t, 65536> mRAM;
   std::array<uint8_t, 512> mROM;
-  std::array<PageType, 256> mPageTypes;
+  //rebuilt from MAPCTL by mapPages
+  std::array<Page, 256> mPages;
   std::shared_ptr<ScriptDebugger> mScriptDebugger;
   uint64_t mCurrentTick;
-  int mSamplesRemainder;
+  //samples are taken at ticks of an exact grid starting at the origin, see Core::scheduleSamples
+  uint64_t mSampleOrigin;
+  uint64_t mSampleIndex;
   int mSPS;
-  std::span<AudioSample> mOutputSamples;
-  uint32_t mSamplesEmitted;
+  std::vector<uint64_t> mSampleTicks;
   uint64_t mGlobalSamplesEmitted;
   uint64_t mGlobalSamplesEmittedSnapshot;
   int64_t mGlobalSamplesEmittedPerFrame;
+  int mFramesToRun;
+  uint64_t mExecutedActions;
   ActionQueue mActionQueue;
   std::shared_ptr<TraceHelper> mTraceHelper;
   std::shared_ptr<CPU> mCpu;
@@ -142,9 +238,22 @@ private:
   uint64_t mPatchMagickCodeAccumulator;
   uint32_t mLastAccessPage;
   uint16_t mDMAAddress;
+  std::shared_ptr<Rewind> mRewind;
+  std::vector<uint8_t> mRunAheadState;
+  int mRunAhead;
+  //frame starts of run-ahead until the video sink is unmuted
+  int mRunAheadUnmute;
+  std::shared_ptr<HostProfiler> mHostProfiler;
   std::shared_ptr<ISuzyProcess> mSuzyProcess;
   ISuzyProcess::Request const* mSuzyProcessRequest;
   bool mResetRequestDuringSpriteRendering;
   bool mSuzyRunning;
+  bool mCPURequestPending;
+  bool mInlineSuzy;
   bool mHaltSuzy;
+  //a frame started since the last rewind snapshot
+  bool mRewindCapture;
+  //a frame started and the machine was stopped on the next instruction boundary for run-ahead
+  bool mRunAheadFrame;
+  IdleLoop mIdleLoop;
 };
@@ -0,0 +1,280 @@
+#include "pch.hpp"
+#include "CpuTrace.hpp"
+#include "CPUState.hpp"
+
+namespace
+{
+
+static constexpr std::array<char, 4> MAGIC = { 'F', 'X', 'T', '1' };
+//varint tick delta and mask followed by all payload bytes
+static constexpr size_t MAX_RECORD_SIZE = 10 + 5 + CpuTraceRecord::PAYLOAD_SIZE;
+
+void putSize( std::vector<uint8_t> & out, uint64_t value )
+{
+  while ( value >= 0x80 )
+  {
+    out.push_back( (uint8_t)( value | 0x80 ) );
+    value >>= 7;
+  }
+  out.push_back( (uint8_t)value );
+}
+
+//empty if the data ends before the number
+std::optional<uint64_t> getSize( uint8_t const*& in, uint8_t const* end )
+{
+  uint64_t value{};
+  for ( int shift = 0; in != end && shift < 64; shift += 7 )
+  {
+    uint8_t b = *in++;
+    value |= (uint64_t)( b & 0x7f ) << shift;
+    if ( ( b & 0x80 ) == 0 )
+      return value;
+  }
+  return std::nullopt;
+}
+
+std::optional<uint64_t> getSize( std::istream & in )
+{
+  uint64_t value{};
+  for ( int shift = 0; shift < 64; shift += 7 )
+  {
+    int b = in.get();
+    if ( b == std::char_traits<char>::eof() )
+      return std::nullopt;
+    value |= (uint64_t)( b & 0x7f ) << shift;
+    if ( ( b & 0x80 ) == 0 )
+      return value;
+  }
+  return std::nullopt;
+}
+
+}
+
+CpuTraceRecord CpuTraceRecord::make( CPUState const& before, CPUState const& after, uint64_t tick )
+{
+  return CpuTraceRecord{ tick, before.pc, before.a, before.x, before.y, before.sl, before.getP(), (uint8_t)after.op, after.interrupt, after.m1, after.m2, after.ea, after.fa, after.t };
+}
+
+void CpuTraceRecord::unpack( CPUState & before, CPUState & after ) const
+{
+  before = CPUState{};
+  before.setP( p );
+  before.padding = ' ';
+  before.pc = pc;
+  before.a = a;
+  before.x = x;
+  before.y = y;
+  before.sh = 0x01;
+  before.sl = s;
+  before.op = (Opcode)op;
+
+  after = before;
+  after.interrupt = interrupt;
+  after.m1 = m1;
+  after.m2 = m2;
+  after.ea = ea;
+  after.fa = fa;
+  after.t = t;
+}
+
+//bytes that change most often come first, so that the mask of changed ones stays short
+std::array<uint8_t, CpuTraceRecord::PAYLOAD_SIZE> CpuTraceRecord::payload() const
+{
+  return { op, (uint8_t)pc, (uint8_t)( pc >> 8 ), a, x, y, p, m1, s, (uint8_t)ea, (uint8_t)( ea >> 8 ), (uint8_t)t, (uint8_t)( t >> 8 ), m2, (uint8_t)fa, (uint8_t)( fa >> 8 ), interrupt };
+}
+
+void CpuTraceRecord::setPayload( std::array<uint8_t, PAYLOAD_SIZE> const& payload )
+{
+  op = payload[0];
+  pc = (uint16_t)( payload[1] | ( payload[2] << 8 ) );
+  a = payload[3];
+  x = payload[4];
+  y = payload[5];
+  p = payload[6];
+  m1 = payload[7];
+  s = payload[8];
+  ea = (uint16_t)( payload[9] | ( payload[10] << 8 ) );
+  t = (uint16_t)( payload[11] | ( payload[12] << 8 ) );
+  m2 = payload[13];
+  fa = (uint16_t)( payload[14] | ( payload[15] << 8 ) );
+  interrupt = payload[16];
+}
+
+CpuTraceWriter::CpuTraceWriter( std::filesystem::path const& path ) : mOut{ path, std::ios::binary }, mRing{ std::make_unique<std::array<CpuTraceRecord, RING_SIZE>>() },
+  mHead{}, mTail{}, mTailCache{}, mBlock{}, mMutex{}, mWake{}, mStop{}, mThread{}
+{
+  mOut.write( MAGIC.data(), MAGIC.size() );
+  mThread = std::thread{ [this]
+  {
+    work();
+  } };
+}
+
+CpuTraceWriter::~CpuTraceWriter()
+{
+  {
+    std::scoped_lock<std::mutex> lock{ mMutex };
+    mStop = true;
+  }
+  mWake.notify_one();
+  mThread.join();
+}
+
+bool CpuTraceWriter::good() const
+{
+  return mOut.good();
+}
+
+uint64_t CpuTraceWriter::records() const
+{
+  return mHead.load( std::memory_order_relaxed );
+}
+
+void CpuTraceWriter::waitForRoom( uint64_t head )
+{
+  for ( ;; )
+  {
+    mTailCache = mTail.load( std::memory_order_acquire );
+    if ( head - mTailCache < RING_SIZE )
+      return;
+    mWake.notify_one();
+    std::this_thread::yield();
+  }
+}
+
+void CpuTraceWriter::work()
+{
+  for ( ;; )
+  {
+    bool stop;
+    {
+      //notifications are not synchronized with the emulation thread, so an occasional lost one only delays the writer a bit
+      std::unique_lock<std::mutex> lock{ mMutex };
+      mWake.wait_for( lock, std::chrono::milliseconds{ 10 }, [this]
+      {
+        return mStop || mHead.load( std::memory_order_acquire ) - mTail.load( std::memory_order_relaxed ) >= BLOCK_SIZE;
+      } );
+      stop = mStop;
+    }
+
+    uint64_t const head = mHead.load( std::memory_order_acquire );
+    uint64_t tail = mTail.load( std::memory_order_relaxed );
+    while ( tail < head )
+    {
+      uint64_t end = std::min<uint64_t>( head, tail + BLOCK_SIZE );
+      writeBlock( tail, end );
+      tail = end;
+      mTail.store( tail, std::memory_order_release );
+    }
+
+    if ( stop )
+    {
+      mOut.flush();
+      return;
+    }
+  }
+}
+
+//Block is the number of records and the size of their encoding followed by the encoding of each record:
+//tick delta, mask of payload bytes that differ from the previous record and their XOR.
+//The first record of a block is encoded against zeros, so every block can be decoded on its own.
+void CpuTraceWriter::writeBlock( uint64_t begin, uint64_t end )
+{
+  mBlock.clear();
+  CpuTraceRecord previous{};
+  auto previousPayload = previous.payload();
+
+  for ( uint64_t i = begin; i < end; ++i )
+  {
+    auto const& record = ( *mRing )[i % RING_SIZE];
+    auto payload = record.payload();
+
+    uint32_t mask{};
+    for ( size_t j = 0; j < payload.size(); ++j )
+    {
+      if ( payload[j] != previousPayload[j] )
+        mask |= 1 << j;
+    }
+
+    putSize( mBlock, record.tick - previous.tick );
+    putSize( mBlock, mask );
+    for ( size_t j = 0; j < payload.size(); ++j )
+    {
+      if ( mask & ( 1 << j ) )
+        mBlock.push_back( payload[j] ^ previousPayload[j] );
+    }
+
+    previous = record;
+    previousPayload = payload;
+  }
+
+  std::vector<uint8_t> header;
+  putSize( header, end - begin );
+  putSize( header, mBlock.size() );
+  mOut.write( (char const*)header.data(), header.size() );
+  mOut.write( (char const*)mBlock.data(), mBlock.size() );
+}
+
+CpuTraceReader::CpuTraceReader( std::filesystem::path const& path ) : mIn{ path, std::ios::binary }, mBlock{}, mCursor{}, mRemaining{}, mPrevious{}, mGood{}
+{
+  std::array<char, MAGIC.size()> magic{};
+  mIn.read( magic.data(), magic.size() );
+  mGood = mIn.good() && magic == MAGIC;
+}
+
+bool CpuTraceReader::good() const
+{
+  return mGood;
+}
+
+bool CpuTraceReader::next( CpuTraceRecord & record )
+{
+  if ( mRemaining == 0 && !readBlock() )
+    return false;
+
+  mRemaining -= 1;
+
+  //block of a truncated or corrupt file ends the trace
+  uint8_t const* const end = mBlock.data() + mBlock.size();
+  auto payload = mPrevious.payload();
+  auto tickDelta = getSize( mCursor, end );
+  auto mask = getSize( mCursor, end );
+  if ( !tickDelta || !mask || (size_t)( end - mCursor ) < (size_t)std::popcount( *mask & ( ( 1ull << payload.size() ) - 1 ) ) )
+  {
+    mGood = false;
+    mRemaining = 0;
+    return false;
+  }
+
+  for ( size_t j = 0; j < payload.size(); ++j )
+  {
+    if ( *mask & ( 1ull << j ) )
+      payload[j] ^= *mCursor++;
+  }
+
+  mPrevious.tick += *tickDelta;
+  mPrevious.setPayload( payload );
+  record = mPrevious;
+  return true;
+}
+
+bool CpuTraceReader::readBlock()
+{
+  if ( !mGood )
+    return false;
+
+  auto count = getSize( mIn );
+  auto size = getSize( mIn );
+  if ( !count || !size || *count == 0 || *count > CpuTraceWriter::BLOCK_SIZE || *size > *count * MAX_RECORD_SIZE )
+    return false;
+
+  mBlock.resize( *size );
+  mIn.read( (char*)mBlock.data(), mBlock.size() );
+  if ( !mIn.good() )
+    return false;
+
+  mCursor = mBlock.data();
+  mRemaining = *count;
+  mPrevious = CpuTraceRecord{};
+  return true;
+}
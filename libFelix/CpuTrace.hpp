@@ -0,0 +1,110 @@
+#pragma once
+
+#include "Utility.hpp"
+
+struct CPUState;
+
+//One executed instruction of the binary CPU trace. Holds everything CPU::formatTrace needs to render the line of the text trace
+struct CpuTraceRecord
+{
+  //bytes of the record other than the tick, the way they are delta encoded
+  static constexpr size_t PAYLOAD_SIZE = 17;
+
+  //tick at the end of the instruction
+  uint64_t tick;
+  //registers on the opcode fetch
+  uint16_t pc;
+  uint8_t a;
+  uint8_t x;
+  uint8_t y;
+  uint8_t s;
+  uint8_t p;
+  //the instruction and what it accessed
+  uint8_t op;
+  uint8_t interrupt;
+  uint8_t m1;
+  uint8_t m2;
+  uint16_t ea;
+  uint16_t fa;
+  uint16_t t;
+
+  static CpuTraceRecord make( CPUState const& before, CPUState const& after, uint64_t tick );
+  //states on the opcode fetch and at the end of the instruction as far as the record tells
+  void unpack( CPUState & before, CPUState & after ) const;
+
+  std::array<uint8_t, PAYLOAD_SIZE> payload() const;
+  void setPayload( std::array<uint8_t, PAYLOAD_SIZE> const& payload );
+};
+
+//Binary CPU trace file written while the emulation runs, enabled by Core::setCpuTrace.
+//The emulation thread only copies records to a lock-free ring, a helper thread encodes them and writes them to disk.
+//Records are grouped in blocks, each record is stored as tick delta and XOR of the bytes that differ from the previous one.
+//If the helper thread falls behind by a whole ring the emulation thread waits for it, so no record is lost.
+class CpuTraceWriter : private NonCopyable
+{
+public:
+  static constexpr size_t RING_SIZE = 1 << 16;
+  static constexpr size_t BLOCK_SIZE = 1 << 12;
+
+  explicit CpuTraceWriter( std::filesystem::path const& path );
+  //writes all records pushed so far
+  ~CpuTraceWriter();
+
+  void push( CpuTraceRecord const& record )
+  {
+    uint64_t head = mHead.load( std::memory_order_relaxed );
+    if ( head - mTailCache >= RING_SIZE )
+      waitForRoom( head );
+
+    ( *mRing )[head % RING_SIZE] = record;
+    mHead.store( head + 1, std::memory_order_release );
+
+    if ( ( head + 1 ) % BLOCK_SIZE == 0 )
+      mWake.notify_one();
+  }
+
+  bool good() const;
+  //records pushed so far
+  uint64_t records() const;
+
+private:
+  void waitForRoom( uint64_t head );
+  void work();
+  void writeBlock( uint64_t begin, uint64_t end );
+
+private:
+  std::ofstream mOut;
+  std::unique_ptr<std::array<CpuTraceRecord, RING_SIZE>> mRing;
+  std::atomic<uint64_t> mHead;
+  std::atomic<uint64_t> mTail;
+  //tail last seen by the emulation thread
+  uint64_t mTailCache;
+  std::vector<uint8_t> mBlock;
+  std::mutex mMutex;
+  std::condition_variable mWake;
+  bool mStop;
+  std::thread mThread;
+};
+
+//Reads records of a file written by CpuTraceWriter one by one
+class CpuTraceReader : private NonCopyable
+{
+public:
+  explicit CpuTraceReader( std::filesystem::path const& path );
+
+  //false if the file is not a CPU trace
+  bool good() const;
+  //false at the end of the trace
+  bool next( CpuTraceRecord & record );
+
+private:
+  bool readBlock();
+
+private:
+  std::ifstream mIn;
+  std::vector<uint8_t> mBlock;
+  uint8_t const* mCursor;
+  size_t mRemaining;
+  CpuTraceRecord mPrevious;
+  bool mGood;
+};
@@ -1,10 +1,12 @@
 #include "pch.hpp"
 #include "DisplayGenerator.hpp"
 #include "IVideoSink.hpp"
+#include "HostProfiler.hpp"
 #include "Log.hpp"
+#include "StateArchive.hpp"
 
 DisplayGenerator::DisplayGenerator( std::shared_ptr<IVideoSink> videoSink ) : mDMAData{}, mVideoSink{ std::move( videoSink ) }, mRowStartTick{ std::numeric_limits<uint64_t>::max() }, mDMAIteration{}, mDisplayRow{}, mEmitedScreenBytes{},
-  mDispAdr{}, mDispColor{}, mDispFlip{}, mDMAEnable{}, mDMAOffset{ -1 }
+  mDispAdr{}, mDispColor{}, mDispFlip{}, mDMAEnable{}, mDMAOffset{ -1 }, mFramesToSkip{}, mMuted{}, mHostProfiler{}
 {
   assert( mVideoSink );
 }
@@ -23,13 +25,23 @@ void DisplayGenerator::setPBKUP( uint8_t value )
 }
 
 
-void DisplayGenerator::firstHblank( uint64_t tick, uint8_t hbackup )
+bool DisplayGenerator::firstHblank( uint64_t tick, uint8_t hbackup )
 {
   flushDisplay( tick );
   mEmitedScreenBytes = 0;
   mDMAIteration = 0;
-  mVideoSink->newFrame( tick, hbackup );
   mRowStartTick = std::numeric_limits<uint64_t>::max();
+
+  if ( mMuted )
+    return false;
+
+  bool const skipping = mFramesToSkip > 0;
+  if ( skipping && --mFramesToSkip > 0 )
+    return false;
+
+  HostProfiler::Scope scope{ mHostProfiler, HostProfiler::Zone::VIDEO_SINK };
+  mVideoSink->newFrame( tick, hbackup );
+  return skipping;
 }
 
 DisplayGenerator::DMARequest DisplayGenerator::hblank( uint64_t tick, int row )
@@ -38,7 +50,11 @@ DisplayGenerator::DMARequest DisplayGenerator::hblank( uint64_t tick, int row )
   mEmitedScreenBytes = 0;
   mDMAIteration = 0;
   mDisplayRow = 101 - row;
-  mVideoSink->newRow( tick, row );
+  if ( emitting() )
+  {
+    HostProfiler::Scope scope{ mHostProfiler, HostProfiler::Zone::VIDEO_SINK };
+    mVideoSink->newRow( tick, row );
+  }
   if ( mDisplayRow >= 0 && mDMAOffset >= 0 )
   {
     mRowStartTick = tick + mDMAOffset;
@@ -69,9 +85,25 @@ DisplayGenerator::DMARequest DisplayGenerator::pushData( uint64_t tick, uint64_t
 void DisplayGenerator::updatePalette( uint64_t tick, uint8_t reg, uint8_t value )
 {
   flushDisplay( tick );
-  mVideoSink->updateColorReg( reg, value );
+  if ( emitting() )
+  {
+    HostProfiler::Scope scope{ mHostProfiler, HostProfiler::Zone::VIDEO_SINK };
+    mVideoSink->updateColorReg( reg, value );
+  }
 }
 
+void DisplayGenerator::resendPalette( std::span<uint8_t const, 32> palette )
+{
+  if ( !emitting() )
+    return;
+
+  HostProfiler::Scope scope{ mHostProfiler, HostProfiler::Zone::VIDEO_SINK };
+  for ( size_t i = 0; i < palette.size(); ++i )
+  {
+    mVideoSink->updateColorReg( (uint8_t)i, palette[i] );
+  }
+}
+
 void DisplayGenerator::updateDispAddr( uint64_t tick, uint16_t dispAdr )
 {
   mDispAdr = dispAdr;
@@ -80,8 +112,28 @@ void DisplayGenerator::updateDispAddr( uint64_t tick, uint16_t dispAdr )
 void DisplayGenerator::vblank( uint64_t tick )
 {
   flushDisplay( tick );
+}
+
+void DisplayGenerator::skipFrames( int frames )
+{
+  mFramesToSkip = frames;
 }
 
+void DisplayGenerator::mute( bool muted )
+{
+  mMuted = muted;
+}
+
+void DisplayGenerator::setHostProfiler( HostProfiler * hostProfiler )
+{
+  mHostProfiler = hostProfiler;
+}
+
+bool DisplayGenerator::emitting() const
+{
+  return mFramesToSkip == 0 && !mMuted;
+}
+
 bool DisplayGenerator::flushDisplay( uint64_t tick )
 {
   if ( !mDMAEnable )
@@ -97,7 +149,11 @@ bool DisplayGenerator::flushDisplay( uint64_t tick )
   bool const result = limit == 80 && mEmitedScreenBytes < 80;
   size_t bytesToEmit = limit - mEmitedScreenBytes;
   //NOTICE - pixels are processed in byte pairs, so in this implementation it is not possible to alter color register between nibbles of a screen byte
-  mVideoSink->emitScreenData( std::span<uint8_t const>( lineData + mEmitedScreenBytes, bytesToEmit ) );
+  if ( emitting() )
+  {
+    HostProfiler::Scope scope{ mHostProfiler, HostProfiler::Zone::VIDEO_SINK };
+    mVideoSink->emitScreenData( std::span<uint8_t const>( lineData + mEmitedScreenBytes, bytesToEmit ) );
+  }
   mEmitedScreenBytes = limit;
 
   return result;
@@ -108,3 +164,13 @@ bool DisplayGenerator::rest() const
   return mDisplayRow < 103 && mDisplayRow > 99;
 }
 
+
+template<typename Archive>
+void DisplayGenerator::serialize( Archive & ar )
+{
+  ar( mDMAData, mRowStartTick, mDMAIteration, mDisplayRow, mEmitedScreenBytes, mDispAdr, mDispColor, mDispFlip, mDMAEnable, mDMAOffset );
+}
+
+template void DisplayGenerator::serialize<StateWriter>( StateWriter & );
+template void DisplayGenerator::serialize<StateReader>( StateReader & );
+template void DisplayGenerator::serialize<StateValidator>( StateValidator & );
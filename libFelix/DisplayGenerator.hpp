@@ -4,6 +4,7 @@
 #include "Utility.hpp"
 
 struct IVideoSink;
+class HostProfiler;
 
 class DisplayGenerator : public RestProvider
 {
@@ -28,18 +29,31 @@ public:
   void dispCtl( bool dispColor, bool dispFlip, bool dmaEnable );
   void setPBKUP( uint8_t value );
 
-  void firstHblank( uint64_t tick, uint8_t hbackup );
+  //returns true if video sink missed palette changes in skipped frames and needs the whole palette
+  bool firstHblank( uint64_t tick, uint8_t hbackup );
   DMARequest hblank( uint64_t tick, int row );
   DMARequest pushData( uint64_t tick, uint64_t data );
   void updatePalette( uint64_t tick, uint8_t reg, uint8_t value );
   void updateDispAddr( uint64_t tick, uint16_t dispAdr );
+  //pushes whole palette to the video sink without flushing pending screen data
+  void resendPalette( std::span<uint8_t const, 32> palette );
 
   void vblank( uint64_t tick );
+  //nothing is emitted to the video sink until given number of frames has started
+  void skipFrames( int frames );
+  //nothing is emitted to the video sink while muted
+  void mute( bool muted );
+  //video sink calls are timed by given profiler, null disables it
+  void setHostProfiler( HostProfiler * hostProfiler );
 
   bool rest() const override;
 
+  template<typename Archive>
+  void serialize( Archive & ar );
+
 private:
   bool flushDisplay( uint64_t tick );
+  bool emitting() const;
 
 private:
   std::array<uint64_t,10> mDMAData;
@@ -53,6 +67,9 @@ private:
   bool mDispFlip;
   bool mDMAEnable;
   int mDMAOffset;
+  int mFramesToSkip;
+  bool mMuted;
+  HostProfiler * mHostProfiler;
 
   static constexpr uint64_t DMA_ITERATIONS = 10;
   static constexpr uint64_t TICKS_PER_PIXEL = 12;
@@ -2,6 +2,7 @@
 #include "EEPROM.hpp"
 #include "ImageProperties.hpp"
 #include "TraceHelper.hpp"
+#include "StateArchive.hpp"
 
 EEPROM::EEPROM( std::filesystem::path imagePath, int eeType, bool is16Bit, std::shared_ptr<TraceHelper> traceHelper ) : mEECoroutine{}, mImagePath{ std::move( imagePath ) },
   mTraceHelper{ std::move( traceHelper ) }, mData{}, mOpcodeBits{}, mAddressMask{}, mDataBits{}, mWriteEnable{}, mChanged{ true }
@@ -144,7 +145,7 @@ EEPROM::EECoroutine EEPROM::process()
   for ( int i = 0; i < mOpcodeBits; ++i )
   {
     opcode <<= 1;
-    int bit = co_await io;
+    int bit = co_await input();
     opcode |= bit;
     mTraceHelper->comment<"EEPROM: fetch opcode bit {}={}.">( mOpcodeBits - i - 1, bit );
   }
@@ -166,7 +167,7 @@ EEPROM::EECoroutine EEPROM::process()
       for ( int i = 0; i < dataBits; ++i )
       {
         data <<= 1;
-        int bit = co_await io;
+        int bit = co_await input();
         data |= bit;
       }
       wral( data );
@@ -183,7 +184,7 @@ EEPROM::EECoroutine EEPROM::process()
     for ( int i = 0; i < dataBits; ++i )
     {
       data <<= 1;
-      int bit = co_await io;
+      int bit = co_await input();
       data |= bit;
       mTraceHelper->comment<"EEPROM: fetch data bit {}={}.">( dataBits - i - 1, bit );
     }
@@ -367,3 +368,29 @@ void EEPROM::EECoroutine::promise_type::return_value( std::optional<bool> opt )
   mEE.mTraceHelper->comment< "EEPROM: end." >();
   mEE.io.output = opt;
 }
+
+bool EEPROM::canSaveState() const
+{
+  return !(bool)mEECoroutine;
+}
+
+template<typename Archive>
+void EEPROM::serialize( Archive & ar )
+{
+  size_t const size = mData.size();
+  ar( io.currentTick, io.busyUntil, io.cs, io.input, io.output, mData, mWriteEnable );
+
+  if constexpr ( Archive::LOADING )
+  {
+    //snapshots are never taken during a command
+    mEECoroutine.reset();
+    //image from another cartridge
+    if ( mData.size() != size )
+      mData.resize( size, 0xff );
+    mChanged = true;
+  }
+}
+
+template void EEPROM::serialize<StateWriter>( StateWriter & );
+template void EEPROM::serialize<StateReader>( StateReader & );
+template void EEPROM::serialize<StateValidator>( StateValidator & );
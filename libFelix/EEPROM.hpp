@@ -17,18 +17,17 @@ public:
   void tick( uint64_t tick, bool cs, bool audin );
   std::optional<bool> output( uint64_t tick ) const;
 
+  //false while a command is being shifted in or out
+  bool canSaveState() const;
+  template<typename Archive>
+  void serialize( Archive & ar );
+
 private:
 
   struct NoCS {};
 
   struct IO
   {
-    bool await_ready() { return false; }
-    void await_suspend( std::coroutine_handle<> c ) {}
-    int await_resume()
-    {
-      return input ? 1 : 0;
-    }
     uint64_t currentTick;
     uint64_t busyUntil;
     bool cs;
@@ -36,6 +35,24 @@ private:
     std::optional<bool> output;
   } io;
 
+  //Awaiter only refers to io, see CPU::Awaiter
+  struct IOAwaiter
+  {
+    IO & io;
+
+    bool await_ready() { return false; }
+    void await_suspend( std::coroutine_handle<> c ) {}
+    int await_resume()
+    {
+      return io.input ? 1 : 0;
+    }
+  };
+
+  IOAwaiter input()
+  {
+    return IOAwaiter{ io };
+  }
+
   int read( int address ) const;
   void ewen();
   void erase( int address );
@@ -74,10 +91,10 @@ private:
       {
         return std::suspend_always{};
       }
-      auto& yield_value( int value )
+      auto yield_value( int value )
       {
         mEE.io.output = value;
-        return mEE.io;
+        return mEE.input();
       }
 
     private:
@@ -0,0 +1,223 @@
+#include "pch.hpp"
+#include "FrameRenderer.hpp"
+#include "ScreenRenderingBuffer.hpp"
+#include "Utility.hpp"
+
+#if defined( _M_X64 ) || defined( __SSE2__ )
+#define FELIX_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+
+static_assert( SCREEN_WIDTH % 16 == 0 && SCREEN_HEIGHT % 2 == 0 );
+
+//integer BT.601 limited range coefficients with 8 fractional bits
+constexpr int YR = 66, YG = 129, YB = 25;
+constexpr int UR = -38, UG = -74, UB = 112;
+constexpr int VR = 112, VG = -94, VB = -18;
+
+#ifndef FELIX_SSE2
+
+void convertRowsScalar( FrameRenderer::Pixel const* row0, FrameRenderer::Pixel const* row1, uint8_t* y0, uint8_t* y1, uint8_t* u, uint8_t* v )
+{
+  for ( int x = 0; x < SCREEN_WIDTH; ++x )
+  {
+    y0[x] = (uint8_t)( ( ( YR * row0[x].r + YG * row0[x].g + YB * row0[x].b + 128 ) >> 8 ) + 16 );
+    y1[x] = (uint8_t)( ( ( YR * row1[x].r + YG * row1[x].g + YB * row1[x].b + 128 ) >> 8 ) + 16 );
+  }
+
+  for ( int x = 0; x < SCREEN_WIDTH / 2; ++x )
+  {
+    auto const* p0 = row0 + 2 * x;
+    auto const* p1 = row1 + 2 * x;
+    int r = ( p0[0].r + p0[1].r + p1[0].r + p1[1].r + 2 ) >> 2;
+    int g = ( p0[0].g + p0[1].g + p1[0].g + p1[1].g + 2 ) >> 2;
+    int b = ( p0[0].b + p0[1].b + p1[0].b + p1[1].b + 2 ) >> 2;
+    u[x] = (uint8_t)( ( ( UR * r + UG * g + UB * b + 128 ) >> 8 ) + 128 );
+    v[x] = (uint8_t)( ( ( VR * r + VG * g + VB * b + 128 ) >> 8 ) + 128 );
+  }
+}
+
+#else
+
+//extracts one channel of 8 pixels to 16 bit lanes
+template<int SHIFT>
+__m128i channel( __m128i lo, __m128i hi )
+{
+  __m128i const mask = _mm_set1_epi32( 0xff );
+  return _mm_packs_epi32( _mm_and_si128( _mm_srli_epi32( lo, SHIFT ), mask ), _mm_and_si128( _mm_srli_epi32( hi, SHIFT ), mask ) );
+}
+
+__m128i lumaOf8( FrameRenderer::Pixel const* src )
+{
+  __m128i lo = _mm_loadu_si128( (__m128i const*)src );
+  __m128i hi = _mm_loadu_si128( (__m128i const*)( src + 4 ) );
+
+  //maximal sum fits unsigned 16 bits
+  __m128i sum = _mm_add_epi16( _mm_add_epi16(
+    _mm_mullo_epi16( channel<0>( lo, hi ), _mm_set1_epi16( YR ) ),
+    _mm_mullo_epi16( channel<8>( lo, hi ), _mm_set1_epi16( YG ) ) ),
+    _mm_add_epi16( _mm_mullo_epi16( channel<16>( lo, hi ), _mm_set1_epi16( YB ) ), _mm_set1_epi16( 128 ) ) );
+
+  return _mm_add_epi16( _mm_srli_epi16( sum, 8 ), _mm_set1_epi16( 16 ) );
+}
+
+//sums of 2x2 blocks of 8x2 pixels in 4 lanes
+template<int SHIFT>
+__m128i blockSums( FrameRenderer::Pixel const* row0, FrameRenderer::Pixel const* row1 )
+{
+  __m128i sum = _mm_add_epi16(
+    channel<SHIFT>( _mm_loadu_si128( (__m128i const*)row0 ), _mm_loadu_si128( (__m128i const*)( row0 + 4 ) ) ),
+    channel<SHIFT>( _mm_loadu_si128( (__m128i const*)row1 ), _mm_loadu_si128( (__m128i const*)( row1 + 4 ) ) ) );
+  return _mm_madd_epi16( sum, _mm_set1_epi16( 1 ) );
+}
+
+//averages of 2x2 blocks of 16x2 pixels in 8 lanes
+template<int SHIFT>
+__m128i blockAverages( FrameRenderer::Pixel const* row0, FrameRenderer::Pixel const* row1 )
+{
+  __m128i sums = _mm_packs_epi32( blockSums<SHIFT>( row0, row1 ), blockSums<SHIFT>( row0 + 8, row1 + 8 ) );
+  return _mm_srli_epi16( _mm_add_epi16( sums, _mm_set1_epi16( 2 ) ), 2 );
+}
+
+__m128i chroma( __m128i r, __m128i g, __m128i b, int cr, int cg, int cb )
+{
+  __m128i sum = _mm_add_epi16( _mm_add_epi16(
+    _mm_mullo_epi16( r, _mm_set1_epi16( (int16_t)cr ) ),
+    _mm_mullo_epi16( g, _mm_set1_epi16( (int16_t)cg ) ) ),
+    _mm_add_epi16( _mm_mullo_epi16( b, _mm_set1_epi16( (int16_t)cb ) ), _mm_set1_epi16( 128 ) ) );
+
+  return _mm_add_epi16( _mm_srai_epi16( sum, 8 ), _mm_set1_epi16( 128 ) );
+}
+
+void convertRowsSSE2( FrameRenderer::Pixel const* row0, FrameRenderer::Pixel const* row1, uint8_t* y0, uint8_t* y1, uint8_t* u, uint8_t* v )
+{
+  for ( int x = 0; x < SCREEN_WIDTH; x += 16 )
+  {
+    _mm_storeu_si128( (__m128i*)( y0 + x ), _mm_packus_epi16( lumaOf8( row0 + x ), lumaOf8( row0 + x + 8 ) ) );
+    _mm_storeu_si128( (__m128i*)( y1 + x ), _mm_packus_epi16( lumaOf8( row1 + x ), lumaOf8( row1 + x + 8 ) ) );
+
+    __m128i r = blockAverages<0>( row0 + x, row1 + x );
+    __m128i g = blockAverages<8>( row0 + x, row1 + x );
+    __m128i b = blockAverages<16>( row0 + x, row1 + x );
+
+    __m128i uv = _mm_packus_epi16( chroma( r, g, b, UR, UG, UB ), chroma( r, g, b, VR, VG, VB ) );
+    _mm_storel_epi64( (__m128i*)( u + x / 2 ), uv );
+    _mm_storel_epi64( (__m128i*)( v + x / 2 ), _mm_srli_si128( uv, 8 ) );
+  }
+}
+
+#endif
+
+}
+
+FrameRenderer::FrameRenderer() : mPalette{}, mRGBA{}
+{
+  for ( uint32_t i = 0; i < 256; ++i )
+  {
+    mPalette[i] = DPixel{ Pixel{ 0, 0, 0, 255 }, Pixel{ 0, 0, 0, 255 } };
+  }
+}
+
+void FrameRenderer::updatePalette( uint8_t reg, uint8_t value )
+{
+  uint32_t regLo = reg & 0x0f;
+  uint32_t regHi = regLo << 4;
+
+  if ( reg < 16 )
+  {
+    //green
+    uint8_t g = ( value << 4 ) | ( value & 0x0f );
+
+    for ( uint32_t i = regHi; i < regHi + 16; ++i )
+    {
+      mPalette[i].left.g = g;
+    }
+    for ( uint32_t i = regLo; i < 256; i += 16 )
+    {
+      mPalette[i].right.g = g;
+    }
+  }
+  else
+  {
+    //blue
+    uint8_t b = ( value >> 4 ) | ( value & 0xf0 );
+    //red
+    uint8_t r = ( value << 4 ) | ( value & 0x0f );
+
+    for ( uint32_t i = regHi; i < regHi + 16; ++i )
+    {
+      mPalette[i].left.b = b;
+      mPalette[i].left.r = r;
+    }
+    for ( uint32_t i = regLo; i < 256; i += 16 )
+    {
+      mPalette[i].right.b = b;
+      mPalette[i].right.r = r;
+    }
+  }
+}
+
+void FrameRenderer::renderRGBA( ScreenRenderingBuffer const& frame, std::span<Pixel> dst )
+{
+  assert( dst.size() >= SCREEN_WIDTH * SCREEN_HEIGHT );
+
+  for ( int i = 0; i < (int)ScreenRenderingBuffer::ROWS_COUNT; ++i )
+  {
+    auto const& row = frame.row( i );
+    int size = frame.size( i );
+    //rows above visible area are drawn over by the first visible one, as in WinFelix renderers
+    Pixel* out = dst.data() + std::max( 0, ( i - 3 ) ) * SCREEN_WIDTH;
+    Pixel* end = out + SCREEN_WIDTH;
+
+    for ( int j = 0; j < size; ++j )
+    {
+      uint16_t v = row[j];
+      if ( std::bit_cast<int16_t>( v ) < 0 )
+      {
+        if ( out != end )
+        {
+          std::memcpy( out, &mPalette[(uint8_t)v], sizeof( DPixel ) );
+          out += 2;
+        }
+      }
+      else
+      {
+        updatePalette( (uint8_t)( v >> 8 ), (uint8_t)v );
+      }
+    }
+  }
+}
+
+void FrameRenderer::renderYUV420( ScreenRenderingBuffer const& frame, YUV420 dst )
+{
+  mRGBA.resize( SCREEN_WIDTH * SCREEN_HEIGHT );
+  renderRGBA( frame, mRGBA );
+  convertYUV420( mRGBA, dst );
+}
+
+void FrameRenderer::convertYUV420( std::span<Pixel const> src, YUV420 dst )
+{
+  assert( src.size() >= SCREEN_WIDTH * SCREEN_HEIGHT );
+  assert( dst.y.size() >= SCREEN_WIDTH * SCREEN_HEIGHT );
+  assert( dst.u.size() >= SCREEN_WIDTH * SCREEN_HEIGHT / 4 );
+  assert( dst.v.size() >= SCREEN_WIDTH * SCREEN_HEIGHT / 4 );
+
+  for ( int y = 0; y < SCREEN_HEIGHT; y += 2 )
+  {
+    auto const* row0 = src.data() + y * SCREEN_WIDTH;
+    auto const* row1 = row0 + SCREEN_WIDTH;
+    auto* y0 = dst.y.data() + y * SCREEN_WIDTH;
+    auto* y1 = y0 + SCREEN_WIDTH;
+    auto* u = dst.u.data() + y / 2 * SCREEN_WIDTH / 2;
+    auto* v = dst.v.data() + y / 2 * SCREEN_WIDTH / 2;
+
+#ifdef FELIX_SSE2
+    convertRowsSSE2( row0, row1, y0, y1, u, v );
+#else
+    convertRowsScalar( row0, row1, y0, y1, u, v );
+#endif
+  }
+}
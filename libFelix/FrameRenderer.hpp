@@ -0,0 +1,48 @@
+#pragma once
+
+class ScreenRenderingBuffer;
+
+//CPU counterpart of the renderers in WinFelix for headless use and encoding.
+//Converts ScreenRenderingBuffer to SCREEN_WIDTH x SCREEN_HEIGHT image applying palette changes recorded in rows.
+//Palette persists between frames like in VideoSink.
+class FrameRenderer
+{
+public:
+  struct Pixel
+  {
+    uint8_t r;
+    uint8_t g;
+    uint8_t b;
+    uint8_t a;
+  };
+
+  struct YUV420
+  {
+    std::span<uint8_t> y;
+    std::span<uint8_t> u;
+    std::span<uint8_t> v;
+  };
+
+  FrameRenderer();
+
+  void updatePalette( uint8_t reg, uint8_t value );
+
+  //dst holds at least SCREEN_WIDTH * SCREEN_HEIGHT pixels
+  void renderRGBA( ScreenRenderingBuffer const& frame, std::span<Pixel> dst );
+  //y holds SCREEN_WIDTH * SCREEN_HEIGHT samples, u and v a quarter of that each
+  void renderYUV420( ScreenRenderingBuffer const& frame, YUV420 dst );
+
+  //BT.601 limited range, chroma averaged over 2x2 pixels
+  static void convertYUV420( std::span<Pixel const> src, YUV420 dst );
+
+private:
+  //one screen byte is two pixels
+  struct DPixel
+  {
+    Pixel left;
+    Pixel right;
+  };
+
+  std::array<DPixel, 256> mPalette;
+  std::vector<Pixel> mRGBA;
+};
@@ -52,44 +52,51 @@ private:
 
   struct Buffer
   {
-    bool await_ready() { return false; }
-    void await_suspend( std::coroutine_handle<> c ) {}
-    void await_resume() {}
     uint8_t value;
     bool ready;
   } mBuffer;
 
-  auto& getByte()
+  //Awaiters only refer to the buffer, see CPU::Awaiter
+  struct Awaiter
+  {
+    Buffer & buffer;
+
+    bool await_ready() { return false; }
+    void await_suspend( std::coroutine_handle<> c ) {}
+    void await_resume() {}
+  };
+
+  auto getByte()
   {
-    struct GetByte : public Buffer
+    struct GetByte : public Awaiter
     {
-      uint8_t await_resume() { return value; }
+      uint8_t await_resume() { return buffer.value; }
     };
     mReadTick = std::nullopt;
     mBuffer.ready = true;
-    return static_cast<GetByte&>( mBuffer );
+    return GetByte{ { mBuffer } };
   }
 
-  auto& putResult( FRESULT value, uint64_t latency = 0 )
+  auto putResult( FRESULT value, uint64_t latency = 0 )
   {
-    struct PutResult : public Buffer
+    struct PutResult : public Awaiter
     {
     };
     mLastTick += latency;
     mReadTick = mLastTick;
     mBuffer.value = (uint8_t)value;
-    return static_cast<PutResult&>( mBuffer );
+    return PutResult{ { mBuffer } };
   }
 
-  auto& putByte( uint8_t value, uint64_t latency = 0 )
+  auto putByte( uint8_t value, uint64_t latency = 0 )
   {
-    struct PutByte : public Buffer
+    struct PutByte : public Awaiter
     {
     };
     mLastTick += latency;
     mReadTick = mLastTick;
     mBuffer.value = value;
-    return static_cast<PutByte&>( mBuffer );
+    return PutByte{ { mBuffer } };
   }
 
   struct GDCoroutine : private NonCopyable
@@ -0,0 +1,137 @@
+#include "pch.hpp"
+#include "GuestProfiler.hpp"
+#include "CPUState.hpp"
+
+GuestProfiler::GuestProfiler() : mCycles( 65536 ), mSelf{}, mCalls{}, mStack{}, mLastTick{}, mTotal{}, mRoot{ NO_FUNCTION }
+{
+}
+
+GuestProfiler::~GuestProfiler()
+{
+}
+
+void GuestProfiler::instruction( CPUState const& before, CPUState const& after, uint64_t tick )
+{
+  uint64_t const cycles = mLastTick && tick > *mLastTick ? tick - *mLastTick : 0;
+  mLastTick = tick;
+
+  if ( mRoot == NO_FUNCTION )
+    mRoot = before.pc;
+
+  uint32_t const function = mStack.empty() ? mRoot : mStack.back().function;
+  mCycles[before.pc] += cycles;
+  mSelf[( function << 16 ) | before.pc] += cycles;
+  mTotal += cycles;
+
+  switch ( after.op )
+  {
+  case Opcode::JSA_JSR:
+    call( before.pc, after.pc, after.s, tick );
+    break;
+  case Opcode::BRK_BRK:
+    //reset starts everything over, BRK may be ignored and then it pushes nothing
+    if ( ( after.interrupt & CPUState::I_RESET ) != 0 )
+    {
+      mStack.clear();
+      mRoot = after.pc;
+    }
+    else if ( (uint8_t)( before.sl - after.sl ) == 3 )
+    {
+      call( before.pc, after.pc, after.s, tick );
+    }
+    break;
+  case Opcode::RTS_RTS:
+  case Opcode::RTI_RTI:
+    ret( after.s, tick );
+    break;
+  default:
+    break;
+  }
+}
+
+void GuestProfiler::call( uint16_t callSite, uint16_t function, uint16_t s, uint64_t tick )
+{
+  if ( mStack.size() == MAX_DEPTH )
+    mStack.erase( mStack.begin() );
+
+  auto & call = mCalls[( (uint32_t)callSite << 16 ) | function];
+  if ( call.count++ == 0 )
+  {
+    call.caller = (uint16_t)( mStack.empty() ? mRoot : mStack.back().function );
+    call.callSite = callSite;
+    call.callee = function;
+  }
+
+  mStack.push_back( Frame{ tick, function, callSite, s } );
+}
+
+//return leaves every frame entered below the restored stack pointer
+void GuestProfiler::ret( uint16_t s, uint64_t tick )
+{
+  while ( !mStack.empty() && mStack.back().s < s )
+  {
+    auto const& frame = mStack.back();
+    mCalls[( (uint32_t)frame.callSite << 16 ) | frame.function].inclusive += tick - frame.tick;
+    mStack.pop_back();
+  }
+}
+
+uint64_t GuestProfiler::cycles( uint16_t address ) const
+{
+  return mCycles[address];
+}
+
+uint64_t GuestProfiler::total() const
+{
+  return mTotal;
+}
+
+void GuestProfiler::writeCallgrind( std::ostream & out, Namer const& namer ) const
+{
+  auto name = [&]( uint32_t function )
+  {
+    std::string result = namer ? namer( (uint16_t)function ) : std::string{};
+    return result.empty() ? fmt::format( "${:04x}", function ) : result;
+  };
+
+  //calls still in progress are counted up to now
+  auto calls = mCalls;
+  for ( auto const& frame : mStack )
+  {
+    calls[( (uint32_t)frame.callSite << 16 ) | frame.function].inclusive += mLastTick.value_or( frame.tick ) - frame.tick;
+  }
+
+  //addresses with their self ticks in every function that ran them
+  std::map<uint32_t, std::map<uint16_t, uint64_t>> functions;
+  for ( auto const& [key, cycles] : mSelf )
+  {
+    if ( cycles != 0 )
+      functions[key >> 16][(uint16_t)key] = cycles;
+  }
+
+  std::multimap<uint32_t, Call const*> callsByCaller;
+  for ( auto const& [key, call] : calls )
+  {
+    functions[call.caller];
+    callsByCaller.insert( { call.caller, &call } );
+  }
+
+  out << "# callgrind format\nversion: 1\ncreator: Felix\npositions: instr\nevents: Ticks\n";
+  out << fmt::format( "summary: {}\n", mTotal );
+
+  for ( auto const& [function, addresses] : functions )
+  {
+    out << fmt::format( "\nfn={}\n", name( function ) );
+    for ( auto const& [address, cycles] : addresses )
+    {
+      out << fmt::format( "0x{:04x} {}\n", address, cycles );
+    }
+
+    auto [begin, end] = callsByCaller.equal_range( function );
+    for ( auto it = begin; it != end; ++it )
+    {
+      auto const& call = *it->second;
+      out << fmt::format( "cfn={}\ncalls={} 0x{:04x}\n0x{:04x} {}\n", name( call.callee ), call.count, call.callee, call.callSite, call.inclusive );
+    }
+  }
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include "Utility.hpp"
+#include <unordered_map>
+
+struct CPUState;
+
+//Emulated cycles spent by the guest code, enabled by Core::setGuestProfiler.
+//Ticks of every instruction, counted from the end of the previous one, are charged to its address and to the function it runs in.
+//Functions are entered by JSR, BRK and interrupts and left by RTS and RTI, tracked on a shadow stack by the stack pointer,
+//so code that drops return addresses or jumps out of a function leaves the right frames.
+//Code shared by several functions, e.g. a common tail reached by JMP, is charged to each of them for the ticks it ran in it.
+//Ticks must not go back, i.e. loading a snapshot while profiling distorts results.
+class GuestProfiler : private NonCopyable
+{
+public:
+  //names function entry address, e.g. from a .lab file
+  using Namer = std::function<std::string( uint16_t address )>;
+
+  GuestProfiler();
+  ~GuestProfiler();
+
+  //called by CPU at the end of every instruction with the state on its fetch and now
+  void instruction( CPUState const& before, CPUState const& after, uint64_t tick );
+
+  uint64_t cycles( uint16_t address ) const;
+  uint64_t total() const;
+
+  //KCachegrind readable profile with positions being instruction addresses. Functions without a name get their address
+  void writeCallgrind( std::ostream & out, Namer const& namer = {} ) const;
+
+private:
+  struct Frame
+  {
+    uint64_t tick;
+    uint16_t function;
+    uint16_t callSite;
+    //stack pointer in the function
+    uint16_t s;
+  };
+
+  struct Call
+  {
+    uint64_t count;
+    uint64_t inclusive;
+    uint16_t caller;
+    uint16_t callSite;
+    uint16_t callee;
+  };
+
+  void call( uint16_t callSite, uint16_t function, uint16_t s, uint64_t tick );
+  void ret( uint16_t s, uint64_t tick );
+
+private:
+  static constexpr uint32_t NO_FUNCTION = 0x10000;
+  static constexpr size_t MAX_DEPTH = 256;
+
+  std::vector<uint64_t> mCycles;
+  //self ticks keyed by function and address
+  std::unordered_map<uint32_t, uint64_t> mSelf;
+  //keyed by call site and callee
+  std::unordered_map<uint32_t, Call> mCalls;
+  std::vector<Frame> mStack;
+  std::optional<uint64_t> mLastTick;
+  uint64_t mTotal;
+  uint32_t mRoot;
+};
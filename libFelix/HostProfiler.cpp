@@ -0,0 +1,267 @@
+#include "pch.hpp"
+#include "HostProfiler.hpp"
+#include "Suzy.hpp"
+
+namespace
+{
+
+static_assert( HostProfiler::SUZY_REQUEST_TYPES == ISuzyProcess::Request::XOR + 1 );
+
+char const* suzyRequestName( int type )
+{
+  switch ( type )
+  {
+  case ISuzyProcess::Request::FINISH:
+    return "FINISH";
+  case ISuzyProcess::Request::FETCHSCB:
+    return "FETCHSCB";
+  case ISuzyProcess::Request::READ:
+    return "READ";
+  case ISuzyProcess::Request::READ4:
+    return "READ4";
+  case ISuzyProcess::Request::READPAL:
+    return "READPAL";
+  case ISuzyProcess::Request::WRITE:
+    return "WRITE";
+  case ISuzyProcess::Request::WRITEFRED:
+    return "WRITEFRED";
+  case ISuzyProcess::Request::COLRMW:
+    return "COLRMW";
+  case ISuzyProcess::Request::VIDRMW:
+    return "VIDRMW";
+  default:
+    return "XOR";
+  }
+}
+
+char const* actionName( Action action )
+{
+  switch ( action )
+  {
+  case Action::DISPLAY_DMA:
+    return "DISPLAY_DMA";
+  case Action::FIRE_TIMER0:
+    return "FIRE_TIMER0";
+  case Action::FIRE_TIMER1:
+    return "FIRE_TIMER1";
+  case Action::FIRE_TIMER2:
+    return "FIRE_TIMER2";
+  case Action::FIRE_TIMER3:
+    return "FIRE_TIMER3";
+  case Action::FIRE_TIMER4:
+    return "FIRE_TIMER4";
+  case Action::FIRE_TIMER5:
+    return "FIRE_TIMER5";
+  case Action::FIRE_TIMER6:
+    return "FIRE_TIMER6";
+  case Action::FIRE_TIMER7:
+    return "FIRE_TIMER7";
+  case Action::FIRE_TIMER8:
+    return "FIRE_TIMER8";
+  case Action::FIRE_TIMER9:
+    return "FIRE_TIMER9";
+  case Action::FIRE_TIMERA:
+    return "FIRE_TIMERA";
+  case Action::FIRE_TIMERB:
+    return "FIRE_TIMERB";
+  case Action::FIRE_TIMERC:
+    return "FIRE_TIMERC";
+  case Action::ASSERT_IRQ:
+    return "ASSERT_IRQ";
+  case Action::ASSERT_RESET:
+    return "ASSERT_RESET";
+  case Action::DESERT_IRQ:
+    return "DESERT_IRQ";
+  case Action::DESERT_RESET:
+    return "DESERT_RESET";
+  case Action::BATCH_END:
+    return "BATCH_END";
+  default:
+    return nullptr;
+  }
+}
+
+}
+
+HostProfiler::HostProfiler() : mStart{ std::chrono::steady_clock::now() }, mActions{}, mSuzyRequests{}, mTraps{}, mZoneTimes{}, mZoneCounts{},
+  mTrace{ std::make_unique<std::array<TraceEvent, TRACE_SIZE>>() }, mTraceHead{}, mEntered{}, mEnteredTime{}, mFrameBegin{}
+{
+}
+
+uint64_t HostProfiler::now() const
+{
+  return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now() - mStart ).count();
+}
+
+void HostProfiler::zone( Zone zone, uint64_t begin, uint64_t end )
+{
+  bump( mZoneTimes[(size_t)zone], end - begin );
+  bump( mZoneCounts[(size_t)zone] );
+
+  if ( zone >= Zone::CPU )
+    return;
+
+  uint64_t head = mTraceHead.load( std::memory_order_relaxed );
+  //reader that sees any of the slot being overwritten sees the head of the previous event too
+  std::atomic_thread_fence( std::memory_order_release );
+  auto & event = ( *mTrace )[head % TRACE_SIZE];
+  event.begin.store( begin, std::memory_order_relaxed );
+  event.end.store( end, std::memory_order_relaxed );
+  event.zone.store( (uint32_t)zone, std::memory_order_relaxed );
+  mTraceHead.store( head + 1, std::memory_order_release );
+}
+
+void HostProfiler::enter( Zone zone )
+{
+  if ( mEntered == zone )
+    return;
+
+  uint64_t time = now();
+  if ( mEntered )
+    this->zone( *mEntered, mEnteredTime, time );
+
+  mEntered = zone;
+  mEnteredTime = time;
+}
+
+void HostProfiler::leave()
+{
+  if ( mEntered )
+    zone( *mEntered, mEnteredTime, now() );
+  mEntered.reset();
+}
+
+void HostProfiler::frame()
+{
+  uint64_t time = now();
+  if ( mFrameBegin )
+    zone( Zone::FRAME, *mFrameBegin, time );
+  mFrameBegin = time;
+}
+
+uint64_t HostProfiler::actions( Action action ) const
+{
+  return mActions[(size_t)action].load( std::memory_order_relaxed );
+}
+
+uint64_t HostProfiler::suzyRequests( int type ) const
+{
+  return mSuzyRequests[type].load( std::memory_order_relaxed );
+}
+
+uint64_t HostProfiler::traps() const
+{
+  return mTraps.load( std::memory_order_relaxed );
+}
+
+uint64_t HostProfiler::zoneTime( Zone zone ) const
+{
+  return mZoneTimes[(size_t)zone].load( std::memory_order_relaxed );
+}
+
+uint64_t HostProfiler::zoneCount( Zone zone ) const
+{
+  return mZoneCounts[(size_t)zone].load( std::memory_order_relaxed );
+}
+
+void HostProfiler::writeChromeTrace( std::ostream & out ) const
+{
+  struct Event
+  {
+    uint64_t index;
+    uint64_t begin;
+    uint64_t end;
+    uint32_t zone;
+  };
+
+  std::vector<Event> events;
+  uint64_t head = mTraceHead.load( std::memory_order_acquire );
+  for ( uint64_t i = head > TRACE_SIZE ? head - TRACE_SIZE : 0; i < head; ++i )
+  {
+    auto const& event = ( *mTrace )[i % TRACE_SIZE];
+    events.push_back( Event{ i, event.begin.load( std::memory_order_relaxed ), event.end.load( std::memory_order_relaxed ), event.zone.load( std::memory_order_relaxed ) } );
+  }
+
+  //events overwritten by the writer in the meantime are dropped, including the one that may be written right now.
+  //Fence keeps the loads of the events before the head is read again, as in a seqlock reader
+  std::atomic_thread_fence( std::memory_order_acquire );
+  head = mTraceHead.load( std::memory_order_relaxed );
+  std::erase_if( events, [&]( Event const& event )
+  {
+    return event.index + TRACE_SIZE <= head;
+  } );
+
+  uint64_t const end = now();
+  bool first = true;
+  auto separator = [&]
+  {
+    return std::exchange( first, false ) ? "\n" : ",\n";
+  };
+
+  out << "{\"traceEvents\":[";
+  out << separator() << R"({"name":"process_name","ph":"M","pid":1,"tid":1,"args":{"name":"Felix"}})";
+
+  for ( auto const& event : events )
+  {
+    out << separator() << fmt::format( R"({{"name":"{}","cat":"felix","ph":"X","pid":1,"tid":1,"ts":{:.3f},"dur":{:.3f}}})",
+      name( (Zone)event.zone ), event.begin / 1000.0, ( event.end - event.begin ) / 1000.0 );
+  }
+
+  auto counter = [&]( char const* counterName, auto const& args )
+  {
+    out << separator() << fmt::format( R"({{"name":"{}","cat":"felix","ph":"C","pid":1,"tid":1,"ts":{:.3f},"args":{{{}}}}})", counterName, end / 1000.0, args );
+  };
+
+  std::string args;
+  for ( size_t i = 0; i < mActions.size(); ++i )
+  {
+    if ( auto label = actionName( (Action)i ) )
+      args += fmt::format( R"({}"{}":{})", args.empty() ? "" : ",", label, actions( (Action)i ) );
+  }
+  counter( "actions", args );
+
+  args.clear();
+  for ( size_t i = 0; i < mSuzyRequests.size(); ++i )
+  {
+    args += fmt::format( R"({}"{}":{})", args.empty() ? "" : ",", suzyRequestName( (int)i ), suzyRequests( (int)i ) );
+  }
+  counter( "suzy requests", args );
+
+  counter( "traps", fmt::format( R"("traps":{})", traps() ) );
+
+  args.clear();
+  for ( size_t i = 0; i < mZoneTimes.size(); ++i )
+  {
+    args += fmt::format( R"({}"{}":{:.3f})", args.empty() ? "" : ",", name( (Zone)i ), zoneTime( (Zone)i ) / 1e6 );
+  }
+  counter( "zone ms", args );
+
+  out << "\n],\"displayTimeUnit\":\"ms\"}\n";
+}
+
+char const* HostProfiler::name( Zone zone )
+{
+  switch ( zone )
+  {
+  case Zone::RUN:
+    return "run";
+  case Zone::FRAME:
+    return "frame";
+  case Zone::SAVE_STATE:
+    return "save state";
+  case Zone::LOAD_STATE:
+    return "load state";
+  case Zone::RUN_AHEAD:
+    return "run ahead";
+  case Zone::REWIND:
+    return "rewind";
+  case Zone::CPU:
+    return "cpu";
+  case Zone::SUZY:
+    return "suzy";
+  case Zone::ACTIONS:
+    return "actions";
+  default:
+    return "video sink";
+  }
+}
@@ -0,0 +1,119 @@
+#pragma once
+
+#include "ActionQueue.hpp"
+#include "Utility.hpp"
+
+//Host time and event counts of one Core, enabled by Core::setHostProfiler.
+//Only the emulation thread writes, every counter can be read at any time from another thread without locking.
+//Core::run spent in CPU, Suzy and sequenced actions is summed up in zones switched on the fly.
+//Coarse zones like runs, frames or save states are also recorded in a ring that is exported as Chrome trace_event JSON.
+//Without a profiler set Core pays one branch per run, Suzy request and video sink call.
+class HostProfiler : private NonCopyable
+{
+public:
+  enum class Zone
+  {
+    RUN,
+    FRAME,
+    SAVE_STATE,
+    LOAD_STATE,
+    RUN_AHEAD,
+    REWIND,
+    //zones below are only summed up, they are too frequent to be traced
+    CPU,
+    SUZY,
+    ACTIONS,
+    VIDEO_SINK,
+    ZONES_END_
+  };
+
+  static constexpr size_t SUZY_REQUEST_TYPES = 10;
+  static constexpr size_t TRACE_SIZE = 1 << 16;
+
+  //times a zone given profiler, null disables it
+  class Scope : private NonCopyable
+  {
+  public:
+    Scope( HostProfiler * profiler, Zone zone ) : mProfiler{ profiler }, mZone{ zone }, mBegin{ profiler ? profiler->now() : 0 }
+    {
+    }
+
+    ~Scope()
+    {
+      if ( mProfiler )
+        mProfiler->zone( mZone, mBegin, mProfiler->now() );
+    }
+
+  private:
+    HostProfiler * mProfiler;
+    Zone mZone;
+    uint64_t mBegin;
+  };
+
+  HostProfiler();
+
+  void action( Action action )
+  {
+    bump( mActions[(size_t)action] );
+  }
+
+  void suzyRequest( int type )
+  {
+    bump( mSuzyRequests[type] );
+  }
+
+  void trap()
+  {
+    bump( mTraps );
+  }
+
+  //nanoseconds since construction
+  uint64_t now() const;
+  void zone( Zone zone, uint64_t begin, uint64_t end );
+  //summed up zone that lasts until the next switch
+  void enter( Zone zone );
+  //closes summed up zone at the end of a run
+  void leave();
+  //frame zone lasts from one call to the next
+  void frame();
+
+  uint64_t actions( Action action ) const;
+  uint64_t suzyRequests( int type ) const;
+  uint64_t traps() const;
+  //nanoseconds
+  uint64_t zoneTime( Zone zone ) const;
+  uint64_t zoneCount( Zone zone ) const;
+
+  //traced zones still in the ring and totals of all counters
+  void writeChromeTrace( std::ostream & out ) const;
+
+  static char const* name( Zone zone );
+
+private:
+  struct TraceEvent
+  {
+    std::atomic<uint64_t> begin;
+    std::atomic<uint64_t> end;
+    std::atomic<uint32_t> zone;
+  };
+
+  //single writer, so no need for locked read-modify-write
+  static void bump( std::atomic<uint64_t> & counter, uint64_t value = 1 )
+  {
+    counter.store( counter.load( std::memory_order_relaxed ) + value, std::memory_order_relaxed );
+  }
+
+private:
+  std::chrono::steady_clock::time_point mStart;
+  std::array<std::atomic<uint64_t>, (size_t)Action::ACTIONS_END_> mActions;
+  std::array<std::atomic<uint64_t>, SUZY_REQUEST_TYPES> mSuzyRequests;
+  std::atomic<uint64_t> mTraps;
+  std::array<std::atomic<uint64_t>, (size_t)Zone::ZONES_END_> mZoneTimes;
+  std::array<std::atomic<uint64_t>, (size_t)Zone::ZONES_END_> mZoneCounts;
+  std::unique_ptr<std::array<TraceEvent, TRACE_SIZE>> mTrace;
+  std::atomic<uint64_t> mTraceHead;
+  //summed up zone being entered and since when
+  std::optional<Zone> mEntered;
+  uint64_t mEnteredTime;
+  std::optional<uint64_t> mFrameBegin;
+};
@@ -5,6 +5,14 @@ class KeyInput
   uint32_t data;
 public:
 
+  KeyInput() : data{}
+  {
+  }
+
+  explicit KeyInput( uint32_t data ) : data{ data }
+  {
+  }
+
   enum Key : uint32_t
   {
     OUTER   = 0,
@@ -42,6 +50,11 @@ public:
   {
     return ( data >> 8 ) & 0xff;
   }
+
+  uint32_t raw() const
+  {
+    return data;
+  }
 };
 
 class IInputSource
@@ -50,4 +63,11 @@ public:
   virtual ~IInputSource() = default;
 
   virtual KeyInput getInput( bool leftHand ) const = 0;
+
+  //Called by Suzy on every read of JOYSTICK or SWITCHES with the tick of the access.
+  //Sources that depend on emulated time like input movies override it
+  virtual KeyInput readInput( bool leftHand, uint64_t tick )
+  {
+    return getInput( leftHand );
+  }
 };
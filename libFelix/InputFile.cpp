@@ -6,10 +6,12 @@
 #include "ImageProperties.hpp"
 #include "Log.hpp"
 
-InputFile::InputFile( std::filesystem::path const & path, std::shared_ptr<ImageProperties> & imageProperties ) : mType{}, mBS93{}, mCart{}
+InputFile::InputFile( std::filesystem::path const & path, std::shared_ptr<ImageProperties> & imageProperties ) : InputFile{ readFile( path ), path, imageProperties }
 {
-  auto data = readFile( path );
+}
 
+InputFile::InputFile( std::vector<uint8_t> data, std::filesystem::path const& path, std::shared_ptr<ImageProperties> & imageProperties ) : mType{}, mBS93{}, mCart{}
+{
   if ( data.empty() )
     return;
 
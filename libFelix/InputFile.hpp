@@ -15,6 +15,8 @@ public:
   };
 
   InputFile( std::filesystem::path const& path, std::shared_ptr<ImageProperties> & imageProperties );
+  //image already in memory, path only identifies it
+  InputFile( std::vector<uint8_t> data, std::filesystem::path const& path, std::shared_ptr<ImageProperties> & imageProperties );
 
   bool valid() const;
   FileType getType() const;
@@ -0,0 +1,164 @@
+#include "pch.hpp"
+#include "InputMovie.hpp"
+
+namespace
+{
+
+static constexpr std::array<char, 4> MAGIC = { 'F', 'X', 'M', '1' };
+static constexpr size_t FLUSH_SIZE = 4096;
+
+void putSize( std::vector<uint8_t> & out, uint64_t value )
+{
+  while ( value >= 0x80 )
+  {
+    out.push_back( (uint8_t)( value | 0x80 ) );
+    value >>= 7;
+  }
+  out.push_back( (uint8_t)value );
+}
+
+//empty if the data ends before the number
+std::optional<uint64_t> getSize( uint8_t const*& in, uint8_t const* end )
+{
+  uint64_t value{};
+  for ( int shift = 0; in != end && shift < 64; shift += 7 )
+  {
+    uint8_t b = *in++;
+    value |= (uint64_t)( b & 0x7f ) << shift;
+    if ( ( b & 0x80 ) == 0 )
+      return value;
+  }
+  return std::nullopt;
+}
+
+}
+
+InputRecorder::InputRecorder( std::shared_ptr<IInputSource> source, std::filesystem::path const& path, uint32_t seed ) : mSource{ std::move( source ) }, mOut{ path, std::ios::binary },
+  mBuffer{}, mLast{}, mReads{}, mLastTick{}, mLastRead{}
+{
+  mOut.write( MAGIC.data(), MAGIC.size() );
+  putSize( mBuffer, seed );
+}
+
+InputRecorder::~InputRecorder()
+{
+  flush();
+}
+
+KeyInput InputRecorder::getInput( bool leftHand ) const
+{
+  return mSource->getInput( leftHand );
+}
+
+KeyInput InputRecorder::readInput( bool leftHand, uint64_t tick )
+{
+  KeyInput input = mSource->readInput( leftHand, tick );
+
+  if ( input.raw() != mLast.raw() )
+  {
+    putSize( mBuffer, tick - mLastTick );
+    putSize( mBuffer, mReads - mLastRead );
+    putSize( mBuffer, input.raw() );
+    mLast = input;
+    mLastTick = tick;
+    mLastRead = mReads;
+
+    if ( mBuffer.size() >= FLUSH_SIZE )
+      flush();
+  }
+
+  mReads += 1;
+  return input;
+}
+
+bool InputRecorder::good() const
+{
+  return mOut.good();
+}
+
+void InputRecorder::flush()
+{
+  mOut.write( (char const*)mBuffer.data(), mBuffer.size() );
+  mOut.flush();
+  mBuffer.clear();
+}
+
+InputReplayer::InputReplayer( std::filesystem::path const& path ) : mChanges{}, mNext{}, mSeed{}, mCurrent{}, mReads{}, mGood{}, mDesynchronized{}
+{
+  auto data = readFile( path );
+  if ( data.size() < MAGIC.size() || !std::equal( MAGIC.cbegin(), MAGIC.cend(), data.cbegin() ) )
+    return;
+
+  uint8_t const* in = data.data() + MAGIC.size();
+  uint8_t const* const end = data.data() + data.size();
+  auto seed = getSize( in, end );
+  if ( !seed )
+    return;
+
+  mSeed = (uint32_t)*seed;
+  uint64_t tick{};
+  uint64_t read{};
+
+  while ( in != end )
+  {
+    auto tickDelta = getSize( in, end );
+    auto readDelta = getSize( in, end );
+    auto input = getSize( in, end );
+    //movie of a session that did not end cleanly is replayed up to the last whole change
+    if ( !tickDelta || !readDelta || !input )
+      break;
+
+    tick += *tickDelta;
+    read += *readDelta;
+    mChanges.push_back( Change{ tick, read, KeyInput{ (uint32_t)*input } } );
+  }
+
+  mGood = true;
+}
+
+bool InputReplayer::good() const
+{
+  return mGood;
+}
+
+bool InputReplayer::desynchronized() const
+{
+  return mDesynchronized;
+}
+
+bool InputReplayer::finished() const
+{
+  return mNext == mChanges.size();
+}
+
+uint32_t InputReplayer::seed() const
+{
+  return mSeed;
+}
+
+KeyInput InputReplayer::getInput( bool leftHand ) const
+{
+  return mCurrent;
+}
+
+KeyInput InputReplayer::readInput( bool leftHand, uint64_t tick )
+{
+  if ( mNext < mChanges.size() )
+  {
+    auto const& change = mChanges[mNext];
+    if ( change.read == mReads )
+    {
+      mDesynchronized |= change.tick != tick;
+      mCurrent = change.input;
+      mNext += 1;
+    }
+    else if ( change.tick <= tick )
+    {
+      //recorded read is not there yet, but its time has come
+      mDesynchronized = true;
+    }
+  }
+
+  mReads += 1;
+  return mCurrent;
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include "IInputSource.hpp"
+#include "Utility.hpp"
+
+//Input movie is the sequence of changes of the input seen by the emulated Lynx.
+//Every change is stamped with the tick of the JOYSTICK or SWITCHES read it was first seen by and with the number of reads before it.
+//Power on state of the CPU is random, so a movie also holds the seed of the reset state the recorded Core was given with Core::setResetSeed.
+//Emulation is otherwise deterministic, so replaying a movie from the same image and boot ROM on a Core with the recorded seed
+//feeds every read with the recorded value and reproduces the recorded session bit-exactly. Movies cover one continuous run
+//from the construction of the Core, i.e. loading states, rewind and run-ahead can't be used while recording or replaying.
+//File is a magic and the varint seed followed by a varint triple per change: tick delta, read count delta and the raw KeyInput.
+
+//Records input of another source seen by the emulation to a movie
+class InputRecorder : public IInputSource, private NonCopyable
+{
+public:
+  //seed must be given to the recorded Core with Core::setResetSeed
+  InputRecorder( std::shared_ptr<IInputSource> source, std::filesystem::path const& path, uint32_t seed );
+  //writes changes not written yet
+  ~InputRecorder() override;
+
+  KeyInput getInput( bool leftHand ) const override;
+  KeyInput readInput( bool leftHand, uint64_t tick ) override;
+
+  bool good() const;
+
+private:
+  void flush();
+
+private:
+  std::shared_ptr<IInputSource> mSource;
+  std::ofstream mOut;
+  std::vector<uint8_t> mBuffer;
+  KeyInput mLast;
+  uint64_t mReads;
+  uint64_t mLastTick;
+  uint64_t mLastRead;
+};
+
+//Replays a movie recorded by InputRecorder.
+//Changes are applied on the reads they were recorded at, a read at another tick than recorded marks the replay desynchronized
+class InputReplayer : public IInputSource, private NonCopyable
+{
+public:
+  explicit InputReplayer( std::filesystem::path const& path );
+
+  //false if the file is not an input movie
+  bool good() const;
+  //emulation did not read the input at the recorded ticks, so it does not reproduce the recorded session
+  bool desynchronized() const;
+  //all recorded changes have been replayed
+  bool finished() const;
+  //reset seed of the recorded Core to be given to the replaying one
+  uint32_t seed() const;
+
+  KeyInput getInput( bool leftHand ) const override;
+  KeyInput readInput( bool leftHand, uint64_t tick ) override;
+
+private:
+  struct Change
+  {
+    uint64_t tick;
+    uint64_t read;
+    KeyInput input;
+  };
+
+  std::vector<Change> mChanges;
+  size_t mNext;
+  uint32_t mSeed;
+  KeyInput mCurrent;
+  uint64_t mReads;
+  bool mGood;
+  bool mDesynchronized;
+};
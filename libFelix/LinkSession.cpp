@@ -0,0 +1,287 @@
+#include "pch.hpp"
+#include "LinkSession.hpp"
+#include "ComLynxWire.hpp"
+#include "Core.hpp"
+
+class LinkSession::Wire : public ComLynxWire
+{
+public:
+  Wire( LinkSession & session, int index, size_t count ) : mSession{ session }, mIndex{ index }, mBoundary{}, mActive{}, mOutgoing{}, mIncoming{}, mPending{},
+    mPeerLevel( count, 1 ), mTick{}, mLevel{ 1 }, mCoarseValue{}, mParBit{}
+  {
+  }
+
+  void pullUp() override
+  {
+    mLevel = 1;
+    mOutgoing.push_back( Event{ mTick, mIndex, Event::LEVEL, 1, 0 } );
+  }
+
+  void pullDown() override
+  {
+    mLevel = 0;
+    mOutgoing.push_back( Event{ mTick, mIndex, Event::LEVEL, 0, 0 } );
+  }
+
+  int wire() const override
+  {
+    int result = mLevel == 0 ? -1 : 0;
+    for ( size_t peer = 0; peer < mPeerLevel.size(); ++peer )
+    {
+      if ( (int)peer != mIndex && mPeerLevel[peer] == 0 )
+        result -= 1;
+    }
+    return result;
+  }
+
+  int connect() override
+  {
+    return mIndex;
+  }
+
+  void setCoarse( int value, int parbit ) override
+  {
+    mCoarseValue = value;
+    mParBit = parbit;
+    mOutgoing.push_back( Event{ mTick, mIndex, Event::COARSE, value, parbit } );
+  }
+
+  int getCoarse( int & parbit ) const override
+  {
+    parbit = mParBit;
+    return mCoarseValue;
+  }
+
+  void sync( uint64_t tick ) override
+  {
+    mTick = std::max( mTick, tick );
+
+    while ( mTick >= ( mBoundary.load( std::memory_order_relaxed ) + 1 ) * mSession.mQuantum )
+    {
+      cross();
+    }
+
+    size_t applied = 0;
+    for ( ; applied < mPending.size() && mPending[applied].tick + mSession.mQuantum <= mTick; ++applied )
+    {
+      auto const& event = mPending[applied];
+      switch ( event.type )
+      {
+      case Event::LEVEL:
+        mPeerLevel[event.sender] = event.value;
+        break;
+      case Event::COARSE:
+        mCoarseValue = event.value;
+        mParBit = event.parbit;
+        break;
+      }
+    }
+    mPending.erase( mPending.begin(), mPending.begin() + applied );
+  }
+
+  void join()
+  {
+    mActive.store( true, std::memory_order_release );
+  }
+
+  //peers do not wait for a wire that left, events sent so far are still delivered
+  void leave()
+  {
+    {
+      std::scoped_lock<std::mutex> lock{ mSession.mMutex };
+      post();
+    }
+    mActive.store( false, std::memory_order_release );
+  }
+
+private:
+  struct Event
+  {
+    enum Type
+    {
+      LEVEL,
+      COARSE
+    };
+
+    uint64_t tick;
+    int sender;
+    Type type;
+    int value;
+    int parbit;
+  };
+
+  //passes the next quantum boundary
+  void cross()
+  {
+    uint64_t boundary = mBoundary.load( std::memory_order_relaxed ) + 1;
+
+    {
+      std::scoped_lock<std::mutex> lock{ mSession.mMutex };
+      post();
+    }
+    mBoundary.store( boundary, std::memory_order_release );
+
+    //all events sent before the boundary are posted by a peer that reached it
+    for ( auto const& peer : mSession.mWires )
+    {
+      while ( peer->mActive.load( std::memory_order_acquire ) && peer->mBoundary.load( std::memory_order_acquire ) < boundary )
+      {
+        std::this_thread::yield();
+      }
+    }
+
+    size_t begin = mPending.size();
+    {
+      std::scoped_lock<std::mutex> lock{ mSession.mMutex };
+      mPending.insert( mPending.end(), mIncoming.cbegin(), mIncoming.cend() );
+      mIncoming.clear();
+    }
+
+    //order of posting depends on thread timing, order of applying does not.
+    //A peer ahead by a quantum posts events before another one posts earlier events, so they are merged with those still pending
+    auto const before = []( Event const& left, Event const& right )
+    {
+      return left.tick < right.tick || ( left.tick == right.tick && left.sender < right.sender );
+    };
+    std::sort( mPending.begin() + begin, mPending.end(), before );
+    std::inplace_merge( mPending.begin(), mPending.begin() + begin, mPending.end(), before );
+  }
+
+  //called under session mutex
+  void post()
+  {
+    for ( auto const& peer : mSession.mWires )
+    {
+      if ( peer.get() != this )
+        peer->mIncoming.insert( peer->mIncoming.end(), mOutgoing.cbegin(), mOutgoing.cend() );
+    }
+    mOutgoing.clear();
+  }
+
+private:
+  LinkSession & mSession;
+  int mIndex;
+  //number of quantum boundaries passed
+  std::atomic<uint64_t> mBoundary;
+  std::atomic<bool> mActive;
+  //sent in the current quantum
+  std::vector<Event> mOutgoing;
+  //posted by peers, guarded by session mutex
+  std::vector<Event> mIncoming;
+  //received and sorted, waiting to become due
+  std::vector<Event> mPending;
+  //0 if the peer pulls the line down
+  std::vector<int> mPeerLevel;
+  uint64_t mTick;
+  int mLevel;
+  int mCoarseValue;
+  int mParBit;
+};
+
+LinkSession::LinkSession( size_t cores, Factory const& factory, uint64_t quantum ) : mQuantum{ std::max<uint64_t>( quantum, 1 ) }, mWires{}, mCores{}, mThreads{},
+  mMutex{}, mWake{}, mIdle{}, mJob{}, mGeneration{}, mUnfinished{}, mStop{}
+{
+  for ( size_t i = 0; i < cores; ++i )
+  {
+    mWires.push_back( std::make_shared<Wire>( *this, (int)i, cores ) );
+  }
+
+  for ( size_t i = 0; i < cores; ++i )
+  {
+    mCores.push_back( factory( mWires[i] ) );
+  }
+
+  for ( size_t i = 0; i < cores; ++i )
+  {
+    mThreads.emplace_back( [this, i]
+    {
+      work( i );
+    } );
+  }
+}
+
+LinkSession::~LinkSession()
+{
+  {
+    std::scoped_lock<std::mutex> lock{ mMutex };
+    mStop = true;
+  }
+  mWake.notify_all();
+
+  for ( auto& thread : mThreads )
+  {
+    thread.join();
+  }
+}
+
+size_t LinkSession::size() const
+{
+  return mCores.size();
+}
+
+Core & LinkSession::core( size_t index )
+{
+  return *mCores[index];
+}
+
+void LinkSession::run( Job job )
+{
+  std::unique_lock<std::mutex> lock{ mMutex };
+
+  //every Core takes part from the start, otherwise the first ones could run ahead of the ones not started yet
+  for ( auto const& wire : mWires )
+  {
+    wire->join();
+  }
+
+  mJob = std::move( job );
+  mGeneration += 1;
+  mUnfinished = mCores.size();
+  mWake.notify_all();
+
+  mIdle.wait( lock, [this]
+  {
+    return mUnfinished == 0;
+  } );
+  mJob = {};
+}
+
+void LinkSession::runFrames( int frames, OutputPolicy outputPolicy )
+{
+  run( [=]( size_t, Core & core )
+  {
+    core.runFrames( frames, outputPolicy );
+  } );
+}
+
+void LinkSession::work( size_t index )
+{
+  uint64_t generation{};
+
+  for ( ;; )
+  {
+    Job job;
+
+    {
+      std::unique_lock<std::mutex> lock{ mMutex };
+      mWake.wait( lock, [&]
+      {
+        return mStop || mGeneration != generation;
+      } );
+      if ( mStop )
+        return;
+
+      generation = mGeneration;
+      job = mJob;
+    }
+
+    job( index, *mCores[index] );
+    mWires[index]->leave();
+
+    {
+      std::scoped_lock<std::mutex> lock{ mMutex };
+      mUnfinished -= 1;
+    }
+    mIdle.notify_all();
+  }
+}
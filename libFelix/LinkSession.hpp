@@ -0,0 +1,53 @@
+#pragma once
+
+#include "Utility.hpp"
+
+class Core;
+class ComLynxWire;
+
+//Cores connected by ComLynx, each emulated on its own thread.
+//Every Core is connected through its own wire. Line transitions and bytes are not synchronized when they happen,
+//they are stamped with the tick of the sender and applied by the others one quantum later.
+//Threads meet only at quantum boundaries, where every Core waits until all others have reached the boundary,
+//so the skew between Cores stays below one quantum and every event arrives before it is due.
+//Results are deterministic as long as all Cores run the same number of ticks, a Core that finished its job is not waited for.
+//A job must keep running its Core until it returns, a Core that is not run holds the others at the next boundary.
+//Ticks must not go back, so rewind and run-ahead can't be used with linked Cores.
+class LinkSession : private NonCopyable
+{
+public:
+  static constexpr uint64_t DEFAULT_QUANTUM = 2048;
+
+  using Factory = std::function<std::shared_ptr<Core>( std::shared_ptr<ComLynxWire> )>;
+  using Job = std::function<void( size_t index, Core & core )>;
+
+  //constructs given number of Cores by calling factory with the wire each one must be connected to
+  LinkSession( size_t cores, Factory const& factory, uint64_t quantum = DEFAULT_QUANTUM );
+  ~LinkSession();
+
+  size_t size() const;
+  Core & core( size_t index );
+
+  //runs job with every Core on its thread and returns when all are finished
+  void run( Job job );
+  void runFrames( int frames, OutputPolicy outputPolicy );
+
+private:
+  class Wire;
+
+  void work( size_t index );
+
+private:
+  uint64_t mQuantum;
+  std::vector<std::shared_ptr<Wire>> mWires;
+  std::vector<std::shared_ptr<Core>> mCores;
+  std::vector<std::thread> mThreads;
+  //guards the job and events passed between wires
+  std::mutex mMutex;
+  std::condition_variable mWake;
+  std::condition_variable mIdle;
+  Job mJob;
+  uint64_t mGeneration;
+  size_t mUnfinished;
+  bool mStop;
+};
@@ -23,7 +23,8 @@ public:
 private:
   Log();
 
-  LogLevel mLogLevel;
+  //shared by all Core instances and may be changed from any thread
+  std::atomic<LogLevel> mLogLevel;
 };
 
 class Formatter
@@ -7,9 +7,11 @@
 #include "CPU.hpp"
 #include "ComLynx.hpp"
 #include "VGMWriter.hpp"
+#include "StateArchive.hpp"
 
 Mikey::Mikey( Core & core, ComLynx & comLynx, std::shared_ptr<IVideoSink> videoSink ) : mCore{ core }, mComLynx{ comLynx }, mAccessTick{}, mTimers{}, mAudioChannels{}, mPalette{},
-  mAttenuation{ 0xff, 0xff, 0xff, 0xff }, mAttenuationLeft{ 0x3c, 0x3c, 0x3c, 0x3c }, mAttenuationRight{ 0x3c, 0x3c, 0x3c, 0x3c }, mDisplayGenerator{ std::make_unique<DisplayGenerator>( std::move( videoSink ) ) },
+  mAttenuation{ 0xff, 0xff, 0xff, 0xff }, mAttenuationLeft{ 0x3c, 0x3c, 0x3c, 0x3c }, mAttenuationRight{ 0x3c, 0x3c, 0x3c, 0x3c },
+  mAudioSynthesizer{ std::make_unique<AudioSynthesizer>() }, mMixLog{}, mLoggingAudio{}, mDisplayGenerator{ std::make_unique<DisplayGenerator>( std::move( videoSink ) ) },
   mParallelPort{ mCore, mComLynx, *mDisplayGenerator }, mDisplayRegs{}, mSuzyDone{}, mPan{ 0xff }, mStereo{}, mSerDat{}, mIRQ{}, mVGMWriterMutex{}
 {
   mTimers[0x0] = std::make_unique<TimerCore>( 0x0, [this]( uint64_t tick, bool interrupt )
@@ -23,7 +25,8 @@ Mikey::Mikey( Core & core, ComLynx & comLynx, std::shared_ptr<IVideoSink> videoS
     mCore.newLine( cnt );
     if ( cnt == 104 )
     {
-      mDisplayGenerator->firstHblank( tick, mTimers[0x00]->getBackup( tick ) );
+      if ( mDisplayGenerator->firstHblank( tick, mTimers[0x00]->getBackup( tick ) ) )
+        mDisplayGenerator->resendPalette( mPalette );
     }
     else if ( auto dma = mDisplayGenerator->hblank( tick, cnt ) )
     {
@@ -61,7 +64,7 @@ Mikey::Mikey( Core & core, ComLynx & comLynx, std::shared_ptr<IVideoSink> videoS
   } );  //timer 3 -> timer 5
   mTimers[0x4] = std::make_unique<TimerCore>( 0x4, [this]( uint64_t tick, bool interrupt )
   {
-    if ( mComLynx.pulse() )
+    if ( mComLynx.pulse( tick ) )
     {
       setIRQ( 0x10 );
     }
@@ -294,7 +297,7 @@ SequencedAction Mikey::write( uint16_t address, uint8_t value )
     case AUDIO::FEEDBACK:
       return mAudioChannels[( address >> 3 ) & 3]->setFeedback( value );
     case AUDIO::OUTPUT:
-      return mAudioChannels[( address >> 3 ) & 3]->setOutput( value );
+      return mAudioChannels[( address >> 3 ) & 3]->setOutput( mAccessTick, value );
     case AUDIO::SHIFT:
       return mAudioChannels[( address >> 3 ) & 3]->setShift( value );
     case AUDIO::BACKUP:
@@ -316,6 +319,7 @@ SequencedAction Mikey::write( uint16_t address, uint8_t value )
     mAttenuation[address & 3] = value;
     mAttenuationRight[address & 3] = ( value & 0x0f ) << 2;
     mAttenuationLeft[address & 3] = ( value & 0xf0 ) >> 2;
+    logMix();
     {
       std::unique_lock lock( mVGMWriterMutex );
       if ( mVGMWriter )
@@ -324,6 +328,7 @@ SequencedAction Mikey::write( uint16_t address, uint8_t value )
     break;
   case MPAN:
     mPan = value;
+    logMix();
     {
       std::unique_lock lock( mVGMWriterMutex );
       if ( mVGMWriter )
@@ -332,6 +337,7 @@ SequencedAction Mikey::write( uint16_t address, uint8_t value )
     break;
   case MSTEREO:
     mStereo = value;
+    logMix();
     {
       std::unique_lock lock( mVGMWriterMutex );
       if ( mVGMWriter )
@@ -462,33 +468,116 @@ void Mikey::suzyDone()
   mSuzyDone = true;
 }
 
-AudioSample Mikey::sampleAudio( uint64_t tick ) const
+AudioSynthesizer::Mix Mikey::mix() const
 {
-  int16_t left{};
-  int16_t right{};
-  int16_t samples[4];
-
-  samples[0] = (int16_t)mAudioChannels[0]->sample( tick );
-  samples[1] = (int16_t)mAudioChannels[1]->sample( tick );
-  samples[2] = (int16_t)mAudioChannels[2]->sample( tick );
-  samples[3] = (int16_t)mAudioChannels[3]->sample( tick );
+  AudioSynthesizer::Mix result{};
 
   for ( size_t i = 0; i < 4; ++i )
   {
     if ( ( mStereo & ( (uint8_t)0x01 << i ) ) == 0 )
-    {
-      const int attenuation = ( mPan & ( (uint8_t)0x01 << i ) ) != 0 ? mAttenuationLeft[i] : 0x3c;
-      left += (int16_t)samples[i] * attenuation;
-    }
+      result.left[i] = ( mPan & ( (uint8_t)0x01 << i ) ) != 0 ? mAttenuationLeft[i] : 0x3c;
 
     if ( ( mStereo & ( (uint8_t)0x10 << i ) ) == 0 )
+      result.right[i] = ( mPan & ( (uint8_t)0x01 << i ) ) != 0 ? mAttenuationRight[i] : 0x3c;
+  }
+
+  return result;
+}
+
+void Mikey::logMix()
+{
+  if ( mLoggingAudio )
+    mMixLog.push_back( { mAccessTick, mix() } );
+}
+
+void Mikey::logAudio( bool enabled, uint64_t tick )
+{
+  if ( enabled && !mLoggingAudio )
+    mMixLog.push_back( { tick, mix() } );
+
+  for ( auto & channel : mAudioChannels )
+  {
+    channel->logOutput( enabled, tick );
+  }
+
+  mLoggingAudio = enabled;
+}
+
+bool Mikey::isLoggingAudio() const
+{
+  return mLoggingAudio;
+}
+
+void Mikey::restartAudio( uint64_t tick )
+{
+  logAudio( false, tick );
+  mMixLog.clear();
+  for ( auto & channel : mAudioChannels )
+  {
+    channel->transitions().clear();
+  }
+
+  mAudioSynthesizer->restart( tick );
+  logAudio( true, tick );
+}
+
+void Mikey::synthesizeAudio( std::span<uint64_t const> ticks, std::span<AudioSample> out )
+{
+  uint64_t const last = ticks.back();
+  std::array<size_t, 4> next{};
+  size_t nextMix{};
+
+  mAudioSynthesizer->begin( ticks );
+
+  //changes of all channels and the mixer merged in the order of their ticks, the mixer first on the same tick
+  for ( ;; )
+  {
+    uint64_t tick = nextMix < mMixLog.size() ? mMixLog[nextMix].tick : std::numeric_limits<uint64_t>::max();
+    int channel = -1;
+    for ( int i = 0; i < 4; ++i )
     {
-      const int attenuation = ( mPan & ( (uint8_t)0x01 << i ) ) != 0 ? mAttenuationRight[i] : 0x3c;
-      right += (int16_t)samples[i] * attenuation;
+      auto const& transitions = mAudioChannels[i]->transitions();
+      if ( next[i] < transitions.size() && transitions[next[i]].tick < tick )
+      {
+        tick = transitions[next[i]].tick;
+        channel = i;
+      }
     }
+
+    if ( tick > last )
+      break;
+
+    if ( channel < 0 )
+      mAudioSynthesizer->setMix( tick, mMixLog[nextMix++].mix );
+    else
+      mAudioSynthesizer->setOutput( channel, tick, mAudioChannels[channel]->transitions()[next[channel]++].output );
   }
 
-  return { left, right };
+  mMixLog.erase( mMixLog.begin(), mMixLog.begin() + nextMix );
+  for ( int i = 0; i < 4; ++i )
+  {
+    auto & transitions = mAudioChannels[i]->transitions();
+    transitions.erase( transitions.begin(), transitions.begin() + next[i] );
+  }
+
+  mAudioSynthesizer->render( out );
+}
+
+void Mikey::skipVideoFrames( int frames )
+{
+  mDisplayGenerator->skipFrames( frames );
+}
+
+void Mikey::muteVideo( bool muted )
+{
+  mDisplayGenerator->mute( muted );
+  if ( !muted )
+    mDisplayGenerator->resendPalette( mPalette );
+}
+
+void Mikey::setHostProfiler( HostProfiler * hostProfiler )
+{
+  mDisplayGenerator->setHostProfiler( hostProfiler );
 }
 
 void Mikey::setVGMWriter( std::shared_ptr<VGMWriter> writer )
@@ -533,3 +622,30 @@ std::span<uint8_t const, 32> Mikey::debugPalette() const
 {
   return std::span<uint8_t const, 32>( mPalette.data(), mPalette.size() );
 }
+
+template<typename Archive>
+void Mikey::serialize( Archive & ar )
+{
+  ar( mAccessTick, mPalette, mAttenuation, mAttenuationLeft, mAttenuationRight, mDisplayRegs, mSuzyDone, mPan, mStereo, mSerDat, mIRQ );
+
+  for ( auto & timer : mTimers )
+  {
+    timer->serialize( ar );
+  }
+  for ( auto & channel : mAudioChannels )
+  {
+    channel->serialize( ar );
+  }
+
+  mDisplayGenerator->serialize( ar );
+  mParallelPort.serialize( ar );
+
+  if constexpr ( Archive::LOADING )
+  {
+    mDisplayGenerator->resendPalette( mPalette );
+  }
+}
+
+template void Mikey::serialize<StateWriter>( StateWriter & );
+template void Mikey::serialize<StateReader>( StateReader & );
+template void Mikey::serialize<StateValidator>( StateValidator & );
@@ -3,6 +3,7 @@
 #include "ActionQueue.hpp"
 #include "ParallelPort.hpp"
 #include "DisplayGenerator.hpp"
+#include "AudioSynthesizer.hpp"
 #include "Utility.hpp"
 
 class Core;
@@ -10,6 +11,7 @@ class TimerCore;
 class AudioChannel;
 class DisplayGenerator;
 class VGMWriter;
+class HostProfiler;
 
 class Mikey
 {
@@ -83,16 +85,35 @@ public:
   SequencedAction fireTimer( uint64_t tick, uint32_t timer );
   void setDMAData( uint64_t tick, uint64_t data );
   void suzyDone();
-  AudioSample sampleAudio( uint64_t tick ) const;
+  //Output changes of audio channels and the mixer are logged for synthesizeAudio while enabled.
+  //Enabling logs the current outputs at given tick, so synthesis steps smoothly over whatever happened unlogged
+  void logAudio( bool enabled, uint64_t tick );
+  bool isLoggingAudio() const;
+  //Drops logged changes and enables logging. The next batch of samples does not follow the last one but given tick
+  void restartAudio( uint64_t tick );
+  //Renders samples at given ascending ticks from changes logged up to the last of them. Later changes are kept for the next batch
+  void synthesizeAudio( std::span<uint64_t const> ticks, std::span<AudioSample> out );
+  //video sink receives nothing until given number of frames has started
+  void skipVideoFrames( int frames );
+  //whole palette is pushed to the video sink on unmuting as it missed changes made while muted
+  void muteVideo( bool muted );
+  void setHostProfiler( HostProfiler * hostProfiler );
   void setVGMWriter( std::shared_ptr<VGMWriter> writer );
   bool isVGMWriter() const;
 
   void setIRQ( uint8_t mask );
   void resetIRQ( uint8_t mask );
 
+  template<typename Archive>
+  void serialize( Archive & ar );
+
   uint16_t debugDispAdr() const;
   std::span<uint8_t const, 32> debugPalette() const;
 
+private:
+  AudioSynthesizer::Mix mix() const;
+  void logMix();
+
 private:
   Core & mCore;
   ComLynx & mComLynx;
@@ -105,6 +126,16 @@ private:
   std::array<int16_t, 4> mAttenuationLeft;
   std::array<int16_t, 4> mAttenuationRight;
 
+  struct MixChange
+  {
+    uint64_t tick;
+    AudioSynthesizer::Mix mix;
+  };
+
+  std::unique_ptr<AudioSynthesizer> mAudioSynthesizer;
+  std::vector<MixChange> mMixLog;
+  bool mLoggingAudio;
+
   std::unique_ptr<DisplayGenerator> mDisplayGenerator;
   std::shared_ptr<VGMWriter> mVGMWriter;
   mutable std::mutex mVGMWriterMutex;
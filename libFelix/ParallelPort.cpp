@@ -3,6 +3,7 @@
 #include "Cartridge.hpp"
 #include "ComLynx.hpp"
 #include "Core.hpp"
+#include "StateArchive.hpp"
 
 
 ParallelPort::ParallelPort( Core & core, ComLynx & comLynx, RestProvider const & restProvider ) : mCore{ core }, mComLynx{ comLynx }, mRestProvider{ restProvider },
@@ -83,3 +84,13 @@ uint8_t ParallelPort::getData( uint64_t tick ) const
 
   return result;
 }
+
+template<typename Archive>
+void ParallelPort::serialize( Archive & ar )
+{
+  ar( mOutputMask, mData );
+}
+
+template void ParallelPort::serialize<StateWriter>( StateWriter & );
+template void ParallelPort::serialize<StateReader>( StateReader & );
+template void ParallelPort::serialize<StateValidator>( StateValidator & );
@@ -24,6 +24,9 @@ public:
   void setData( uint8_t value );
   uint8_t getData( uint64_t tick ) const;
 
+  template<typename Archive>
+  void serialize( Archive & ar );
+
   struct Mask
   {
     static constexpr uint8_t AUDIN          = 0b00010000; 
@@ -0,0 +1,243 @@
+#include "pch.hpp"
+#include "Rewind.hpp"
+
+namespace
+{
+
+void putSize( std::vector<uint8_t> & out, size_t value )
+{
+  while ( value >= 0x80 )
+  {
+    out.push_back( (uint8_t)( value | 0x80 ) );
+    value >>= 7;
+  }
+  out.push_back( (uint8_t)value );
+}
+
+size_t getSize( uint8_t const*& in )
+{
+  size_t value{};
+  for ( int shift = 0;; shift += 7 )
+  {
+    uint8_t b = *in++;
+    value |= (size_t)( b & 0x7f ) << shift;
+    if ( ( b & 0x80 ) == 0 )
+      return value;
+  }
+}
+
+}
+
+Rewind::Rewind( size_t frames ) : mCapacity{ std::max<size_t>( frames, 1 ) }, mMutex{}, mWake{}, mIdle{}, mEntries{}, mPending{}, mGroupSize{}, mKeyframe{}, mBytes{}, mBusy{}, mStop{}
+{
+  mThread = std::thread{ [this]
+  {
+    work();
+  } };
+}
+
+Rewind::~Rewind()
+{
+  {
+    std::scoped_lock<std::mutex> lock{ mMutex };
+    mStop = true;
+  }
+  mWake.notify_all();
+  mThread.join();
+}
+
+void Rewind::push( std::vector<uint8_t> snapshot )
+{
+  {
+    std::scoped_lock<std::mutex> lock{ mMutex };
+    bool keyframe = mGroupSize == 0 || mGroupSize == KEYFRAME_INTERVAL;
+    mGroupSize = keyframe ? 1 : mGroupSize + 1;
+    mPending.push_back( Entry{ std::move( snapshot ), keyframe } );
+  }
+  mWake.notify_one();
+}
+
+bool Rewind::pop( std::vector<uint8_t> & snapshot )
+{
+  std::unique_lock<std::mutex> lock{ mMutex };
+  //the latest snapshot may still be encoded
+  mIdle.wait( lock, [this]
+  {
+    return mPending.empty() && !mBusy;
+  } );
+
+  if ( mEntries.empty() )
+    return false;
+
+  Entry entry = std::move( mEntries.back() );
+  mEntries.pop_back();
+  mBytes -= entry.data.size();
+
+  if ( entry.keyframe )
+  {
+    decode( {}, entry.data, snapshot );
+    restoreKeyframe();
+  }
+  else
+  {
+    decode( mKeyframe, entry.data, snapshot );
+  }
+
+  mGroupSize = 0;
+  for ( auto it = mEntries.rbegin(); it != mEntries.rend(); ++it )
+  {
+    mGroupSize += 1;
+    if ( it->keyframe )
+      break;
+  }
+
+  return true;
+}
+
+size_t Rewind::size() const
+{
+  std::scoped_lock<std::mutex> lock{ mMutex };
+  return mEntries.size() + mPending.size() + ( mBusy ? 1 : 0 );
+}
+
+size_t Rewind::memoryUsage() const
+{
+  std::scoped_lock<std::mutex> lock{ mMutex };
+  return mBytes;
+}
+
+void Rewind::work()
+{
+  std::vector<uint8_t> delta;
+
+  for ( ;; )
+  {
+    Entry entry;
+
+    {
+      std::unique_lock<std::mutex> lock{ mMutex };
+      mWake.wait( lock, [this]
+      {
+        return mStop || !mPending.empty();
+      } );
+      if ( mStop )
+        return;
+
+      entry = std::move( mPending.front() );
+      mPending.pop_front();
+      mBusy = true;
+    }
+
+    //mKeyframe is touched by pop only when not busy
+    if ( entry.keyframe )
+    {
+      mKeyframe = entry.data;
+      encode( {}, entry.data, delta );
+    }
+    else
+    {
+      encode( mKeyframe, entry.data, delta );
+    }
+    entry.data.assign( delta.cbegin(), delta.cend() );
+
+    {
+      std::scoped_lock<std::mutex> lock{ mMutex };
+      mBytes += entry.data.size();
+      mEntries.push_back( std::move( entry ) );
+      evict();
+      mBusy = false;
+    }
+    mIdle.notify_all();
+  }
+}
+
+void Rewind::evict()
+{
+  //deltas can't outlive their keyframe, so the oldest group goes whole once there are enough snapshots without it
+  while ( !mEntries.empty() )
+  {
+    auto next = std::find_if( mEntries.cbegin() + 1, mEntries.cend(), []( Entry const& entry )
+    {
+      return entry.keyframe;
+    } );
+
+    if ( next == mEntries.cend() || (size_t)( mEntries.cend() - next ) < mCapacity )
+      return;
+
+    for ( auto it = mEntries.cbegin(); it != next; ++it )
+    {
+      mBytes -= it->data.size();
+    }
+    mEntries.erase( mEntries.cbegin(), next );
+  }
+}
+
+void Rewind::restoreKeyframe()
+{
+  auto it = std::find_if( mEntries.crbegin(), mEntries.crend(), []( Entry const& entry )
+  {
+    return entry.keyframe;
+  } );
+
+  if ( it != mEntries.crend() )
+    decode( {}, it->data, mKeyframe );
+  else
+    mKeyframe.clear();
+}
+
+//Delta is the size of the snapshot followed by pairs of counts of equal and differing bytes, the latter followed by their XOR.
+//Bytes past the end of the keyframe are XORed with zero, and so are all bytes of a keyframe itself.
+void Rewind::encode( std::vector<uint8_t> const& keyframe, std::vector<uint8_t> const& snapshot, std::vector<uint8_t> & delta )
+{
+  size_t const size = snapshot.size();
+  size_t const common = std::min( size, keyframe.size() );
+
+  auto diff = [&]( size_t i )
+  {
+    return (uint8_t)( snapshot[i] ^ ( i < common ? keyframe[i] : 0 ) );
+  };
+
+  delta.clear();
+  putSize( delta, size );
+
+  size_t i = 0;
+  while ( i < size )
+  {
+    size_t begin = i;
+    //most of the machine does not change in a frame, so equal bytes are skipped a word at a time
+    while ( i + 8 <= common && std::memcmp( snapshot.data() + i, keyframe.data() + i, 8 ) == 0 )
+      i += 8;
+    while ( i < size && diff( i ) == 0 )
+      i += 1;
+    putSize( delta, i - begin );
+
+    begin = i;
+    while ( i < size && diff( i ) != 0 )
+      i += 1;
+    putSize( delta, i - begin );
+    for ( size_t j = begin; j < i; ++j )
+    {
+      delta.push_back( diff( j ) );
+    }
+  }
+}
+
+void Rewind::decode( std::vector<uint8_t> const& keyframe, std::vector<uint8_t> const& delta, std::vector<uint8_t> & snapshot )
+{
+  uint8_t const* in = delta.data();
+  size_t const size = getSize( in );
+
+  snapshot.assign( keyframe.cbegin(), keyframe.cbegin() + std::min( size, keyframe.size() ) );
+  snapshot.resize( size );
+
+  size_t i = 0;
+  while ( i < size )
+  {
+    i += getSize( in );
+    size_t count = getSize( in );
+    for ( size_t j = 0; j < count; ++j )
+    {
+      snapshot[i++] ^= *in++;
+    }
+  }
+}
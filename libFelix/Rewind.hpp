@@ -0,0 +1,58 @@
+#pragma once
+
+#include "Utility.hpp"
+
+//Ring of Core::saveState snapshots taken once per frame for stepping back in time.
+//Every KEYFRAME_INTERVAL-th snapshot is a keyframe, the others are kept as XOR against their keyframe.
+//Runs of zeros are squeezed out of both, keyframes being XORed with nothing, so restoring any snapshot costs one pass over a delta.
+//Deltas are encoded on a helper thread, the emulation thread only hands over the snapshot.
+class Rewind : private NonCopyable
+{
+public:
+  static constexpr size_t KEYFRAME_INTERVAL = 30;
+
+  //keeps at least given number of snapshots, oldest are dropped a whole keyframe group at a time
+  explicit Rewind( size_t frames );
+  ~Rewind();
+
+  void push( std::vector<uint8_t> snapshot );
+  //removes the latest snapshot and returns it in snapshot. False if there is none
+  bool pop( std::vector<uint8_t> & snapshot );
+
+  size_t size() const;
+  //bytes held by keyframes and encoded deltas
+  size_t memoryUsage() const;
+
+private:
+  struct Entry
+  {
+    std::vector<uint8_t> data;
+    bool keyframe;
+  };
+
+  void work();
+  void evict();
+  //decodes the latest keyframe in mEntries to mKeyframe
+  void restoreKeyframe();
+
+  static void encode( std::vector<uint8_t> const& keyframe, std::vector<uint8_t> const& snapshot, std::vector<uint8_t> & delta );
+  static void decode( std::vector<uint8_t> const& keyframe, std::vector<uint8_t> const& delta, std::vector<uint8_t> & snapshot );
+
+private:
+  size_t mCapacity;
+  mutable std::mutex mMutex;
+  std::condition_variable mWake;
+  std::condition_variable mIdle;
+  //encoded snapshots, oldest first
+  std::deque<Entry> mEntries;
+  //raw snapshots waiting for the helper thread
+  std::deque<Entry> mPending;
+  //snapshots in the latest keyframe group including pending ones
+  size_t mGroupSize;
+  //the latest keyframe decoded
+  std::vector<uint8_t> mKeyframe;
+  size_t mBytes;
+  bool mBusy;
+  bool mStop;
+  std::thread mThread;
+};
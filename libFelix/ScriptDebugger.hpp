@@ -1,6 +1,7 @@
 #pragma once
 
 #include "IMemoryAccessTrap.hpp"
+#include "HostProfiler.hpp"
 #include "generator.hpp"
 
 class Core;
@@ -46,160 +47,91 @@ public:
     MAPCTL_WRITE
   };
 
-  ScriptDebugger() = default;
+  ScriptDebugger() : mRamReadMask{}, mRamWriteMask{}, mRamExecuteMask{}, mRomReadMask{}, mRomWriteMask{}, mRomExecuteMask{},
+    mMikeyReadMask{}, mMikeyWriteMask{}, mSuzyReadMask{}, mSuzyWriteMask{}, mTrappedTypes{}, mTraps{}, mMapCtlReadTrap{}, mMapCtlWriteTrap{}, mHostProfiler{}
+  {
+  }
   ~ScriptDebugger() = default;
 
   cppcoro::generator<std::tuple<Type, uint16_t, std::shared_ptr<IMemoryAccessTrap>>> getTraps( IMemoryAccessTrap::Kind kind )
   {
-    for ( int i = 0; i < 0xffff; ++i )
+    for ( auto const& [key, trap] : mTraps )
     {
-      if ( mRamReadTraps[i] && mRamReadTraps[i]->getKind() == kind )
-      {
-        co_yield std::tuple<Type, uint16_t, std::shared_ptr<IMemoryAccessTrap>>( Type::RAM_READ, i, mRamReadTraps[i] );
-      }
-      if ( mRamWriteTraps[i] && mRamWriteTraps[i]->getKind() == kind )
+      if ( trap->getKind() == kind )
       {
-        co_yield std::tuple<Type, uint16_t, std::shared_ptr<IMemoryAccessTrap>>( Type::RAM_WRITE, i, mRamWriteTraps[i] );
-      }
-      if ( mRamExecuteTraps[i] && mRamExecuteTraps[i]->getKind() == kind )
-      {
-        co_yield std::tuple<Type, uint16_t, std::shared_ptr<IMemoryAccessTrap>>( Type::RAM_EXECUTE, i, mRamExecuteTraps[i] );
+        co_yield std::tuple<Type, uint16_t, std::shared_ptr<IMemoryAccessTrap>>( (Type)( key >> 16 ), (uint16_t)key, trap );
       }
     }
+  }
 
-    for ( int i = 0; i < 0x200; ++i )
-    {
-      if ( mRomReadTraps[i] && mRomReadTraps[i]->getKind() == kind )
-      {
-        co_yield std::tuple<Type, uint16_t, std::shared_ptr<IMemoryAccessTrap>>( Type::ROM_READ, i, mRomReadTraps[i] );
-      }
-      if ( mRomWriteTraps[i] && mRomWriteTraps[i]->getKind() == kind )
-      {
-        co_yield std::tuple<Type, uint16_t, std::shared_ptr<IMemoryAccessTrap>>( Type::ROM_WRITE, i, mRomWriteTraps[i] );
-      }
-      if ( mRomExecuteTraps[i] && mRomExecuteTraps[i]->getKind() == kind )
-      {
-        co_yield std::tuple<Type, uint16_t, std::shared_ptr<IMemoryAccessTrap>>( Type::ROM_EXECUTE, i, mRomExecuteTraps[i] );
-      }
-    }
+  void deleteTrap( Type type, uint16_t address )
+  {
+    if ( type == Type::MAPCTL_READ || type == Type::MAPCTL_WRITE )
+      return;
 
-    for ( int i = 0; i < 0x100; ++i )
-    {
-      if ( mSuzyReadTraps[i] && mSuzyReadTraps[i]->getKind() == kind )
-      {
-        co_yield std::tuple<Type, uint16_t, std::shared_ptr<IMemoryAccessTrap>>( Type::SUZY_READ, i, mSuzyReadTraps[i] );
-      }
-      if ( mSuzyWriteTraps[i] && mSuzyWriteTraps[i]->getKind() == kind )
-      {
-        co_yield std::tuple<Type, uint16_t, std::shared_ptr<IMemoryAccessTrap>>( Type::SUZY_WRITE, i, mSuzyWriteTraps[i] );
-      }
+    address = slot( type, address );
+    mask( type, address ) = false;
+    mTraps.erase( key( type, address ) );
 
-      if ( mMikeyReadTraps[i] && mMikeyReadTraps[i]->getKind() == kind )
-      {
-        co_yield std::tuple<Type, uint16_t, std::shared_ptr<IMemoryAccessTrap>>( Type::MIKEY_READ, i, mMikeyReadTraps[i] );
-      }
-      if ( mMikeyWriteTraps[i] && mMikeyWriteTraps[i]->getKind() == kind )
-      {
-        co_yield std::tuple<Type, uint16_t, std::shared_ptr<IMemoryAccessTrap>>( Type::MIKEY_WRITE, i, mMikeyWriteTraps[i] );
-      }
-    }
+    auto it = mTraps.lower_bound( key( type, 0 ) );
+    if ( it == mTraps.end() || ( it->first >> 16 ) != (uint32_t)type )
+      mTrappedTypes &= ~typeBit( type );
   }
 
-  void deleteTrap( Type type, uint16_t address )
+  void addTrap( Type type, uint16_t address, std::shared_ptr<IMemoryAccessTrap> trap )
   {
     switch ( type )
     {
-    case Type::RAM_READ:
-      mRamReadMask[address] = 0;
-      mRamReadTraps[address] = nullptr;
-      break;
-    case Type::RAM_WRITE:
-      mRamWriteMask[address] = 0;
-      mRamWriteTraps[address] = nullptr;
-      break;
-    case Type::RAM_EXECUTE:
-      mRamExecuteMask[address] = 0;
-      mRamExecuteTraps[address] = nullptr;
-      break;
-    case Type::ROM_READ:
-      mRomReadMask[address] = 0;
-      mRomReadTraps[address] = nullptr;
-      break;
-    case Type::ROM_WRITE:
-      mRomWriteMask[address] = 0;
-      mRomWriteTraps[address] = nullptr;
-      break;
-    case Type::ROM_EXECUTE:
-      mRomExecuteMask[address] = 0;
-      mRomExecuteTraps[address] = nullptr;
-      break;
-    case Type::MIKEY_READ:
-      mMikeyReadMask[address] = 0;
-      mMikeyReadTraps[address] = nullptr;
-      break;
-    case Type::MIKEY_WRITE:
-      mMikeyWriteMask[address] = 0;
-      mMikeyWriteTraps[address] = nullptr;
+    case Type::MAPCTL_READ:
+      helper( mMapCtlReadTrap, std::move( trap ) );
       break;
-    case Type::SUZY_READ:
-      mSuzyReadMask[address] = 0;
-      mSuzyReadTraps[address] = nullptr;
+    case Type::MAPCTL_WRITE:
+      helper( mMapCtlWriteTrap, std::move( trap ) );
       break;
-    case Type::SUZY_WRITE:
-      mSuzyWriteMask[address] = 0;
-      mSuzyWriteTraps[address] = nullptr;
+    default:
+      address = slot( type, address );
+      helper( mTraps[key( type, address )], std::move( trap ) );
+      mask( type, address ) = true;
+      mTrappedTypes |= typeBit( type );
       break;
     }
   }
 
-  void addTrap( Type type, uint16_t address, std::shared_ptr<IMemoryAccessTrap> trap )
+  //counts invoked traps, null disables it
+  void setHostProfiler( HostProfiler * hostProfiler )
+  {
+    mHostProfiler = hostProfiler;
+  }
+
+  //traps on RAM, Mikey or Suzy that need instrumented variant of Core to be observed
+  bool hasMemoryTraps() const
+  {
+    uint32_t romTypes = typeBit( Type::ROM_READ ) | typeBit( Type::ROM_WRITE ) | typeBit( Type::ROM_EXECUTE );
+    return ( mTrappedTypes & ~romTypes ) != 0;
+  }
+
+  bool isTrapped( Type type, uint16_t address ) const
   {
     switch ( type )
     {
     case Type::RAM_READ:
-      helper( { mRamReadTraps.data(), mRamReadTraps.size() }, mRamReadMask[address], address, std::move( trap ) );
-      break;
+      return trapped( Type::RAM_READ, mRamReadMask, address );
     case Type::RAM_WRITE:
-      helper( { mRamWriteTraps.data(), mRamWriteTraps.size() }, mRamWriteMask[address], address, std::move( trap ) );
-      break;
+      return trapped( Type::RAM_WRITE, mRamWriteMask, address );
     case Type::RAM_EXECUTE:
-      helper( { mRamExecuteTraps.data(), mRamExecuteTraps.size() }, mRamExecuteMask[address], address, std::move( trap ) );
-      break;
-    case Type::ROM_READ:
-      helper( { mRomReadTraps.data(), mRomReadTraps.size() }, mRomReadMask[address & 0x1ff], address & 0x1ff, std::move( trap ) );
-      break;
-    case Type::ROM_WRITE:
-      helper( { mRomWriteTraps.data(), mRomWriteTraps.size() }, mRomWriteMask[address & 0x1ff], address & 0x1ff, std::move( trap ) );
-      break;
-    case Type::ROM_EXECUTE:
-      helper( { mRomExecuteTraps.data(), mRomExecuteTraps.size() }, mRomExecuteMask[address & 0x1ff], address & 0x1ff, std::move( trap ) );
-      break;
+      return trapped( Type::RAM_EXECUTE, mRamExecuteMask, address );
     case Type::MIKEY_READ:
-      helper( { mMikeyReadTraps.data(), mMikeyReadTraps.size() }, mMikeyReadMask[address & 0xff], address & 0xff, std::move( trap ) );
-      break;
-    case Type::MIKEY_WRITE:
-      helper( { mMikeyWriteTraps.data(), mMikeyWriteTraps.size() }, mMikeyWriteMask[address & 0xff], address & 0xff, std::move( trap ) );
-      break;
-    case Type::SUZY_READ:
-      helper( { mSuzyReadTraps.data(), mSuzyReadTraps.size() }, mSuzyReadMask[address & 0xff], address & 0xff, std::move( trap ) );
-      break;
-    case Type::SUZY_WRITE:
-      helper( { mSuzyWriteTraps.data(), mSuzyWriteTraps.size() }, mSuzyWriteMask[address & 0xff], address & 0xff, std::move( trap ) );
-      break;
-    case Type::MAPCTL_READ:
-      helper( { &mMapCtlReadTrap, 1 }, 0, std::move( trap ) );
-      break;
-    case Type::MAPCTL_WRITE:
-      helper( { &mMapCtlWriteTrap, 1 }, 0, std::move( trap ) );
-      break;
+      return trapped( Type::MIKEY_READ, mMikeyReadMask, address & 0xff );
+    default:
+      return true;
     }
   }
 
   uint8_t readRAM( Core& core, uint16_t address, uint8_t orgValue )
   {
-    if ( mRamReadMask( address ) )
+    if ( trapped( Type::RAM_READ, mRamReadMask, address ) )
     {
-      return mRamReadTraps[address]->trap( core, address, orgValue );
+      return trap( Type::RAM_READ, address ).trap( core, address, orgValue );
     }
     else
     {
@@ -209,9 +141,9 @@ public:
 
   uint8_t writeRAM( Core& core, uint16_t address, uint8_t orgValue )
   {
-    if ( mRamWriteMask( address ) )
+    if ( trapped( Type::RAM_WRITE, mRamWriteMask, address ) )
     {
-      return mRamWriteTraps[address]->trap( core, address, orgValue );
+      return trap( Type::RAM_WRITE, address ).trap( core, address, orgValue );
     }
     else
     {
@@ -221,9 +153,9 @@ public:
 
   uint8_t executeRAM( Core& core, uint16_t address, uint8_t orgValue )
   {
-    if ( mRamExecuteMask( address ) )
+    if ( trapped( Type::RAM_EXECUTE, mRamExecuteMask, address ) )
     {
-      return mRamExecuteTraps[address]->trap( core, address, orgValue );
+      return trap( Type::RAM_EXECUTE, address ).trap( core, address, orgValue );
     }
     else
     {
@@ -233,9 +165,9 @@ public:
 
   uint8_t readROM( Core& core, uint16_t address, uint8_t orgValue )
   {
-    if ( mRomReadMask( address ) )
+    if ( trapped( Type::ROM_READ, mRomReadMask, address ) )
     {
-      return mRomReadTraps[address]->trap( core, address + 0xfe00, orgValue );
+      return trap( Type::ROM_READ, address ).trap( core, address + 0xfe00, orgValue );
     }
     else
     {
@@ -245,9 +177,9 @@ public:
 
   uint8_t writeROM( Core& core, uint16_t address, uint8_t orgValue )
   {
-    if ( mRomWriteMask( address ) )
+    if ( trapped( Type::ROM_WRITE, mRomWriteMask, address ) )
     {
-      return mRomWriteTraps[address]->trap( core, address + 0xfe00, orgValue );
+      return trap( Type::ROM_WRITE, address ).trap( core, address + 0xfe00, orgValue );
     }
     else
     {
@@ -257,9 +189,9 @@ public:
 
   uint8_t executeROM( Core& core, uint16_t address, uint8_t orgValue )
   {
-    if ( mRomExecuteMask(address) )
+    if ( trapped( Type::ROM_EXECUTE, mRomExecuteMask, address ) )
     {
-      return mRomExecuteTraps[address]->trap( core, address + 0xfe00, orgValue );
+      return trap( Type::ROM_EXECUTE, address ).trap( core, address + 0xfe00, orgValue );
     }
     else
     {
@@ -269,9 +201,9 @@ public:
 
   uint8_t readMikey( Core& core, uint16_t address, uint8_t orgValue )
   {
-    if ( mMikeyReadMask( address & 0xff ) )
+    if ( trapped( Type::MIKEY_READ, mMikeyReadMask, address & 0xff ) )
     {
-      return mMikeyReadTraps[address & 0xff]->trap( core, address, orgValue );
+      return trap( Type::MIKEY_READ, address & 0xff ).trap( core, address, orgValue );
     }
     else
     {
@@ -281,9 +213,9 @@ public:
 
   uint8_t writeMikey( Core& core, uint16_t address, uint8_t orgValue )
   {
-    if ( mMikeyWriteMask( address & 0xff ) )
+    if ( trapped( Type::MIKEY_WRITE, mMikeyWriteMask, address & 0xff ) )
     {
-      return mMikeyWriteTraps[address & 0xff]->trap( core, address, orgValue );
+      return trap( Type::MIKEY_WRITE, address & 0xff ).trap( core, address, orgValue );
     }
     else
     {
@@ -293,9 +225,9 @@ public:
 
   uint8_t readSuzy( Core& core, uint16_t address, uint8_t orgValue )
   {
-    if ( mSuzyReadMask( address & 0xff ) )
+    if ( trapped( Type::SUZY_READ, mSuzyReadMask, address & 0xff ) )
     {
-      return mSuzyReadTraps[address & 0xff]->trap( core, address, orgValue );
+      return trap( Type::SUZY_READ, address & 0xff ).trap( core, address, orgValue );
     }
     else
     {
@@ -305,9 +237,9 @@ public:
 
   uint8_t writeSuzy( Core& core, uint16_t address, uint8_t orgValue )
   {
-    if ( mSuzyWriteMask( address & 0xff ) )
+    if ( trapped( Type::SUZY_WRITE, mSuzyWriteMask, address & 0xff ) )
     {
-      return mSuzyWriteTraps[address & 0xff]->trap( core, address, orgValue );
+      return trap( Type::SUZY_WRITE, address & 0xff ).trap( core, address, orgValue );
     }
     else
     {
@@ -319,6 +251,8 @@ public:
   {
     if ( auto trap = mMapCtlReadTrap.get() )
     {
+      if ( mHostProfiler )
+        mHostProfiler->trap();
       return trap->trap( core, 0xfff9, orgValue );
     }
     else
@@ -331,6 +265,8 @@ public:
   {
     if ( auto trap = mMapCtlWriteTrap.get() )
     {
+      if ( mHostProfiler )
+        mHostProfiler->trap();
       return trap->trap( core, 0xfff9, orgValue );
     }
     else
@@ -379,60 +315,115 @@ private:
     }
   };
 
-  void helper( std::span<std::shared_ptr<IMemoryAccessTrap>> dest, uint16_t address, std::shared_ptr<IMemoryAccessTrap> src )
+  static constexpr uint32_t typeBit( Type type )
+  {
+    return 1u << (int)type;
+  }
+
+  static constexpr uint32_t key( Type type, uint16_t address )
+  {
+    return ( (uint32_t)type << 16 ) | address;
+  }
+
+  static constexpr uint16_t slot( Type type, uint16_t address )
   {
-    if ( dest[address] )
+    switch ( type )
     {
-      auto tmp = std::move( dest[address] );
-      dest[address] = std::make_shared<CompositeTrap>( std::move( tmp ), std::move( src ) );
+    case Type::ROM_READ:
+    case Type::ROM_WRITE:
+    case Type::ROM_EXECUTE:
+      return address & 0x1ff;
+    case Type::MIKEY_READ:
+    case Type::MIKEY_WRITE:
+    case Type::SUZY_READ:
+    case Type::SUZY_WRITE:
+      return address & 0xff;
+    default:
+      return address;
     }
-    else
+  }
+
+  //the common case of no trap of given type at all does not touch the bitmap
+  template<size_t SIZE>
+  bool trapped( Type type, BitArray<SIZE> const& mask, uint16_t address ) const
+  {
+    return ( mTrappedTypes & typeBit( type ) ) != 0 && mask( address );
+  }
+
+  //trap object is looked up only if the bitmap says there is one
+  IMemoryAccessTrap & trap( Type type, uint16_t address )
+  {
+    auto it = mTraps.find( key( type, address ) );
+    assert( it != mTraps.end() );
+    if ( mHostProfiler )
+      mHostProfiler->trap();
+    return *it->second;
+  }
+
+  Proxy mask( Type type, uint16_t address )
+  {
+    switch ( type )
     {
-      dest[address] = std::move( src );
+    case Type::RAM_READ:
+      return mRamReadMask[address];
+    case Type::RAM_WRITE:
+      return mRamWriteMask[address];
+    case Type::RAM_EXECUTE:
+      return mRamExecuteMask[address];
+    case Type::ROM_READ:
+      return mRomReadMask[address];
+    case Type::ROM_WRITE:
+      return mRomWriteMask[address];
+    case Type::ROM_EXECUTE:
+      return mRomExecuteMask[address];
+    case Type::MIKEY_READ:
+      return mMikeyReadMask[address];
+    case Type::MIKEY_WRITE:
+      return mMikeyWriteMask[address];
+    case Type::SUZY_READ:
+      return mSuzyReadMask[address];
+    default:
+      assert( type == Type::SUZY_WRITE );
+      return mSuzyWriteMask[address];
     }
   }
 
-  void helper( std::span<std::shared_ptr<IMemoryAccessTrap>> dest, Proxy proxy, uint16_t address, std::shared_ptr<IMemoryAccessTrap> src )
+  void helper( std::shared_ptr<IMemoryAccessTrap> & dest, std::shared_ptr<IMemoryAccessTrap> src )
   {
-    if ( proxy )
+    if ( dest )
     {
-      auto tmp = std::move( dest[address] );
-      dest[address] = std::make_shared<CompositeTrap>( std::move( tmp ), std::move( src ) );
+      auto tmp = std::move( dest );
+      dest = std::make_shared<CompositeTrap>( std::move( tmp ), std::move( src ) );
     }
     else
     {
-      dest[address] = std::move( src );
-      proxy = true;
+      dest = std::move( src );
     }
   }
 
 
 private:
   BitArray<65536> mRamReadMask;
-  std::array<std::shared_ptr<IMemoryAccessTrap>, 65536> mRamReadTraps;
   BitArray<65536> mRamWriteMask;
-  std::array<std::shared_ptr<IMemoryAccessTrap>, 65536> mRamWriteTraps;
   BitArray<65536> mRamExecuteMask;
-  std::array<std::shared_ptr<IMemoryAccessTrap>, 65536> mRamExecuteTraps;
 
   BitArray<512> mRomReadMask;
-  std::array<std::shared_ptr<IMemoryAccessTrap>, 512> mRomReadTraps;
   BitArray<512> mRomWriteMask;
-  std::array<std::shared_ptr<IMemoryAccessTrap>, 512> mRomWriteTraps;
   BitArray<512> mRomExecuteMask;
-  std::array<std::shared_ptr<IMemoryAccessTrap>, 512> mRomExecuteTraps;
 
   BitArray<256> mMikeyReadMask;
-  std::array<std::shared_ptr<IMemoryAccessTrap>, 256> mMikeyReadTraps;
   BitArray<256> mMikeyWriteMask;
-  std::array<std::shared_ptr<IMemoryAccessTrap>, 256> mMikeyWriteTraps;
 
   BitArray<256> mSuzyReadMask;
-  std::array<std::shared_ptr<IMemoryAccessTrap>, 256> mSuzyReadTraps;
   BitArray<256> mSuzyWriteMask;
-  std::array<std::shared_ptr<IMemoryAccessTrap>, 256> mSuzyWriteTraps;
+
+  //bit per Type that has at least one trap
+  uint32_t mTrappedTypes;
+  //keyed by type and address, so traps of one type are adjacent
+  std::map<uint32_t, std::shared_ptr<IMemoryAccessTrap>> mTraps;
 
   std::shared_ptr<IMemoryAccessTrap> mMapCtlReadTrap;
   std::shared_ptr<IMemoryAccessTrap> mMapCtlWriteTrap;
+  HostProfiler * mHostProfiler;
 };
 
@@ -0,0 +1,204 @@
+#pragma once
+
+//Binary archives used by Core::saveState and Core::loadState.
+//Components describe their state once in template<typename Archive> void serialize( Archive & ar )
+//and the same list of fields is used for both directions.
+
+class StateWriter
+{
+public:
+  static constexpr bool LOADING = false;
+
+  explicit StateWriter( std::vector<uint8_t> & out ) : mOut{ out }
+  {
+  }
+
+  template<typename... Args>
+  void operator()( Args &... args )
+  {
+    ( put( args ), ... );
+  }
+
+  bool good() const
+  {
+    return true;
+  }
+
+private:
+  template<typename T> requires std::is_trivially_copyable_v<T>
+  void put( T const& value )
+  {
+    auto begin = reinterpret_cast<uint8_t const*>( &value );
+    mOut.insert( mOut.end(), begin, begin + sizeof( T ) );
+  }
+
+  template<typename T>
+  void put( std::optional<T> const& value )
+  {
+    put( value.has_value() );
+    put( value.value_or( T{} ) );
+  }
+
+  template<typename T>
+  void put( std::vector<T> const& value )
+  {
+    put( (uint32_t)value.size() );
+    auto begin = reinterpret_cast<uint8_t const*>( value.data() );
+    mOut.insert( mOut.end(), begin, begin + value.size() * sizeof( T ) );
+  }
+
+private:
+  std::vector<uint8_t> & mOut;
+};
+
+class StateReader
+{
+public:
+  static constexpr bool LOADING = true;
+
+  explicit StateReader( std::span<uint8_t const> in ) : mIn{ in }, mOffset{}, mGood{ true }
+  {
+  }
+
+  template<typename... Args>
+  void operator()( Args &... args )
+  {
+    ( get( args ), ... );
+  }
+
+  //false if the input was too short for the requested fields
+  bool good() const
+  {
+    return mGood;
+  }
+
+  bool atEnd() const
+  {
+    return mOffset == mIn.size();
+  }
+
+private:
+  bool take( void * dst, size_t size )
+  {
+    if ( !mGood || mIn.size() - mOffset < size )
+    {
+      mGood = false;
+      return false;
+    }
+    std::memcpy( dst, mIn.data() + mOffset, size );
+    mOffset += size;
+    return true;
+  }
+
+  template<typename T> requires std::is_trivially_copyable_v<T>
+  void get( T & value )
+  {
+    take( &value, sizeof( T ) );
+  }
+
+  template<typename T>
+  void get( std::optional<T> & value )
+  {
+    bool present{};
+    T v{};
+    get( present );
+    get( v );
+    value = present ? std::optional<T>{ v } : std::nullopt;
+  }
+
+  template<typename T>
+  void get( std::vector<T> & value )
+  {
+    uint32_t size{};
+    get( size );
+    if ( !mGood || ( mIn.size() - mOffset ) / sizeof( T ) < size )
+    {
+      mGood = false;
+      return;
+    }
+    value.resize( size );
+    take( value.data(), size * sizeof( T ) );
+  }
+
+private:
+  std::span<uint8_t const> mIn;
+  size_t mOffset;
+  bool mGood;
+};
+
+//Walks a snapshot like StateReader without storing anything, so that Core::loadState fails before touching the machine.
+//Components take their saving path, which describes the same fields.
+class StateValidator
+{
+public:
+  static constexpr bool LOADING = false;
+
+  explicit StateValidator( std::span<uint8_t const> in ) : mIn{ in }, mOffset{}, mGood{ true }
+  {
+  }
+
+  template<typename... Args>
+  void operator()( Args const&... args )
+  {
+    ( skip( args ), ... );
+  }
+
+  bool good() const
+  {
+    return mGood;
+  }
+
+  bool atEnd() const
+  {
+    return mOffset == mIn.size();
+  }
+
+private:
+  bool take( size_t size )
+  {
+    if ( !mGood || mIn.size() - mOffset < size )
+    {
+      mGood = false;
+      return false;
+    }
+    mOffset += size;
+    return true;
+  }
+
+  template<typename T> requires std::is_trivially_copyable_v<T>
+  void skip( T const& )
+  {
+    take( sizeof( T ) );
+  }
+
+  template<typename T>
+  void skip( std::optional<T> const& )
+  {
+    take( sizeof( bool ) );
+    take( sizeof( T ) );
+  }
+
+  template<typename T>
+  void skip( std::vector<T> const& )
+  {
+    uint32_t size{};
+    if ( !mGood || mIn.size() - mOffset < sizeof( size ) )
+    {
+      mGood = false;
+      return;
+    }
+    std::memcpy( &size, mIn.data() + mOffset, sizeof( size ) );
+    mOffset += sizeof( size );
+    if ( ( mIn.size() - mOffset ) / sizeof( T ) < size )
+    {
+      mGood = false;
+      return;
+    }
+    take( size * sizeof( T ) );
+  }
+
+private:
+  std::span<uint8_t const> mIn;
+  size_t mOffset;
+  bool mGood;
+};
@@ -4,6 +4,7 @@
 #include "SuzyProcess.hpp"
 #include "Cartridge.hpp"
 #include "Log.hpp"
+#include "StateArchive.hpp"
 
 Suzy::Suzy( Core & core, std::shared_ptr<IInputSource> inputSource ) : mCore{ core }, mSCB{}, mMath{ mCore.getTraceHelper() }, mInputSource{ inputSource }, mAccessTick{},
   mPalette{}, mBusEnable{}, mNoCollide{}, mVStretch{}, mLeftHand{ true }, mUnsafeAccess{}, mSpriteStop{},
@@ -178,16 +179,11 @@ uint8_t Suzy::read( uint16_t address )
     break;
   case JOYSTICK:
   {
-    uint8_t joystick = mInputSource->getInput( mLeftHand != 0 ).joystick();
+    uint8_t joystick = mInputSource->readInput( mLeftHand != 0, mAccessTick ).joystick();
     return joystick;
   }
   case SWITCHES:
-  {
-    uint8_t switches = mInputSource->getInput( mLeftHand != 0 ).switches() |
-      ( mCore.getCartridge().isCart0Inactive() ? SWITCHES::CART0_STROBE : 0 ) |
-      ( mCore.getCartridge().isCart1Inactive() ? SWITCHES::CART1_STROBE : 0 );
-    return switches;
-  }
+    return switches( mInputSource->readInput( mLeftHand != 0, mAccessTick ) );
   case RCART0:
     return mCore.getCartridge().peekRCART0( mAccessTick );
   case RCART1:
@@ -195,7 +191,7 @@ uint8_t Suzy::read( uint16_t address )
     //incrementing counter...
     mCore.getCartridge().peekRCART1( mAccessTick );
     //... but looks like mirror of joystick
-    return mInputSource->getInput( mLeftHand != 0 ).joystick();
+    return mInputSource->readInput( mLeftHand != 0, mAccessTick ).joystick();
   }
   default:
     if ( address < 0x80 )
@@ -211,6 +207,22 @@ uint8_t Suzy::read( uint16_t address )
   }
 }
 
+uint8_t Suzy::debugRead( uint16_t address )
+{
+  switch ( address & 0xff )
+  {
+  case JOYSTICK:
+    return mInputSource->getInput( mLeftHand != 0 ).joystick();
+  case SWITCHES:
+    return switches( mInputSource->getInput( mLeftHand != 0 ) );
+  case RCART1:
+    //neither increments the counter
+    return mInputSource->getInput( mLeftHand != 0 ).joystick();
+  default:
+    return read( address );
+  }
+}
+
 void Suzy::write( uint16_t address, uint8_t value )
 {
   address &= 0xff;
@@ -489,7 +501,26 @@ uint8_t Suzy::noice( uint64_t tick )
   }
 }
 
+uint8_t Suzy::switches( KeyInput input )
+{
+  return input.switches() |
+    ( mCore.getCartridge().isCart0Inactive() ? SWITCHES::CART0_STROBE : 0 ) |
+    ( mCore.getCartridge().isCart1Inactive() ? SWITCHES::CART1_STROBE : 0 );
+}
+
 std::shared_ptr<ISuzyProcess> Suzy::suzyProcess()
 {
   return std::make_shared<SuzyProcess>( *this );
 }
+
+template<typename Archive>
+void Suzy::serialize( Archive & ar )
+{
+  ar( mSCB, mAccessTick, mPalette, mBusEnable, mNoCollide, mVStretch, mLeftHand, mUnsafeAccess, mSpriteStop, mSpriteWorking,
+    mHFlip, mVFlip, mLiteral, mAlgo3, mReusePalette, mSkipSprite, mEveron, mStartingQuadrant, mBpp, mSpriteType, mReload, mSprColl, mSprInit );
+  mMath.serialize( ar );
+}
+
+template void Suzy::serialize<StateWriter>( StateWriter & );
+template void Suzy::serialize<StateReader>( StateReader & );
+template void Suzy::serialize<StateValidator>( StateValidator & );
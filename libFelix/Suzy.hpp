@@ -37,6 +37,8 @@ public:
   virtual ~ISuzyProcess() = default;
   virtual Request const* advance() = 0;
   virtual void respond( uint32_t value ) = 0;
+  //next advance returns current request again instead of resuming the process
+  virtual void postpone() = 0;
 };
 
 class Suzy
@@ -47,12 +49,17 @@ public:
   uint64_t requestRead( uint64_t tick, uint16_t address );
   uint64_t requestWrite( uint64_t tick, uint16_t address );
   uint8_t read( uint16_t address );
+  //reads registers mirroring the input without counting as reads of the emulation
+  uint8_t debugRead( uint16_t address );
   void write( uint16_t address, uint8_t value );
   uint16_t debugVidBas() const;
   uint16_t debugCollBas() const;
 
   std::shared_ptr<ISuzyProcess> suzyProcess();
 
+  template<typename Archive>
+  void serialize( Archive & ar );
+
   friend class SuzyProcess;
 
   static constexpr uint16_t TMPADR    = 0x00;
@@ -282,6 +289,7 @@ private:
   void writeSPRCOLL( uint8_t value );
   int bpp() const;
   uint8_t noice( uint64_t tick );
+  uint8_t switches( KeyInput input );
 
   void debugCollisions();
 
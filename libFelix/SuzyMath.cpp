@@ -2,6 +2,7 @@
 #include "SuzyMath.hpp"
 #include "TraceHelper.hpp"
 #include "Utility.hpp"
+#include "StateArchive.hpp"
 
 namespace
 {
@@ -287,3 +288,13 @@ void SuzyMath::np( uint16_t value )
 }
 
 
+
+template<typename Archive>
+void SuzyMath::serialize( Archive & ar )
+{
+  ar( mArea, mFinishTick, mSignAB, mSignCD, mUnsafeAccess, mSignMath, mAccumulate, mMathWarning, mMathCarry );
+}
+
+template void SuzyMath::serialize<StateWriter>( StateWriter & );
+template void SuzyMath::serialize<StateReader>( StateReader & );
+template void SuzyMath::serialize<StateValidator>( StateValidator & );
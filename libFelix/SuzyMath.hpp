@@ -26,6 +26,9 @@ public:
   void carry( bool value );
   void unsafeAccess( bool value );
 
+  template<typename Archive>
+  void serialize( Archive & ar );
+
 private:
 
   uint32_t abcd() const;
@@ -1,11 +1,17 @@
 #include "pch.hpp"
 #include "SuzyProcess.hpp"
+#include "Core.hpp"
 #include "VidOperator.hpp"
 #include "ColOperator.hpp"
 #include "Log.hpp"
 #include "SpriteLineParser.hpp"
 #include "Utility.hpp"
 
+bool SuzyProcess::accessInline()
+{
+  return mSuzy.mCore.inlineSuzyAction( request, response.value );
+}
+
 SuzyProcess::ProcessCoroutine SuzyProcess::process()
 {
   auto & suzy = mSuzy;
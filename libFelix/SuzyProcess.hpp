@@ -7,14 +7,21 @@ class SuzyProcess : public ISuzyProcess
 public:
   struct Response
   {
-    bool await_ready() { return false; }
-    void await_suspend( std::coroutine_handle<> c ) {}
     uint32_t value;
   };
 
+  //Awaiters only refer to the process, see CPU::Awaiter
+  struct Awaiter
+  {
+    SuzyProcess & process;
+
+    bool await_ready() { return process.accessInline(); }
+    void await_suspend( std::coroutine_handle<> c ) {}
+  };
+
 public:
 
-  SuzyProcess( Suzy & suzy ) : mSuzy{ suzy }, mProcessCoroutine{ process() }, request{}, response{}
+  SuzyProcess( Suzy & suzy ) : mSuzy{ suzy }, mProcessCoroutine{ process() }, request{}, response{}, mPostponed{}
   {
   }
 
@@ -22,11 +29,12 @@ public:
 
   Request const* advance() override
   {
-    if ( mSuzy.mSpriteWorking )
-      mProcessCoroutine.resume();
-    else
+    if ( !mSuzy.mSpriteWorking )
       setFinish();
+    else if ( !mPostponed )
+      mProcessCoroutine.resume();
 
+    mPostponed = false;
     return &request;
   }
 
@@ -35,102 +43,109 @@ public:
     response.value = value;
   }
 
+  void postpone() override
+  {
+    mPostponed = true;
+  }
+
 private:
 
+  bool accessInline();
+
   void setFinish()
   {
     mSuzy.mSpriteWorking = false;
     request = { Request::FINISH };
   }
 
-  auto & suzyRead( uint16_t address )
+  auto suzyRead( uint16_t address )
   {
-    struct SuzyReadResponse : public Response
+    struct SuzyReadResponse : public Awaiter
     {
-      uint8_t await_resume() { return (uint8_t)value; }
+      uint8_t await_resume() { return (uint8_t)process.response.value; }
     };
     request = { Request::READ, address };
-    return static_cast<SuzyReadResponse &>( response );
+    return SuzyReadResponse{ { *this } };
   }
 
-  auto & suzyFetchSCB( uint16_t address )
+  auto suzyFetchSCB( uint16_t address )
   {
-    struct SuzyFetchSCBResponse : public Response
+    struct SuzyFetchSCBResponse : public Awaiter
     {
-      uint8_t await_resume() { return (uint8_t)value; }
+      uint8_t await_resume() { return (uint8_t)process.response.value; }
     };
     request = { Request::FETCHSCB, address };
-    return static_cast<SuzyFetchSCBResponse &>( response );
+    return SuzyFetchSCBResponse{ { *this } };
   }
 
-  auto & suzyRead4( uint16_t address )
+  auto suzyRead4( uint16_t address )
   {
-    struct SuzyRead4Response : public Response
+    struct SuzyRead4Response : public Awaiter
     {
-      uint32_t await_resume() { return value; }
+      uint32_t await_resume() { return process.response.value; }
     };
     request = { Request::READ4, address };
-    return static_cast<SuzyRead4Response &>( response );
+    return SuzyRead4Response{ { *this } };
   }
 
-  auto & suzyReadPal( uint16_t address )
+  auto suzyReadPal( uint16_t address )
   {
-    struct SuzyReadPalResponse : public Response
+    struct SuzyReadPalResponse : public Awaiter
     {
-      uint32_t await_resume() { return value; }
+      uint32_t await_resume() { return process.response.value; }
     };
     request = { Request::READPAL, address };
-    return static_cast<SuzyReadPalResponse &>( response );
+    return SuzyReadPalResponse{ { *this } };
   }
 
-  auto & suzyWrite( uint16_t address, uint8_t value )
+  auto suzyWrite( uint16_t address, uint8_t value )
   {
-    struct SuzyWriteResponse : public Response
+    struct SuzyWriteResponse : public Awaiter
     {
       void await_resume() {}
     };
     request = { Request::WRITE,  address, value };
-    return static_cast<SuzyWriteResponse &>( response );
+    return SuzyWriteResponse{ { *this } };
   }
 
-  auto & suzyWriteFred( uint16_t address, uint8_t value )
+  auto suzyWriteFred( uint16_t address, uint8_t value )
   {
-    struct SuzyWriteResponse : public Response
+    struct SuzyWriteResponse : public Awaiter
     {
       void await_resume() {}
     };
     request = { Request::WRITEFRED,  address, value };
-    return static_cast<SuzyWriteResponse &>( response );
+    return SuzyWriteResponse{ { *this } };
   }
 
-  auto & suzyColRMW( uint32_t mask, uint16_t address, uint16_t value )
+  auto suzyColRMW( uint32_t mask, uint16_t address, uint16_t value )
   {
-    struct SuzyColRMWResponse : public Response
+    struct SuzyColRMWResponse : public Awaiter
     {
-      uint32_t await_resume() { return value; }
+      uint32_t await_resume() { return process.response.value; }
     };
     request = { Request::COLRMW, address, value, mask };
-    return static_cast<SuzyColRMWResponse &>( response );
+    return SuzyColRMWResponse{ { *this } };
   }
 
-  auto & suzyVidRMW( uint16_t address, uint8_t value, uint8_t mask )
+  auto suzyVidRMW( uint16_t address, uint8_t value, uint8_t mask )
   {
-    struct SuzyVidRMWResponse : public Response
+    struct SuzyVidRMWResponse : public Awaiter
     {
       void await_resume() {}
     };
     request = { Request::VIDRMW, address, value, mask };
-    return static_cast<SuzyVidRMWResponse &>( response );
+    return SuzyVidRMWResponse{ { *this } };
   }
 
-  auto & suzyXOR( uint16_t address, uint8_t value )
+  auto suzyXOR( uint16_t address, uint8_t value )
   {
-    struct SuzyXORResponse : public Response
+    struct SuzyXORResponse : public Awaiter
     {
       void await_resume() {}
     };
     request = { Request::XOR, address, value };
-    return static_cast<SuzyXORResponse &>( response );
+    return SuzyXORResponse{ { *this } };
   }
 
   struct ProcessCoroutine : private NonCopyable
@@ -182,4 +197,5 @@ private:
 
   Request request;
   Response response;
+  bool mPostponed;
 };
@@ -1,5 +1,6 @@
 #include "pch.hpp"
 #include "SymbolSource.hpp"
+#include <charconv>
 
 namespace
 {
@@ -186,31 +187,48 @@ static constexpr std::pair<char const*, uint16_t> defaultSymbols[] = {
 };
 }
 
-SymbolSource::SymbolSource() : mSymbols{}
+SymbolSource::SymbolSource() : mSymbols{}, mValues{}
 {
 }
 
-SymbolSource::SymbolSource( std::filesystem::path const& labPath ) : mSymbols{}
+SymbolSource::SymbolSource( std::filesystem::path const& labPath ) : mSymbols{}, mValues{}
 {
   if ( labPath.empty() )
     return;
 
-  std::ifstream fin{ labPath };
+  std::ifstream fin{ labPath, std::ios::binary };
+  std::string const text{ std::istreambuf_iterator<char>{ fin }, std::istreambuf_iterator<char>{} };
+
+  std::string_view rest = text;
+  auto nextLine = [&]
+  {
+    size_t end = rest.find( '\n' );
+    std::string_view line = rest.substr( 0, end );
+    rest = end == std::string_view::npos ? std::string_view{} : rest.substr( end + 1 );
+    return line;
+  };
 
-  std::string line;
   //skip two lines
-  std::getline( fin, line );
-  std::getline( fin, line );
+  nextLine();
+  nextLine();
 
-  while ( std::getline( fin, line ) && !line.empty() )
+  while ( !rest.empty() )
   {
+    std::string_view line = nextLine();
+    if ( line.empty() )
+      break;
+
     if ( auto symbol = parseLine( line ) )
     {
-      mSymbols.push_back( std::move( symbol ) );
+      mValues.emplace( symbol->name, symbol->value );
+      mSymbols.push_back( std::move( *symbol ) );
     }
   }
 
-  std::ranges::sort( mSymbols, {}, &Symbol::name );
+  std::ranges::sort( mSymbols, []( Symbol const& left, Symbol const& right )
+  {
+    return left.value < right.value || ( left.value == right.value && left.name < right.name );
+  } );
 }
 
 SymbolSource::~SymbolSource()
@@ -221,26 +239,62 @@ std::optional<uint16_t> SymbolSource::symbol( std::string const& name ) const
 {
   std::string upper;
   std::transform( name.cbegin(), name.cend(), std::back_inserter( upper ), []( std::string::value_type c ) { return std::toupper( c ); } );
-  auto it = std::ranges::lower_bound( mSymbols, upper, {}, &Symbol::name );
-
-  if ( it != mSymbols.cend() && it->name == upper )
-    return it->value;
+  if ( auto it = mValues.find( upper ); it != mValues.cend() )
+    return it->second;
 
   auto it2 = std::ranges::lower_bound( defaultSymbols, upper, {}, []( auto const& p ) { return p.first; } );
 
   return it2 != std::cend( defaultSymbols ) && it2->first == upper ? it2->second : std::optional<uint16_t>{};
 }
 
-SymbolSource::Symbol SymbolSource::parseLine( std::string const& line )
+std::string const* SymbolSource::name( uint16_t value ) const
+{
+  auto it = std::ranges::lower_bound( mSymbols, value, {}, &Symbol::value );
+  return it != mSymbols.cend() && it->value == value ? &it->name : nullptr;
+}
+
+std::optional<SymbolSource::Offset> SymbolSource::nearest( uint16_t value ) const
 {
-  std::istringstream is{ line };
-  std::string name;
-  int bank, adr;
+  auto it = std::ranges::upper_bound( mSymbols, value, {}, &Symbol::value );
+  if ( it == mSymbols.cbegin() )
+    return std::nullopt;
+
+  //the first one of the greatest value not above given one
+  it = std::ranges::lower_bound( mSymbols, std::prev( it )->value, {}, &Symbol::value );
+  return Offset{ &it->name, (uint16_t)( value - it->value ) };
+}
+
+//Line is bank, address and name separated by white space, numbers being hexadecimal. Only symbols of bank 0 are taken
+std::optional<SymbolSource::Symbol> SymbolSource::parseLine( std::string_view line )
+{
+  auto skipSpace = [&]
+  {
+    while ( !line.empty() && std::isspace( (unsigned char)line.front() ) )
+      line.remove_prefix( 1 );
+  };
+
+  auto hex = [&]() -> std::optional<int>
+  {
+    skipSpace();
+    int value{};
+    auto [ptr, ec] = std::from_chars( line.data(), line.data() + line.size(), value, 16 );
+    if ( ec != std::errc{} )
+      return std::nullopt;
+    line.remove_prefix( ptr - line.data() );
+    return value;
+  };
+
+  auto bank = hex();
+  auto adr = hex();
+  if ( !bank || !adr || *bank != 0 )
+    return std::nullopt;
 
-  is >> std::hex >> bank >> adr >> name;
+  skipSpace();
+  size_t size = 0;
+  while ( size < line.size() && !std::isspace( (unsigned char)line[size] ) )
+    size += 1;
+  if ( size == 0 )
+    return std::nullopt;
 
-  if ( bank == 0 )
-    return { std::move( name ), (uint16_t)adr };
-  else
-    return {};
+  return Symbol{ std::string{ line.substr( 0, size ) }, (uint16_t)*adr };
 }
@@ -1,27 +1,37 @@
 #pragma once
 
+#include <unordered_map>
+
 class SymbolSource
 {
   struct Symbol
   {
     std::string name;
     uint16_t value;
-
-    explicit operator bool() const
-    {
-      return !name.empty();
-    }
   };
 
 public:
+  //symbol and the distance of a value from it
+  struct Offset
+  {
+    std::string const* name;
+    uint16_t offset;
+  };
+
   SymbolSource();
   SymbolSource( std::filesystem::path const& labPath );
   ~SymbolSource();
   std::optional<uint16_t> symbol( std::string const& name ) const;
+  //name of a symbol of given value loaded from the file, null if there is none. The first in alphabetical order if there are more
+  std::string const* name( uint16_t value ) const;
+  //symbol loaded from the file with the greatest value not above given one, e.g. to name an address as label+offset
+  std::optional<Offset> nearest( uint16_t value ) const;
 
 private:
-  Symbol parseLine( std::string const& line );
+  static std::optional<Symbol> parseLine( std::string_view line );
 
 private:
+  //sorted by value and name
   std::vector<Symbol> mSymbols;
+  std::unordered_map<std::string, uint16_t> mValues;
 };
@@ -1,5 +1,6 @@
 #include "pch.hpp"
 #include "TimerCore.hpp"
+#include "StateArchive.hpp"
 
 TimerCore::TimerCore( int number, std::function<void( uint64_t, bool )> trigger ) :
   mBaseTick{}, mExpectedTick{}, mBorrowInTick{}, mBorrowOutTick{}, mTrigger{ std::move( trigger ) }, mNumber{ number },
@@ -143,3 +144,14 @@ SequencedAction TimerCore::computeAction()
 
   return { (Action)( ( int )Action::FIRE_TIMER0 + mNumber ), mExpectedTick };
 }
+
+template<typename Archive>
+void TimerCore::serialize( Archive & ar )
+{
+  ar( mBaseTick, mExpectedTick, mBorrowInTick, mBorrowOutTick, mEnableInt, mResetDone, mEnableReload, mEnableCount, mLinking, mAudShift,
+    mValue, mBackup, mTimerDone, mLastClock, mBorrowIn, mBorrowOut );
+}
+
+template void TimerCore::serialize<StateWriter>( StateWriter & );
+template void TimerCore::serialize<StateReader>( StateReader & );
+template void TimerCore::serialize<StateValidator>( StateValidator & );
@@ -20,6 +20,9 @@ public:
   SequencedAction fireAction( uint64_t tick );
   void borrowIn( uint64_t tick );
 
+  template<typename Archive>
+  void serialize( Archive & ar );
+
 private:
   SequencedAction computeAction();
   void updateValue( uint64_t tick );
@@ -1,101 +1,12 @@
 #include "pch.hpp"
 #include "TraceHelper.hpp"
 
-static constexpr int LABEL_SIZE_LIMIT = 20;
-
-TraceHelper::TraceHelper() : mLabels{}, mTraceComment{}, mData{}, mCommentView{}, mCommentCursor{}, mEnabled{}
+namespace
 {
-  char buf[256];
-  for ( size_t i = 0; i < 65536; ++i )
-  {
-    mLabels[i] = (uint32_t)mData.size();
-    char const* ptr = map( (uint16_t)i, buf );
-    size_t size = 0;
-    do
-    {
-      mData.push_back( *ptr );
-      size += 1;
-    } while ( *ptr++ );
-    while ( size-- > LABEL_SIZE_LIMIT )
-    {
-      mData.pop_back();
-    }
-    mData.back() = '\0';
-  }
-}
-
-TraceHelper::~TraceHelper()
-{
-}
-
-void TraceHelper::updateLabel( uint16_t address, const char* label )
-{
-  if ( address > 0xffff )
-  {
-    return;
-  }
-
-  auto labelLen = strlen( label );
-  if ( labelLen <= 0 || labelLen > LABEL_SIZE_LIMIT )
-  {
-    return;
-  }
-
-  auto currPos = mLabels[address];
 
-  std::vector<char>::iterator iterFirst = mData.begin() + currPos;
-  auto iterLast = iterFirst;
-
-  while ( *iterLast != 0 )
-  {
-    iterLast += 1;
-    labelLen--;
-  }
-
-  mData.erase( iterFirst, iterLast );
-  
-  iterFirst = mData.begin() + currPos;
-  for ( int i = 0; i < strlen( label ); ++i )
-  {
-    iterFirst = mData.insert( iterFirst, label[i]) + 1;
-  }
-  
-  do 
-  {
-    mLabels[++address] += (uint32_t)labelLen;
-  } while ( address < 0xffff );
-}
-
-char const * TraceHelper::addressLabel( uint16_t address ) const
-{
-  return mData.data() + mLabels[address];
-}
-
-void TraceHelper::enable( bool cond )
-{
-  mEnabled = cond;
-}
-
-std::shared_ptr<std::string_view> TraceHelper::getTraceComment()
-{
-  if ( mCommentCursor )
-  {
-    mCommentView = std::string_view{ mTraceComment.data(), mCommentCursor };
-    return std::shared_ptr<std::string_view>{
-      &mCommentView,
-        [this]( auto p )
-      {
-        mCommentCursor = 0;
-      }
-    };
-  }
-  else
-  {
-    return {};
-  }
-}
+static constexpr int LABEL_SIZE_LIMIT = 20;
 
-char const * TraceHelper::map( uint16_t address, char * dest ) const
+char const * map( uint16_t address, char * dest )
 {
   switch ( address )
   {
@@ -532,3 +443,78 @@ char const * TraceHelper::map( uint16_t address, char * dest ) const
     return dest;
   }
 }
+
+}
+
+//Names of hardware registers and hex numbers of other addresses
+class TraceHelper::DefaultLabels
+{
+public:
+  DefaultLabels() : mOffsets{}, mData{}
+  {
+    char buf[256];
+    for ( size_t i = 0; i < mOffsets.size(); ++i )
+    {
+      mOffsets[i] = (uint32_t)mData.size();
+      std::string_view label = map( (uint16_t)i, buf );
+      label = label.substr( 0, LABEL_SIZE_LIMIT - 1 );
+      mData.insert( mData.end(), label.cbegin(), label.cend() );
+      mData.push_back( '\0' );
+    }
+  }
+
+  char const* operator[]( uint16_t address ) const
+  {
+    return mData.data() + mOffsets[address];
+  }
+
+private:
+  std::array<uint32_t, 65536> mOffsets;
+  std::vector<char> mData;
+};
+
+TraceHelper::DefaultLabels const& TraceHelper::defaultLabels()
+{
+  static DefaultLabels const labels{};
+  return labels;
+}
+
+TraceHelper::TraceHelper() : mDefaultLabels{ defaultLabels() }, mUserLabels{}, mTraceComment{}, mCommentCursor{}, mEnabled{}
+{
+}
+
+TraceHelper::~TraceHelper()
+{
+}
+
+void TraceHelper::updateLabel( uint16_t address, const char* label )
+{
+  auto labelLen = strlen( label );
+  if ( labelLen <= 0 || labelLen > LABEL_SIZE_LIMIT )
+  {
+    return;
+  }
+
+  mUserLabels.insert_or_assign( address, std::string{ label } );
+}
+
+char const * TraceHelper::addressLabel( uint16_t address ) const
+{
+  if ( !mUserLabels.empty() )
+  {
+    if ( auto it = mUserLabels.find( address ); it != mUserLabels.cend() )
+      return it->second.c_str();
+  }
+
+  return mDefaultLabels[address];
+}
+
+void TraceHelper::enable( bool cond )
+{
+  mEnabled = cond;
+}
+
+std::string_view TraceHelper::getTraceComment()
+{
+  return std::string_view{ mTraceComment.data(), std::exchange( mCommentCursor, 0 ) };
+}
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "fmt/format.h"
+#include <unordered_map>
 
 //https://stackoverflow.com/questions/68675303/how-to-create-a-function-that-forwards-its-arguments-to-fmtformat-keeping-the
 template <std::size_t N>
@@ -36,16 +37,20 @@ public:
     mCommentCursor = std::distance( mTraceComment.begin(), out );
   }
 
-  std::shared_ptr<std::string_view> getTraceComment();
+  //comment collected during the instruction, valid until the next one adds to it
+  std::string_view getTraceComment();
 
 private:
-  char const * map( uint16_t address, char * dest ) const;
+  class DefaultLabels;
+
+  //built on first use and shared by all TraceHelpers
+  static DefaultLabels const& defaultLabels();
 
 private:
-  std::array<uint32_t, 65536> mLabels;
+  DefaultLabels const& mDefaultLabels;
+  //labels set by updateLabel over the default ones
+  std::unordered_map<uint16_t, std::string> mUserLabels;
   std::array<char, 1024> mTraceComment;
-  std::vector<char> mData;
-  std::string_view mCommentView;
   size_t mCommentCursor;
   bool mEnabled;
 };
@@ -44,6 +44,34 @@ enum class RunMode
   RUN
 };
 
+enum class CpuEngine
+{
+  //every bus access suspends CPU and Suzy coroutines and is dispatched by Core::run
+  COROUTINE,
+  //RAM accesses that can't be observed by the rest of the system are served without suspending
+  INLINE
+};
+
+enum class OutputPolicy
+{
+  //video sink receives every frame
+  ALL_FRAMES,
+  //video sink receives only the last frame, frames before it are not emitted at all
+  LAST_FRAME
+};
+
+//Policies of CPU and Core code compiled twice, with and without debugger hooks, i.e. memory traps, trace and history.
+//The variant is switched on instruction boundary, see CPU::execute
+struct Instrumented
+{
+  static constexpr bool enabled = true;
+};
+
+struct Bare
+{
+  static constexpr bool enabled = false;
+};
+
 std::vector<uint8_t> readFile( std::filesystem::path const& path );
 
 static constexpr int SCREEN_WIDTH = 160;
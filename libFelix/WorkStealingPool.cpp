@@ -0,0 +1,150 @@
+#include "pch.hpp"
+#include "WorkStealingPool.hpp"
+
+namespace
+{
+
+struct Worker
+{
+  WorkStealingPool const* pool;
+  size_t index;
+};
+
+//identifies the pool and the deque of the calling thread
+thread_local Worker tWorker{};
+
+}
+
+WorkStealingPool::WorkStealingPool( size_t workers ) : mQueues{}, mThreads{}, mMutex{}, mWake{}, mIdle{}, mQueued{}, mUnfinished{}, mNextQueue{}, mStop{}
+{
+  workers = std::max<size_t>( workers, 1 );
+
+  for ( size_t i = 0; i < workers; ++i )
+  {
+    mQueues.push_back( std::make_unique<Queue>() );
+  }
+
+  for ( size_t i = 0; i < workers; ++i )
+  {
+    mThreads.emplace_back( [this, i]
+    {
+      work( i );
+    } );
+  }
+}
+
+WorkStealingPool::~WorkStealingPool()
+{
+  wait();
+
+  {
+    std::scoped_lock<std::mutex> lock{ mMutex };
+    mStop = true;
+  }
+  mWake.notify_all();
+
+  for ( auto& thread : mThreads )
+  {
+    thread.join();
+  }
+}
+
+void WorkStealingPool::submit( Task task )
+{
+  size_t index;
+
+  {
+    std::scoped_lock<std::mutex> lock{ mMutex };
+    index = tWorker.pool == this ? tWorker.index : mNextQueue++ % mQueues.size();
+    //counted before it is visible so a worker that takes it can't see the counters going below zero
+    mQueued += 1;
+    mUnfinished += 1;
+  }
+
+  {
+    auto& queue = *mQueues[index];
+    std::scoped_lock<std::mutex> lock{ queue.mutex };
+    queue.tasks.push_back( std::move( task ) );
+  }
+
+  mWake.notify_one();
+}
+
+void WorkStealingPool::wait()
+{
+  std::unique_lock<std::mutex> lock{ mMutex };
+  mIdle.wait( lock, [this]
+  {
+    return mUnfinished == 0;
+  } );
+}
+
+size_t WorkStealingPool::workers() const
+{
+  return mThreads.size();
+}
+
+void WorkStealingPool::work( size_t index )
+{
+  tWorker = { this, index };
+
+  for ( ;; )
+  {
+    if ( auto task = pop( index ) )
+    {
+      {
+        std::scoped_lock<std::mutex> lock{ mMutex };
+        mQueued -= 1;
+      }
+
+      ( *task )();
+
+      bool idle;
+      {
+        std::scoped_lock<std::mutex> lock{ mMutex };
+        idle = --mUnfinished == 0;
+      }
+      if ( idle )
+        mIdle.notify_all();
+    }
+    else
+    {
+      std::unique_lock<std::mutex> lock{ mMutex };
+      mWake.wait( lock, [this]
+      {
+        return mStop || mQueued > 0;
+      } );
+
+      if ( mStop && mQueued == 0 )
+        return;
+    }
+  }
+}
+
+std::optional<WorkStealingPool::Task> WorkStealingPool::pop( size_t index )
+{
+  {
+    auto& queue = *mQueues[index];
+    std::scoped_lock<std::mutex> lock{ queue.mutex };
+    if ( !queue.tasks.empty() )
+    {
+      Task task = std::move( queue.tasks.back() );
+      queue.tasks.pop_back();
+      return task;
+    }
+  }
+
+  for ( size_t i = 1; i < mQueues.size(); ++i )
+  {
+    auto& queue = *mQueues[( index + i ) % mQueues.size()];
+    std::scoped_lock<std::mutex> lock{ queue.mutex };
+    if ( !queue.tasks.empty() )
+    {
+      Task task = std::move( queue.tasks.front() );
+      queue.tasks.pop_front();
+      return task;
+    }
+  }
+
+  return std::nullopt;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "Utility.hpp"
+
+//Fixed set of worker threads each owning a deque of tasks.
+//A worker runs its own tasks newest first and when it runs out it steals the oldest task of another worker.
+//Tasks submitted from a worker go to that worker's deque, so a task that reschedules itself
+//(e.g. to run its Core for another slice) stays on the same thread unless somebody is idle.
+//
+//Core instances do not share any mutable state, so each one may be driven from any worker
+//as long as it is driven by one thread at a time. Cores connected with the same ComLynxWire are an exception
+//and must be run by the same task, or by LinkSession on threads of their own.
+class WorkStealingPool : private NonCopyable
+{
+public:
+  using Task = std::function<void()>;
+
+  explicit WorkStealingPool( size_t workers = std::thread::hardware_concurrency() );
+  //finishes all submitted tasks before joining workers
+  ~WorkStealingPool();
+
+  void submit( Task task );
+  //blocks until all submitted tasks, including the ones submitted by tasks, are finished
+  void wait();
+
+  size_t workers() const;
+
+private:
+  struct Queue
+  {
+    std::mutex mutex;
+    std::deque<Task> tasks;
+  };
+
+  void work( size_t index );
+  std::optional<Task> pop( size_t index );
+
+private:
+  std::vector<std::unique_ptr<Queue>> mQueues;
+  std::vector<std::thread> mThreads;
+  std::mutex mMutex;
+  std::condition_variable mWake;
+  std::condition_variable mIdle;
+  size_t mQueued;
+  size_t mUnfinished;
+  size_t mNextQueue;
+  bool mStop;
+};
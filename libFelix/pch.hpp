@@ -7,12 +7,15 @@
 #include <cassert>
 #include <chrono>
 #include <concepts>
+#include <condition_variable>
 #include <coroutine>
 #include <cstdint>
+#include <deque>
 #include <filesystem>
 #include <fstream>
 #include <functional>
 #include <limits>
+#include <map>
 #include <memory>
 #include <mutex>
 #include <optional>
@@ -22,6 +25,7 @@
 #include <span>
 #include <string>
 #include <stdexcept>
+#include <thread>
 #include <vector>
 
 #define BOOST_MP_STANDALONE